@@ -0,0 +1,275 @@
+#include "channel.h"
+#include "iomanager.h"
+#include "scheduler.h"
+#include "util.h"
+#include "macro.h"
+#include <unistd.h>
+
+namespace focus {
+
+void ChannelWakeup::wake() {
+    if(m_sem) {
+        m_sem->notify();
+        return;
+    }
+    Fiber::ptr fiber;
+    fiber.swap(m_fiber);
+    FOCUS_ASSERT(m_scheduler && fiber);
+    m_scheduler->schedule(fiber);
+}
+
+bool ChannelSelectState::fire(int index, ChannelWakeup& wakeup) {
+    int expected = WAITING;
+    if(!m_firedBy.compare_exchange_strong(expected, index)) {
+        return false;
+    }
+    wakeup.m_scheduler = m_wakeup.m_scheduler;
+    wakeup.m_fiber.swap(m_wakeup.m_fiber);
+    wakeup.m_sem = m_wakeup.m_sem;
+    return true;
+}
+
+void ChannelWaitList::push(ChannelWaiter* waiter) {
+    waiter->m_prev = m_tail;
+    waiter->m_next = nullptr;
+    waiter->m_linked = true;
+    if(m_tail) {
+        m_tail->m_next = waiter;
+    }else {
+        m_head = waiter;
+    }
+    m_tail = waiter;
+}
+
+void ChannelWaitList::remove(ChannelWaiter* waiter) {
+    if(waiter->m_prev) {
+        waiter->m_prev->m_next = waiter->m_next;
+    }else {
+        m_head = waiter->m_next;
+    }
+    if(waiter->m_next) {
+        waiter->m_next->m_prev = waiter->m_prev;
+    }else {
+        m_tail = waiter->m_prev;
+    }
+    waiter->m_prev = nullptr;
+    waiter->m_next = nullptr;
+    waiter->m_linked = false;
+}
+
+ChannelWaiter* ChannelWaitList::pop() {
+    ChannelWaiter* waiter = m_head;
+    if(waiter) {
+        remove(waiter);
+    }
+    return waiter;
+}
+
+void ChannelBase::close() {
+    if(m_closed.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    std::vector<ChannelWakeup> wakeups;
+    {
+        SpinLock::Lock lock(m_mutex);
+        ChannelWakeup wakeup;
+        for(ChannelWaiter* w = m_sendWaiters.pop(); w; w = m_sendWaiters.pop()) {
+            m_sendWaiting.fetch_sub(1, std::memory_order_relaxed);
+            if(w->m_state->fire(w->m_index, wakeup)) {
+                wakeups.push_back(std::move(wakeup));
+            }
+        }
+        for(ChannelWaiter* w = m_recvWaiters.pop(); w; w = m_recvWaiters.pop()) {
+            m_recvWaiting.fetch_sub(1, std::memory_order_relaxed);
+            if(w->m_state->fire(w->m_index, wakeup)) {
+                wakeups.push_back(std::move(wakeup));
+            }
+        }
+    }
+    for(auto& i: wakeups) {
+        i.wake();
+    }
+}
+
+void ChannelBase::addWaiter(ChannelWaiter* waiter, bool send) {
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(send) {
+            m_sendWaiters.push(waiter);
+            m_sendWaiting.fetch_add(1, std::memory_order_relaxed);
+        }else {
+            m_recvWaiters.push(waiter);
+            m_recvWaiting.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    // 与notifyRecv/notifySend中的屏障配对，注册后的重试和对方的检查至少有一个能看到对方
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void ChannelBase::removeWaiter(ChannelWaiter* waiter, bool send) {
+    SpinLock::Lock lock(m_mutex);
+    if(!waiter->m_linked) {
+        return;
+    }
+    if(send) {
+        m_sendWaiters.remove(waiter);
+        m_sendWaiting.fetch_sub(1, std::memory_order_relaxed);
+    }else {
+        m_recvWaiters.remove(waiter);
+        m_recvWaiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void ChannelBase::notify(bool send) {
+    ChannelWaitList& waiters = send? m_sendWaiters: m_recvWaiters;
+    std::atomic<size_t>& waiting = send? m_sendWaiting: m_recvWaiting;
+    ChannelWakeup wakeup;
+    {
+        // 在锁内抢占唤醒权，select返回前会在锁内摘除节点，节点不会在这里失效
+        SpinLock::Lock lock(m_mutex);
+        ChannelWaiter* w = waiters.pop();
+        for(; w; w = waiters.pop()) {
+            waiting.fetch_sub(1, std::memory_order_relaxed);
+            // select已经被其他通道或超时唤醒，继续唤醒下一个
+            if(w->m_state->fire(w->m_index, wakeup)) {
+                break;
+            }
+        }
+        if(!w) {
+            return;
+        }
+    }
+    // 在锁外调度，避免持锁时被抢占让对方空转
+    wakeup.wake();
+}
+
+/**
+ * @brief 轮询等待，用于没有IOManager定时器时的超时
+ */
+static int PollSelect(ChannelCase* const* cases, size_t count, uint64_t deadline, bool inFiber) {
+    while(true) {
+        for(size_t i = 0; i < count; ++i) {
+            if(cases[i]->tryOnce()) {
+                return i;
+            }
+        }
+        if(GetCurrentMS() >= deadline) {
+            return -1;
+        }
+        if(inFiber) {
+            Scheduler::GetThis()->schedule(Fiber::GetThis());
+            Fiber::GetThis()->yield();
+        }else {
+            usleep(1000);
+        }
+    }
+}
+
+int ChannelSelect(ChannelCase* const* cases, size_t count, uint64_t timeoutMs) {
+    for(size_t i = 0; i < count; ++i) {
+        if(cases[i]->tryOnce()) {
+            return i;
+        }
+    }
+    if(0 == timeoutMs) {
+        return -1;
+    }
+
+    Scheduler* scheduler = Scheduler::GetThis();
+    bool inFiber = scheduler && Fiber::GetThis()->isRunInScheduler();
+    IOManager* iom = IOManager::GetThis();
+    uint64_t deadline = ~0ull == timeoutMs? ~0ull: GetCurrentMS() + timeoutMs;
+    if(~0ull != deadline && !(inFiber && iom)) {
+        return PollSelect(cases, count, deadline, inFiber);
+    }
+
+    std::vector<ChannelWaiter> waiters(count);
+    // 被唤醒但没有在该分支完成操作的，返回前把唤醒转给其他等待者
+    std::vector<bool> woken(count, false);
+    int result = -1;
+    while(result < 0) {
+        Semaphore sem;
+        std::shared_ptr<ChannelSelectState> state = std::make_shared<ChannelSelectState>();
+        Fiber* raw = nullptr;
+        if(inFiber) {
+            state->m_wakeup.m_scheduler = scheduler;
+            state->m_wakeup.m_fiber = Fiber::GetThis();
+            raw = state->m_wakeup.m_fiber.get();
+        }else {
+            state->m_wakeup.m_sem = &sem;
+        }
+        for(size_t i = 0; i < count; ++i) {
+            waiters[i].m_state = state.get();
+            waiters[i].m_index = i;
+            cases[i]->m_channel->addWaiter(&waiters[i], cases[i]->m_send);
+        }
+
+        // 注册后再试一次，避免在注册前错过唤醒
+        for(size_t i = 0; i < count; ++i) {
+            if(cases[i]->tryOnce()) {
+                result = i;
+                break;
+            }
+        }
+
+        Timer::ptr timer;
+        bool park = true;
+        if(result >= 0) {
+            // 已经完成，取消等待；取消失败说明已经被唤醒，要消耗掉这次唤醒
+            park = !state->cancel();
+            if(!park) {
+                state->m_wakeup.m_fiber.reset();
+            }
+        }else if(~0ull != deadline) {
+            uint64_t now = GetCurrentMS();
+            std::weak_ptr<ChannelSelectState> weak(state);
+            timer = iom->addTimer([weak]() {
+                std::shared_ptr<ChannelSelectState> s = weak.lock();
+                ChannelWakeup wakeup;
+                if(s && s->fire(ChannelSelectState::TIMEOUT, wakeup)) {
+                    wakeup.wake();
+                }
+            }, deadline > now? deadline - now: 0);
+        }
+        if(park) {
+            if(raw) {
+                raw->yield();
+            }else {
+                sem.wait();
+            }
+        }
+
+        for(size_t i = 0; i < count; ++i) {
+            cases[i]->m_channel->removeWaiter(&waiters[i], cases[i]->m_send);
+        }
+        if(timer) {
+            timer->cancel();
+        }
+
+        int firedBy = state->m_firedBy.load();
+        if(firedBy >= 0) {
+            woken[firedBy] = true;
+        }
+        if(result >= 0) {
+            break;
+        }
+        for(size_t i = 0; i < count; ++i) {
+            if(cases[i]->tryOnce()) {
+                result = i;
+                break;
+            }
+        }
+        if(ChannelSelectState::TIMEOUT == firedBy) {
+            break;
+        }
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+        if(woken[i] && (int)i != result) {
+            cases[i]->m_channel->notify(cases[i]->m_send);
+        }
+    }
+    return result;
+}
+
+} // end namespace focus
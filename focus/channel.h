@@ -0,0 +1,485 @@
+#ifndef __FOCUS_CHANNEL_H__
+#define __FOCUS_CHANNEL_H__
+
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <initializer_list>
+#include "mutex.h"
+#include "fiber.h"
+#include "nocopyable.h"
+
+namespace focus {
+
+class Scheduler;
+
+/**
+ * @brief 唤醒一个等待者需要的信息，在锁外执行唤醒
+ */
+struct ChannelWakeup {
+    /**
+     * @brief 唤醒，协程通过调度器重新调度
+     */
+    void wake();
+
+    Scheduler* m_scheduler = nullptr; // 协程所在的调度器
+    Fiber::ptr m_fiber; // 挂起的协程
+    Semaphore* m_sem = nullptr; // 不在协程中时阻塞的信号量
+};
+
+/**
+ * @brief select的等待状态，一次select在多个通道上共享
+ */
+struct ChannelSelectState {
+    static const int WAITING = -1; // 还在等待
+    static const int TIMEOUT = -2; // 超时
+    static const int CANCELED = -3; // 等待者自己取消
+
+    /**
+     * @brief 抢占唤醒权，只有第一次调用成功
+     * @param[in] index 唤醒的case下标或者TIMEOUT
+     * @param[out] wakeup 成功时取出唤醒信息，由调用者在释放通道锁后唤醒
+     */
+    bool fire(int index, ChannelWakeup& wakeup);
+
+    /**
+     * @brief 取消等待
+     * @return 已经被唤醒返回false
+     */
+    bool cancel() {
+        int expected = WAITING;
+        return m_firedBy.compare_exchange_strong(expected, CANCELED);
+    }
+
+    std::atomic<int> m_firedBy = {WAITING}; // 唤醒的case下标
+    ChannelWakeup m_wakeup; // 唤醒信息
+};
+
+/**
+ * @brief 通道等待队列的节点
+ */
+struct ChannelWaiter {
+    ChannelSelectState* m_state = nullptr; // 共享的等待状态
+    int m_index = 0; // 在select中的下标
+    bool m_linked = false; // 是否在队列中
+    ChannelWaiter* m_prev = nullptr; // 前一个
+    ChannelWaiter* m_next = nullptr; // 后一个
+};
+
+/**
+ * @brief 通道等待队列，双向链表，需要外部加锁
+ */
+class ChannelWaitList {
+public:
+    /**
+     * @brief 放入队尾
+     */
+    void push(ChannelWaiter* waiter);
+
+    /**
+     * @brief 从队列中摘除
+     */
+    void remove(ChannelWaiter* waiter);
+
+    /**
+     * @brief 取出队首，为空返回nullptr
+     */
+    ChannelWaiter* pop();
+
+    /**
+     * @brief 是否为空
+     */
+    bool empty() const {
+        return !m_head;
+    }
+
+private:
+    ChannelWaiter* m_head = nullptr; // 队首
+    ChannelWaiter* m_tail = nullptr; // 队尾
+};
+
+/**
+ * @brief 通道基类，管理等待的发送者和接收者
+ */
+class ChannelBase: public Nocopyable {
+public:
+    /**
+     * @brief 关闭通道
+     * @details 关闭后发送失败，接收在取完剩余数据后失败，唤醒所有等待者
+     */
+    void close();
+
+    /**
+     * @brief 是否已经关闭
+     */
+    bool isClosed() const {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief 注册等待者
+     * @param[in] send 等待发送还是等待接收
+     */
+    void addWaiter(ChannelWaiter* waiter, bool send);
+
+    /**
+     * @brief 删除还在队列中的等待者
+     */
+    void removeWaiter(ChannelWaiter* waiter, bool send);
+
+    /**
+     * @brief 唤醒一个等待者
+     * @param[in] send 唤醒发送者还是接收者
+     */
+    void notify(bool send);
+
+protected:
+    /**
+     * @brief 有数据可读，有等待的接收者时唤醒一个
+     */
+    void notifyRecv() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_recvWaiting.load(std::memory_order_relaxed)) {
+            notify(false);
+        }
+    }
+
+    /**
+     * @brief 有空间可写，有等待的发送者时唤醒一个
+     */
+    void notifySend() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_sendWaiting.load(std::memory_order_relaxed)) {
+            notify(true);
+        }
+    }
+
+protected:
+    SpinLock m_mutex; // 保护等待队列和溢出队列
+    std::atomic<bool> m_closed = {false}; // 是否关闭
+
+private:
+    ChannelWaitList m_sendWaiters; // 等待发送的
+    ChannelWaitList m_recvWaiters; // 等待接收的
+    std::atomic<size_t> m_sendWaiting = {0}; // 等待发送的数量，为0时不加锁
+    std::atomic<size_t> m_recvWaiting = {0}; // 等待接收的数量，为0时不加锁
+};
+
+/**
+ * @brief select的一个分支
+ */
+class ChannelCase {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] channel 通道
+     * @param[in] send 是否发送
+     */
+    ChannelCase(ChannelBase* channel, bool send):
+        m_channel(channel),
+        m_send(send) {
+    }
+
+    virtual ~ChannelCase() {}
+
+    /**
+     * @brief 尝试完成一次操作
+     * @return 操作完成或者通道已关闭(m_ok为false)返回true
+     */
+    virtual bool tryOnce() = 0;
+
+    /**
+     * @brief 操作是否成功，通道关闭时为false
+     */
+    bool isOk() const {
+        return m_ok;
+    }
+
+    ChannelBase* m_channel; // 通道
+    bool m_send; // 是否发送
+    bool m_ok = false; // 操作是否成功
+};
+
+/**
+ * @brief 在多个通道上等待，完成其中一个操作
+ * @param[in] cases 分支
+ * @param[in] count 分支数量
+ * @param[in] timeoutMs 超时毫秒，~0ull不超时，0不等待
+ * @return 完成的分支下标，超时返回-1
+ * @details 在IOManager的协程中挂起协程，超时使用IOManager的定时器；
+ *          不在协程中时阻塞线程，此时的超时通过轮询实现
+ */
+int ChannelSelect(ChannelCase* const* cases, size_t count, uint64_t timeoutMs = ~0ull);
+
+/**
+ * @brief 在多个通道上等待
+ */
+inline int Select(std::initializer_list<ChannelCase*> cases, uint64_t timeoutMs = ~0ull) {
+    return ChannelSelect(cases.begin(), cases.size(), timeoutMs);
+}
+
+/**
+ * @brief 协程之间传递数据的通道
+ * @tparam T 元素类型，需要可默认构造和移动
+ * @details 数据放在无锁的环形队列中，既不满也不空时收发都不加锁，
+ *          只有需要挂起或唤醒等待者时才加锁。
+ *          容量为0表示无界，环形队列满后放入加锁的溢出队列
+ */
+template<class T>
+class Channel: public ChannelBase {
+public:
+    using ptr = std::shared_ptr<Channel>;
+
+    /**
+     * @brief 接收分支
+     */
+    class RecvCase: public ChannelCase {
+    public:
+        RecvCase(Channel* channel, T& out):
+            ChannelCase(channel, false),
+            m_out(out) {
+        }
+
+        bool tryOnce() override {
+            Channel* channel = static_cast<Channel*>(m_channel);
+            if(channel->tryRecv(m_out)) {
+                m_ok = true;
+                return true;
+            }
+            // 关闭后再取一次，关闭前放入的数据不会丢
+            if(channel->isClosed()) {
+                m_ok = channel->tryRecv(m_out);
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        T& m_out; // 接收的数据
+    };
+
+    /**
+     * @brief 发送分支，发送失败时数据留在m_value中
+     */
+    class SendCase: public ChannelCase {
+    public:
+        SendCase(Channel* channel, T value):
+            ChannelCase(channel, true),
+            m_value(std::move(value)) {
+        }
+
+        bool tryOnce() override {
+            Channel* channel = static_cast<Channel*>(m_channel);
+            if(channel->isClosed()) {
+                m_ok = false;
+                return true;
+            }
+            if(channel->trySend(m_value)) {
+                m_ok = true;
+                return true;
+            }
+            return false;
+        }
+
+        T m_value; // 发送的数据
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量，0表示无界
+     * @param[in] ringSize 无界时环形队列的大小
+     */
+    Channel(size_t capacity = 0, size_t ringSize = 1024):
+        m_capacity(capacity) {
+        m_size = capacity? capacity: ringSize;
+        m_cells = new Cell[m_size];
+        for(size_t i = 0; i < m_size; ++i) {
+            m_cells[i].m_seq.store(i << 1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 析构函数
+     */
+    ~Channel() {
+        delete[] m_cells;
+    }
+
+    /**
+     * @brief 容量，0表示无界
+     */
+    size_t capacity() const {
+        return m_capacity;
+    }
+
+    /**
+     * @brief 元素个数(近似值)
+     */
+    size_t size() const {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        return (tail > head? (size_t)(tail - head): 0) + m_overflowCount.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 尝试发送，不挂起
+     * @return 已满或已关闭返回false，v不会被移动
+     */
+    bool trySend(T& v) {
+        if(isClosed()) {
+            return false;
+        }
+        if(0 == m_overflowCount.load(std::memory_order_acquire) && ringPush(v)) {
+            notifyRecv();
+            return true;
+        }
+        if(m_capacity) {
+            return false;
+        }
+        {
+            // 无界，放入溢出队列，之后的发送也放入溢出队列，保证同一个发送者的顺序
+            SpinLock::Lock lock(m_mutex);
+            m_overflow.push_back(std::move(v));
+            m_overflowCount.fetch_add(1, std::memory_order_release);
+        }
+        notifyRecv();
+        return true;
+    }
+
+    /**
+     * @brief 尝试发送(右值)
+     */
+    bool trySend(T&& v) {
+        return trySend(v);
+    }
+
+    /**
+     * @brief 尝试接收，不挂起
+     * @return 为空返回false
+     */
+    bool tryRecv(T& v) {
+        if(ringPop(v)) {
+            notifySend();
+            return true;
+        }
+        if(0 == m_overflowCount.load(std::memory_order_acquire)) {
+            return false;
+        }
+        SpinLock::Lock lock(m_mutex);
+        // 加锁期间可能有其他发送者放入了环形队列
+        if(ringPop(v)) {
+            return true;
+        }
+        if(m_overflow.empty()) {
+            return false;
+        }
+        v = std::move(m_overflow.front());
+        m_overflow.pop_front();
+        m_overflowCount.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 发送，已满时挂起当前协程
+     * @return 通道已关闭返回false
+     */
+    bool send(T v) {
+        if(trySend(v)) {
+            return true;
+        }
+        if(isClosed()) {
+            return false;
+        }
+        SendCase c(this, std::move(v));
+        ChannelCase* cases[] = {&c};
+        ChannelSelect(cases, 1);
+        return c.isOk();
+    }
+
+    /**
+     * @brief 接收，为空时挂起当前协程
+     * @return 通道已关闭并且没有数据返回false
+     */
+    bool recv(T& v) {
+        if(tryRecv(v)) {
+            return true;
+        }
+        RecvCase c(this, v);
+        ChannelCase* cases[] = {&c};
+        ChannelSelect(cases, 1);
+        return c.isOk();
+    }
+
+private:
+    /**
+     * @brief 环形队列的槽
+     * @details 序号为pos*2表示第pos个元素可写，pos*2+1表示可读，容量为1时也能区分
+     */
+    struct Cell {
+        std::atomic<uint64_t> m_seq = {0}; // 序号
+        T m_value; // 元素
+    };
+
+    /**
+     * @brief 放入环形队列，多生产者
+     */
+    bool ringPush(T& v) {
+        uint64_t pos = m_tail.load(std::memory_order_relaxed);
+        while(true) {
+            Cell& cell = m_cells[pos % m_size];
+            uint64_t seq = cell.m_seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)seq - (int64_t)(pos << 1);
+            if(0 == diff) {
+                if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.m_value = std::move(v);
+                    cell.m_seq.store((pos << 1) + 1, std::memory_order_release);
+                    return true;
+                }
+            }else if(diff < 0) {
+                return false;
+            }else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief 从环形队列取出，多消费者
+     */
+    bool ringPop(T& v) {
+        uint64_t pos = m_head.load(std::memory_order_relaxed);
+        while(true) {
+            Cell& cell = m_cells[pos % m_size];
+            uint64_t seq = cell.m_seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)seq - (int64_t)((pos << 1) + 1);
+            if(0 == diff) {
+                if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    v = std::move(cell.m_value);
+                    cell.m_value = T();
+                    // 下一圈可写
+                    cell.m_seq.store((pos + m_size) << 1, std::memory_order_release);
+                    return true;
+                }
+            }else if(diff < 0) {
+                return false;
+            }else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    alignas(64) std::atomic<uint64_t> m_tail = {0}; // 写位置
+    alignas(64) std::atomic<uint64_t> m_head = {0}; // 读位置
+    alignas(64) std::atomic<size_t> m_overflowCount = {0}; // 溢出队列的元素个数
+    Cell* m_cells = nullptr; // 环形队列
+    size_t m_size = 0; // 环形队列大小
+    size_t m_capacity = 0; // 容量，0表示无界
+    std::deque<T> m_overflow; // 无界时的溢出队列
+};
+
+} // end namespace focus
+
+#endif
@@ -1,4 +1,6 @@
 #include <list>
+#include <sys/stat.h>
+#include <dirent.h>
 
 #include "config.h"
 
@@ -6,6 +8,13 @@ namespace focus {
 
 static Logger::ptr g_logger=FOCUS_LOG_NAME("system");
 
+// 配置版本号，从1开始，0表示线程缓存为空
+static std::atomic<uint64_t> s_config_version={1};
+
+uint64_t NextConfigVersion() {
+    return s_config_version.fetch_add(1,std::memory_order_relaxed);
+}
+
 ConfigVarBase::ptr Config::LookUpBase(const std::string& name) {
     RWMutexType::ReadLock lock(GetMutex());
     auto it=GetDatas().find(name);
@@ -29,10 +38,26 @@ static void ListAllMembers(const std::string& prefix,
     }
 }
 
-void Config::LoadFromYaml(const YAML::Node& root) {
+// 统一为块风格，和toString的序列化格式一致
+static void ResetStyle(YAML::Node node) {
+    if(node.IsSequence()||node.IsMap()){
+        node.SetStyle(YAML::EmitterStyle::Block);
+        for(auto it=node.begin();it!=node.end();++it){
+            if(node.IsMap()){
+                ResetStyle(it->second);
+            }else{
+                ResetStyle(*it);
+            }
+        }
+    }
+}
+
+size_t Config::LoadFromYaml(const YAML::Node& root) {
     std::list<std::pair<std::string,const YAML::Node>> nodes;
     ListAllMembers("",root,nodes);
 
+    Mutex::Lock lock(GetLoadMutex());
+    size_t applied=0;
     for(auto& node: nodes){
         std::string key=node.first;
         if(key.empty()){
@@ -43,15 +68,72 @@ void Config::LoadFromYaml(const YAML::Node& root) {
         ConfigVarBase::ptr var=LookUpBase(key);
         
         if(nullptr!=var){
+            std::string val;
             if(node.second.IsScalar()){
-                var->fromString(node.second.Scalar());
+                val=node.second.Scalar();
             }else{
+                YAML::Node clone=YAML::Clone(node.second);
+                ResetStyle(clone);
                 std::stringstream ss;
-                ss<<node.second;
-                var->fromString(ss.str());
+                ss<<clone;
+                val=ss.str();
+            }
+            // 和当前值的序列化相同，跳过
+            if(val==var->toString()){
+                continue;
+            }
+            if(var->fromString(val)){
+                ++applied;
             }
         }
     }
+    return applied;
 }
 
-}
\ No newline at end of file
+size_t Config::LoadFromConfDir(const std::string& path) {
+    std::vector<std::string> files;
+    struct stat st;
+    if(0!=stat(path.c_str(),&st)){
+        FOCUS_LOG_ERROR(g_logger)<<"LoadFromConfDir stat fail path="<<path
+            <<" errno="<<errno;
+        return 0;
+    }
+    if(S_ISDIR(st.st_mode)){
+        DIR* dir=opendir(path.c_str());
+        if(nullptr==dir){
+            return 0;
+        }
+        while(struct dirent* dp=readdir(dir)){
+            std::string name=dp->d_name;
+            if(IsYamlFile(name)){
+                files.emplace_back(path+"/"+name);
+            }
+        }
+        closedir(dir);
+        // 按文件名顺序加载，结果确定
+        std::sort(files.begin(),files.end());
+    }else{
+        files.emplace_back(path);
+    }
+
+    size_t applied=0;
+    for(auto& file: files){
+        try{
+            applied+=LoadFromYaml(YAML::LoadFile(file));
+        }catch(std::exception& e){
+            FOCUS_LOG_ERROR(g_logger)<<"LoadFromConfDir load fail file="<<file
+                <<" "<<e.what();
+        }
+    }
+    return applied;
+}
+
+bool IsYamlFile(const std::string& name) {
+    auto EndWith=[&name](const std::string& suffix){
+        return name.size()>suffix.size()
+            &&0==name.compare(name.size()-suffix.size(),suffix.size(),suffix);
+    };
+    return EndWith(".yml")||EndWith(".yaml");
+}
+
+}
@@ -7,8 +7,15 @@
 #include <boost/lexical_cast.hpp>
 #include <functional>
 #include <map>
+#include <unordered_map>
+#include <mutex>
+#include <typeinfo>
+#include <vector>
+#include <sstream>
 #include <stdint.h>
 #include <exception>
+#include <atomic>
+#include <type_traits>
 #include <yaml-cpp/yaml.h>
 
 #include "mutex.h"
@@ -69,8 +76,172 @@ public:
     }
 };
 
+/**
+ * @brief 模版特化(YAML String 转换成 bool)，支持true/false
+ */
+template<>
+class LexicalCast<std::string,bool>{
+public:
+    bool operator()(const std::string& v) {
+        return YAML::Load(v).as<bool>();
+    }
+};
+
+/**
+ * @brief 模版偏特化(YAML String 转换成 std::vector<T>)
+ */
+template<class T>
+class LexicalCast<std::string, std::vector<T>> {
+public:
+    std::vector<T> operator()(const std::string& v) {
+        YAML::Node node = YAML::Load(v);
+        std::vector<T> vec;
+        std::stringstream ss;
+        for(size_t i = 0; i < node.size(); ++i) {
+            ss.str("");
+            ss << node[i];
+            vec.emplace_back(LexicalCast<std::string, T>()(ss.str()));
+        }
+        return vec;
+    }
+};
+
+/**
+ * @brief 模版偏特化(std::vector<T> 转换成 YAML String)
+ */
+template<class T>
+class LexicalCast<std::vector<T>, std::string> {
+public:
+    std::string operator()(const std::vector<T>& v) {
+        YAML::Node node(YAML::NodeType::Sequence);
+        for(auto& i: v) {
+            node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
+        }
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+};
+
 // 模版特化 TODO
 
+// 获取全局唯一的配置版本号
+uint64_t NextConfigVersion();
+
+// 是否是yaml配置文件(.yml/.yaml)
+bool IsYamlFile(const std::string& name);
+
+/**
+ * @brief 配置值的只读快照，持有期间值不会被修改或释放
+ */
+template<class T>
+class ConfigSnapshot{
+public:
+    // 构造
+    explicit ConfigSnapshot(std::shared_ptr<const T> val)
+        :val_(std::move(val)) {
+    }
+
+    // 读取值
+    const T& get() const {return *val_;}
+    operator const T&() const {return *val_;}
+    const T& operator*() const {return *val_;}
+    const T* operator->() const {return val_.get();}
+
+private:
+    std::shared_ptr<const T> val_; // 不可变的值
+};
+
+/**
+ * @brief 是否可以用无锁原子变量保存的配置类型
+ */
+template<class T>
+struct ConfigIsAtomic{
+    static constexpr bool value=std::is_trivially_copyable<T>::value
+        &&(1==sizeof(T)||2==sizeof(T)||4==sizeof(T)||8==sizeof(T));
+};
+
+/**
+ * @brief 配置值的存储，读取不加锁
+ * @details 默认保存不可变的快照，修改时发布新的快照；
+ *          每个线程缓存最近读到的快照，版本号没变时只需要一次原子读
+ */
+template<class T,bool Atomic=ConfigIsAtomic<T>::value>
+class ConfigValue{
+public:
+    using value_type=ConfigSnapshot<T>;
+
+    // 构造
+    explicit ConfigValue(const T& val)
+        :id_(NextConfigVersion()),
+        val_(std::make_shared<const T>(val)),
+        version_(NextConfigVersion()) {
+    }
+
+    // 读取快照
+    value_type load() const {
+        // 版本号全局唯一，缓存的版本号相等说明就是当前的快照
+        static thread_local CacheEntry t_cache[CACHE_SIZE];
+        CacheEntry& entry=t_cache[id_%CACHE_SIZE];
+        if(entry.version_!=version_.load(std::memory_order_acquire)){
+            SpinLock::Lock lock(mutex_);
+            entry.val_=val_;
+            entry.version_=version_.load(std::memory_order_relaxed);
+        }
+        return value_type(entry.val_);
+    }
+
+    // 发布新的值
+    void store(const T& val) {
+        std::shared_ptr<const T> next=std::make_shared<const T>(val);
+        SpinLock::Lock lock(mutex_);
+        val_.swap(next);
+        version_.store(NextConfigVersion(),std::memory_order_release);
+    }
+
+private:
+    // 线程缓存的大小
+    static constexpr size_t CACHE_SIZE=16;
+
+    // 线程缓存的快照
+    struct CacheEntry{
+        uint64_t version_=0;
+        std::shared_ptr<const T> val_;
+    };
+
+    const uint64_t id_; // 用于选择线程缓存的位置
+    mutable SpinLock mutex_; // 保护val_，只在发布和缓存失效时使用
+    std::shared_ptr<const T> val_; // 当前快照
+    std::atomic<uint64_t> version_; // 当前快照的版本号
+};
+
+/**
+ * @brief 可以原子读写的配置值，直接按值返回
+ */
+template<class T>
+class ConfigValue<T,true>{
+public:
+    using value_type=T;
+
+    // 构造
+    explicit ConfigValue(const T& val)
+        :val_(val) {
+    }
+
+    // 读取值
+    value_type load() const {
+        return val_.load(std::memory_order_acquire);
+    }
+
+    // 修改值
+    void store(const T& val) {
+        val_.store(val,std::memory_order_release);
+    }
+
+private:
+    std::atomic<T> val_; // 值
+};
+
 // 配置变量子类
 template<class T,class FromStr=LexicalCast<std::string,T>,
                 class ToStr=LexicalCast<T,std::string>>
@@ -89,8 +260,8 @@ public:
     // 转成字符串
     std::string toString() override {
         try{
-            RWMutexType::ReadLock lock(mutex_);
-            return ToStr()(val_);
+            typename ConfigValue<T>::value_type val=val_.load();
+            return ToStr()(val);
         }catch(std::exception& e){
             FOCUS_LOG_ERROR(FOCUS_LOG_ROOT())<<"ConfigVar:toString excption "
                 <<e.what()<<"convert:"<<TypeToName<T>()<<" to string"
@@ -108,7 +279,7 @@ public:
             FOCUS_LOG_ERROR(FOCUS_LOG_ROOT())<<"ConfigVar:fromString excption"
                 <<e.what()<<" convert: string to"<<TypeToName<T>()
                 <<" name="<<name_
-                <<" - "<<val_;
+                <<" - "<<val;
         }
         return false;
     }
@@ -118,25 +289,35 @@ public:
         return TypeToName<T>();
     }
 
-    // 读取参数值
-    const T getVal() {
-        RWMutexType::ReadLock lock(mutex_);
-        return val_;
+    // 读取参数值，不加锁，返回拷贝
+    const T getVal() const {
+        return val_.load();
+    }
+
+    /**
+     * @brief 读取参数值，不加锁也不拷贝
+     * @return 可以原子读写的类型直接返回值，其他类型返回只读快照；
+     *         引用快照中的值时要持有快照，修改后旧的值会被释放
+     */
+    typename ConfigValue<T>::value_type getSnapshot() const {
+        return val_.load();
     }
 
     // 更该参数值
     void setVal(const T& v) {
         {
             RWMutexType::ReadLock lock(mutex_);
-            if(v==val_){
+            typename ConfigValue<T>::value_type old=val_.load();
+            const T& oldval=old;
+            if(v==oldval){
                 return ;
             }
             for(auto& cb: cbs_){
-                cb.second(val_,v);
+                cb.second(oldval,v);
             }
         }
         RWMutexType::WriteLock lock(mutex_);
-        val_=v;
+        val_.store(v);
     }
 
     // 添加回调函数，并返回唯一id
@@ -167,40 +348,36 @@ public:
     }
 
 private:
-    RWMutexType mutex_; //读写锁
-    T val_; //变量值
+    RWMutexType mutex_; //读写锁，保护回调函数和修改
+    ConfigValue<T> val_; //变量值
     std::map<uint64_t,onchangecb> cbs_; //修改时触发的回调函数
 };
 
 // 配置变量管理类 TODO
 class Config{
 public:
-    using ConfigVarMap=std::map<std::string,ConfigVarBase::ptr>;
+    using ConfigVarMap=std::unordered_map<std::string,ConfigVarBase::ptr>;
     using RWMutexType=RWMutex;
 
     /**
-     * @brief 获取配置变量
-     * 
+     * @brief 获取配置变量，不存在时创建
+     * @details 已经存在时只加读锁查找；类型不匹配返回nullptr
      */
     template<class T>
     static typename ConfigVar<T>::ptr LookUp(const std::string& name,const T& defaultval,const std::string& description="") {
+        {
+            RWMutexType::ReadLock lock(GetMutex());
+            auto it=GetDatas().find(name);
+            if(it!=GetDatas().end()){
+                return CastVar<T>(name,it->second);
+            }
+        }
+
         RWMutexType::WriteLock lock(GetMutex());
+        // 加写锁前可能已经被其他线程创建
         auto it=GetDatas().find(name);
-        // 存在
         if(it!=GetDatas().end()){
-            // 下转型
-            auto temp=std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
-            if(temp!=nullptr){
-                // 获取成功
-                FOCUS_LOG_INFO(FOCUS_LOG_ROOT())<<"LookUp name= "<<name<<" exists";
-                return temp;
-            }else{
-                // 类型不匹配
-                FOCUS_LOG_ERROR(FOCUS_LOG_ROOT())<<"LookUp name= "<<name<<" exists but type not"
-                        <<TypeToName<T>()<<" real type= "<<it->second->getTypeName()
-                        <<" "<<it->second->toString();
-                return nullptr;
-            }
+            return CastVar<T>(name,it->second);
         }
         
         // 判断无效字符
@@ -224,15 +401,38 @@ public:
         if(it==GetDatas().end()){
             return nullptr;
         }
-        return std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
+        return CastVar<T>(name,it->second);
     }
 
-    // 从yaml文件中读取
-    static void LoadFromYaml(const YAML::Node& root);
+    /**
+     * @brief 从yaml中读取
+     * @details 只应用序列化内容和当前值不同的配置，没有变化的不会重新解析，也不会触发回调
+     * @return 应用的配置数
+     */
+    static size_t LoadFromYaml(const YAML::Node& root);
+
+    /**
+     * @brief 从配置目录读取所有.yml和.yaml文件，路径是文件时只读取该文件
+     * @return 应用的配置数
+     */
+    static size_t LoadFromConfDir(const std::string& path);
 
     // 获取基类指针
     static ConfigVarBase::ptr LookUpBase(const std::string& name);
 private:
+    // 转成具体类型，比较类型信息代替dynamic_cast
+    template<class T>
+    static typename ConfigVar<T>::ptr CastVar(const std::string& name,const ConfigVarBase::ptr& var) {
+        if(typeid(*var)==typeid(ConfigVar<T>)){
+            return std::static_pointer_cast<ConfigVar<T>>(var);
+        }
+        // 类型不匹配
+        FOCUS_LOG_ERROR(FOCUS_LOG_ROOT())<<"LookUp name= "<<name<<" exists but type not "
+                <<TypeToName<T>()<<" real type= "<<var->getTypeName()
+                <<" "<<var->toString();
+        return nullptr;
+    }
+
     // 获取键值对
     static ConfigVarMap& GetDatas() {
         static ConfigVarMap s_datas;
@@ -244,6 +444,69 @@ private:
         static RWMutexType s_mutex;
         return s_mutex;
     }
+
+    // 加载过程的互斥量，同时只有一个加载
+    static Mutex& GetLoadMutex() {
+        static Mutex s_mutex;
+        return s_mutex;
+    }
+};
+
+/**
+ * @brief 类型化的配置键
+ * @details 声明一次，第一次使用时向Config注册或查找并缓存配置变量，之后的访问不再查表加锁
+ * @code
+ * static ConfigKey<uint32_t> s_timeout("tcp.read_timeout", 3000, "tcp read timeout");
+ * uint32_t timeout = s_timeout.getVal();
+ * @endcode
+ */
+template<class T>
+class ConfigKey{
+public:
+    using VarType=ConfigVar<T>;
+
+    /**
+     * @brief 构造
+     * @param[in] name 配置名
+     * @param[in] defaultval 默认值
+     * @param[in] description 描述
+     */
+    ConfigKey(const std::string& name,const T& defaultval,const std::string& description="")
+        :name_(name),
+        default_(defaultval),
+        description_(description) {
+    }
+
+    // 获取配置名
+    const std::string& getName() const {return name_;}
+
+    /**
+     * @brief 获取配置变量，只解析一次
+     * @exception 同名配置的类型不同时抛出std::invalid_argument
+     */
+    VarType* get() const {
+        std::call_once(once_,[this](){
+            var_=Config::LookUp<T>(name_,default_,description_);
+            if(!var_){
+                throw std::invalid_argument(name_);
+            }
+        });
+        return var_.get();
+    }
+
+    VarType* operator->() const {return get();}
+
+    // 读取配置值，不拷贝，其他类型返回只读快照
+    typename ConfigValue<T>::value_type getVal() const {
+        return get()->getSnapshot();
+    }
+
+private:
+    std::string name_; // 配置名
+    T default_; // 默认值
+    std::string description_; // 描述
+    mutable std::once_flag once_; // 只解析一次
+    mutable typename VarType::ptr var_; // 解析后的配置变量
 };
 
 }
@@ -0,0 +1,139 @@
+#include "configwatcher.h"
+#include "config.h"
+#include "env.h"
+#include "macro.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace focus {
+
+// 全局日志器
+static Logger::ptr g_logger = FOCUS_LOG_NAME("system");
+
+// 配置文件变化后延迟多久重新加载，期间的多次修改合并成一次
+static ConfigVar<uint32_t>::ptr g_config_reload_delay_ms =
+    Config::LookUp<uint32_t>("config.reload_delay_ms", 200, "config hot reload delay ms");
+
+ConfigWatcher::ConfigWatcher(IOManager* iom, const std::string& path)
+    :m_iom(iom),
+    m_path(path.empty()? EnvMgr::GetInstance()->getConfigPath(): path) {
+    FOCUS_ASSERT(m_iom);
+    // 路径是文件时监听所在目录，编辑器保存时常常用重命名替换文件
+    struct stat st;
+    if(0 == stat(m_path.c_str(), &st) && !S_ISDIR(st.st_mode)) {
+        size_t pos = m_path.rfind('/');
+        m_dir = std::string::npos == pos? ".": m_path.substr(0, pos);
+        m_file = std::string::npos == pos? m_path: m_path.substr(pos + 1);
+    }else {
+        m_dir = m_path;
+    }
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    if(-1 != m_fd) {
+        close(m_fd);
+    }
+}
+
+bool ConfigWatcher::start() {
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(-1 == m_fd) {
+        FOCUS_LOG_ERROR(g_logger) << "inotify_init1 errno = " << errno << " errstr = " << strerror(errno);
+        return false;
+    }
+    if(-1 == inotify_add_watch(m_fd, m_dir.c_str(),
+                IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE)) {
+        FOCUS_LOG_ERROR(g_logger) << "inotify_add_watch " << m_dir << " errno = " << errno
+                                  << " errstr = " << strerror(errno);
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_iom->schedule(std::bind(&ConfigWatcher::watch, shared_from_this()));
+    return true;
+}
+
+void ConfigWatcher::stop() {
+    if(m_stopping.exchange(true)) {
+        return;
+    }
+    // 唤醒监听协程退出，等待中的延迟加载到期后不再执行
+    if(-1 != m_fd) {
+        m_iom->cancelEvent(m_fd, IOManager::READ);
+    }
+}
+
+void ConfigWatcher::watch() {
+    // 事件按inotify_event对齐
+    alignas(struct inotify_event) char buf[4096];
+    while(!m_stopping) {
+        ssize_t n = read(m_fd, buf, sizeof(buf));
+        if(n > 0) {
+            bool changed = false;
+            for(char* p = buf; p < buf + n;) {
+                struct inotify_event* event = (struct inotify_event*)p;
+                if(event->len && isWatched(event->name)) {
+                    changed = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+            if(changed) {
+                onChange();
+            }
+            continue;
+        }
+        if(-1 == n && EINTR == errno) {
+            continue;
+        }
+        if(-1 == n && EAGAIN != errno) {
+            FOCUS_LOG_ERROR(g_logger) << "ConfigWatcher read inotify errno = " << errno
+                                      << " errstr = " << strerror(errno);
+            break;
+        }
+        // 没有事件，等待可读
+        if(m_iom->addEvent(m_fd, IOManager::READ)) {
+            break;
+        }
+        // 注册后再检查一次，stop可能在注册之前已经取消过
+        if(m_stopping) {
+            m_iom->cancelEvent(m_fd, IOManager::READ);
+        }
+        Fiber::GetThis()->yield();
+    }
+    FOCUS_LOG_DEBUG(g_logger) << "ConfigWatcher " << m_path << " stopped";
+}
+
+void ConfigWatcher::onChange() {
+    // 已经有等待中的加载，本次修改会一起加载
+    if(m_pending.exchange(true)) {
+        return;
+    }
+    std::weak_ptr<ConfigWatcher> weak(shared_from_this());
+    m_iom->addTimer([weak](){
+        ConfigWatcher::ptr self = weak.lock();
+        if(self && !self->m_stopping) {
+            // 在单独的协程中解析，不阻塞定时器的处理
+            self->m_iom->schedule(std::bind(&ConfigWatcher::reload, self));
+        }
+    }, g_config_reload_delay_ms->getVal());
+}
+
+void ConfigWatcher::reload() {
+    // 先清除标记，加载期间的修改会再触发一次
+    m_pending = false;
+    size_t applied = Config::LoadFromConfDir(m_path);
+    m_lastApplied = applied;
+    ++m_reloadCount;
+    FOCUS_LOG_INFO(g_logger) << "config reload " << m_path << " applied = " << applied;
+}
+
+bool ConfigWatcher::isWatched(const char* name) const {
+    if(!m_file.empty()) {
+        return m_file == name;
+    }
+    return IsYamlFile(name);
+}
+
+} // end namespace focus
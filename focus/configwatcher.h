@@ -0,0 +1,100 @@
+#ifndef __FOCUS_CONFIGWATCHER_H__
+#define __FOCUS_CONFIGWATCHER_H__
+
+#include <memory>
+#include <string>
+#include <atomic>
+#include "iomanager.h"
+#include "nocopyable.h"
+
+namespace focus {
+
+/**
+ * @brief 配置文件热加载
+ * @details 在IOManager上用协程监听inotify事件，配置文件修改后延迟一段时间再重新加载，
+ *          延迟期间的多次修改只加载一次，只应用内容变化的配置并触发对应的回调
+ */
+class ConfigWatcher: public std::enable_shared_from_this<ConfigWatcher>, public Nocopyable {
+public:
+    using ptr = std::shared_ptr<ConfigWatcher>;
+
+    /**
+     * @brief 构造函数
+     * @param[in] iom 运行监听协程的IO调度器
+     * @param[in] path 配置目录或文件，为空时使用Env::getConfigPath()
+     */
+    ConfigWatcher(IOManager* iom, const std::string& path = "");
+
+    /**
+     * @brief 析构函数
+     */
+    ~ConfigWatcher();
+
+    /**
+     * @brief 开始监听
+     * @return 创建inotify失败返回false
+     */
+    bool start();
+
+    /**
+     * @brief 停止监听，需要在IO调度器停止之前调用
+     */
+    void stop();
+
+    /**
+     * @brief 获取监听的路径
+     */
+    const std::string& getPath() const {
+        return m_path;
+    }
+
+    /**
+     * @brief 获取重新加载的次数
+     */
+    uint64_t getReloadCount() const {
+        return m_reloadCount;
+    }
+
+    /**
+     * @brief 获取最近一次加载应用的配置数
+     */
+    size_t getLastApplied() const {
+        return m_lastApplied;
+    }
+
+private:
+    /**
+     * @brief 监听协程，读取inotify事件
+     */
+    void watch();
+
+    /**
+     * @brief 有相关文件变化，延迟后重新加载
+     */
+    void onChange();
+
+    /**
+     * @brief 重新加载配置
+     */
+    void reload();
+
+    /**
+     * @brief 文件名是否需要关注
+     */
+    bool isWatched(const char* name) const;
+
+private:
+    IOManager* m_iom; // 所属IO调度器
+    std::string m_path; // 配置目录或文件
+    std::string m_dir; // 监听的目录
+    std::string m_file; // 只关注的文件名，为空表示目录下所有yaml文件
+    int m_fd = -1; // inotify句柄
+    std::atomic<bool> m_stopping = {false}; // 是否正在停止
+    std::atomic<bool> m_pending = {false}; // 是否已经有等待中的加载
+    std::atomic<uint64_t> m_reloadCount = {0}; // 重新加载的次数
+    std::atomic<size_t> m_lastApplied = {0}; // 最近一次加载应用的配置数
+};
+
+} // end namespace focus
+
+#endif
@@ -0,0 +1,142 @@
+#include "context.h"
+#include <cstdint>
+#include <cstring>
+
+namespace focus {
+
+#if defined(FOCUS_FIBER_USE_ASM)
+
+#if defined(__x86_64__)
+
+/**
+ * x86-64 System V
+ * 栈布局(从低到高): mxcsr/x87控制字, r15, r14, r13, r12, rbx, rbp, 返回地址
+ */
+asm(R"(
+    .text
+    .globl focus_swap_context
+    .type focus_swap_context, @function
+    .align 16
+focus_swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size focus_swap_context, .-focus_swap_context
+)");
+
+bool MakeContext(Context* ctx, void* stack, size_t size, void (*fn)()) {
+    // 栈顶16字节对齐
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    // 返回地址所在位置16字节对齐，ret后进入fn时满足(rsp + 8) % 16 == 0
+    uint64_t* sp = (uint64_t*)(top - 16);
+    sp[1] = 0; // fn的返回地址，fn不能返回
+    sp[0] = (uint64_t)fn; // ret跳转到fn
+    sp -= 7;
+    memset(sp, 0, 7 * sizeof(uint64_t)); // rbp, rbx, r12-r15
+    // 默认的mxcsr和x87控制字
+    uint32_t* ctrl = (uint32_t*)sp;
+    ctrl[0] = 0x1F80;
+    ctrl[1] = 0x037F;
+    ctx->m_sp = sp;
+    return true;
+}
+
+#elif defined(__aarch64__)
+
+/**
+ * AArch64 AAPCS64
+ * 栈布局(从低到高): d8-d15, x19-x28, x29(fp), x30(lr)
+ */
+asm(R"(
+    .text
+    .globl focus_swap_context
+    .type focus_swap_context, %function
+    .align 4
+focus_swap_context:
+    sub sp, sp, #0xb0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    add sp, sp, #0xb0
+    ret
+    .size focus_swap_context, .-focus_swap_context
+)");
+
+bool MakeContext(Context* ctx, void* stack, size_t size, void (*fn)()) {
+    // 栈顶16字节对齐
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)(top - 0xb0);
+    memset(sp, 0, 0xb0);
+    sp[0x98 / 8] = (uint64_t)fn; // x30，ret跳转到fn
+    ctx->m_sp = sp;
+    return true;
+}
+
+#else
+#error "FOCUS_FIBER_USE_ASM is not supported on this architecture"
+#endif
+
+bool InitContext(Context* ctx) {
+    // 主协程的上下文在第一次切换出去时保存
+    ctx->m_sp = nullptr;
+    return true;
+}
+
+#else
+
+bool InitContext(Context* ctx) {
+    return 0 == getcontext(&ctx->m_uctx);
+}
+
+bool MakeContext(Context* ctx, void* stack, size_t size, void (*fn)()) {
+    if(getcontext(&ctx->m_uctx)) {
+        return false;
+    }
+    ctx->m_uctx.uc_link = nullptr;
+    ctx->m_uctx.uc_stack.ss_sp = stack;
+    ctx->m_uctx.uc_stack.ss_size = size;
+    makecontext(&ctx->m_uctx, fn, 0);
+    return true;
+}
+
+#endif
+
+} // end namespace focus
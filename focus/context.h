@@ -0,0 +1,72 @@
+#ifndef __FOCUS_CONTEXT_H__
+#define __FOCUS_CONTEXT_H__
+
+#include <cstddef>
+
+#if !defined(FOCUS_FIBER_USE_ASM)
+#include <ucontext.h>
+#endif
+
+namespace focus {
+
+#if defined(FOCUS_FIBER_USE_ASM)
+
+extern "C" {
+/**
+ * @brief 汇编实现的上下文切换，只保存callee-saved寄存器
+ * @param[out] from 保存当前上下文的栈顶
+ * @param[in] to 要切换到的上下文的栈顶
+ */
+void focus_swap_context(void** from, void* to);
+}
+
+/**
+ * @brief 协程上下文，保存的寄存器都在协程栈上，只需要记录栈顶
+ */
+struct Context {
+    void* m_sp = nullptr; // 栈顶
+};
+
+/**
+ * @brief 切换上下文，保存当前上下文到from，切换到to
+ */
+inline bool SwapContext(Context* from, Context* to) {
+    focus_swap_context(&from->m_sp, to->m_sp);
+    return true;
+}
+
+#else
+
+/**
+ * @brief 协程上下文，基于ucontext
+ */
+struct Context {
+    ucontext_t m_uctx; // ucontext上下文
+};
+
+/**
+ * @brief 切换上下文，保存当前上下文到from，切换到to
+ */
+inline bool SwapContext(Context* from, Context* to) {
+    return 0 == swapcontext(&from->m_uctx, &to->m_uctx);
+}
+
+#endif
+
+/**
+ * @brief 初始化线程主协程的上下文
+ */
+bool InitContext(Context* ctx);
+
+/**
+ * @brief 初始化子协程的上下文，切换到该上下文时从fn开始执行
+ * @param[out] ctx 上下文
+ * @param[in] stack 栈地址
+ * @param[in] size 栈大小
+ * @param[in] fn 入口函数，不能返回
+ */
+bool MakeContext(Context* ctx, void* stack, size_t size, void (*fn)());
+
+} // end namespace focus
+
+#endif
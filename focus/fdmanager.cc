@@ -1,21 +1,13 @@
 #include "fdmanager.h"
 #include "hook.h"
+#include "util.h"
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 namespace focus {
 
-FdCtx::FdCtx(int fd):
-    m_isInit(false),
-    m_isSocket(false),
-    m_sysNonblock(false),
-    m_userNonblock(false),
-    m_isClosed(false),
-    m_fd(fd),
-    m_recvTimeout(-1),
-    m_sendTimeout(-1) {
-    init();
+FdCtx::FdCtx() {
 }
 
 FdCtx::~FdCtx() {
@@ -23,25 +15,26 @@ FdCtx::~FdCtx() {
 
 void FdCtx::setTimeout(int type, uint64_t timeout) {
     if(SO_RCVTIMEO == type) {
-        m_recvTimeout = timeout;
+        m_recvTimeout.store(timeout, std::memory_order_relaxed);
     }else {
-        m_sendTimeout = timeout;
+        m_sendTimeout.store(timeout, std::memory_order_relaxed);
     }
 }
 
 uint64_t FdCtx::getTimeout(int type) {
     if(SO_RCVTIMEO == type) {
-        return m_recvTimeout;
+        return m_recvTimeout.load(std::memory_order_relaxed);
     }else {
-        return m_sendTimeout;
+        return m_sendTimeout.load(std::memory_order_relaxed);
     }
 }
 
-bool FdCtx::init() {
-    // 初始化过
-    if(m_isInit) {
-        return true;
-    }
+int FdCtx::waitIndex(int type) {
+    return SO_RCVTIMEO == type? 0: 1;
+}
+
+bool FdCtx::init(int fd) {
+    m_fd = fd;
     // 都不超时
     m_recvTimeout = -1;
     m_sendTimeout = -1;
@@ -77,44 +70,35 @@ bool FdCtx::init() {
     return m_isInit;
 }
 
-FdManager::FdManager() {
-    m_fds.resize(64);
+FdManager::FdManager():
+    m_ctxs(GetFdLimit()) {
 }
 
-FdCtx::ptr FdManager::get(int fd, bool autoCreate) {
-    if(-1 == fd) {
-        return nullptr;
+FdCtx* FdManager::create(int fd) {
+    MutexType::Lock lock(m_mutex);
+    FdCtx* ctx = m_ctxs.getOrCreate(fd);
+    // 加锁前已经被其他线程创建
+    if(ctx->m_live.load(std::memory_order_relaxed)) {
+        return ctx;
     }
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fds.size() <= fd) {
-        // 不够，并且不自动创建
-        if(!autoCreate) {
-            return nullptr;
-        }
-    }else {
-        // 存在，或者不自动创建
-        if(m_fds[fd] || !autoCreate) {
-            return m_fds[fd];
-        }
-    }
-    lock.unlock();
-
-    // 扩容
-    RWMutexType::WriteLock lock2(m_mutex);
-    FdCtx::ptr ctx(new FdCtx(fd));
-    if(fd >= (int)m_fds.size()) {
-        m_fds.resize(fd * 1.5);
-    }
-    m_fds[fd] = ctx;
+    // 原地初始化后再发布
+    ctx->init(fd);
+    ctx->m_live.store(true, std::memory_order_release);
     return ctx;
 }
 
 void FdManager::del(int fd) {
-    RWMutexType::WriteLock lock(m_mutex);
-    if((int)m_fds.size() <= fd) {
+    if(fd < 0) {
+        return ;
+    }
+    MutexType::Lock lock(m_mutex);
+    FdCtx* ctx = m_ctxs.get(fd);
+    if(!ctx) {
         return ;
     }
-    m_fds[fd].reset();
+    // 还持有指针的调用者会看到已经关闭
+    ctx->m_isClosed.store(true, std::memory_order_relaxed);
+    ctx->m_live.store(false, std::memory_order_release);
 }
 
 }
\ No newline at end of file
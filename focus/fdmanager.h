@@ -3,24 +3,24 @@
 
 #include <memory>
 #include <cstdint>
-#include <vector>
+#include <atomic>
 #include "mutex.h"
+#include "pagetable.h"
 #include "singleton.h"
 
 namespace focus {
 
 /**
  * @brief 帮助hook模块的fd上下文
+ * @details 对象常驻在FdManager的页中，fd关闭后重新打开时原地初始化，
+ *          字段都是原子变量，旧的持有者读到的是当前fd的状态
  */
-class FdCtx: public std::enable_shared_from_this<FdCtx> {
+class FdCtx {
 public:
-    using ptr = std::shared_ptr<FdCtx>;
-
     /**
-     * @brief 构造函数
-     * @param[in] fd 文件句柄
+     * @brief 构造函数，页中的空闲上下文
      */
-    FdCtx(int fd);
+    FdCtx();
 
     /**
      * @brief 析构函数
@@ -31,49 +31,49 @@ public:
      * @brief 是否初始化
      */
     bool isInit() const {
-        return m_isInit;
+        return m_isInit.load(std::memory_order_relaxed);
     }
 
     /**
      * @brief 是否是套接字
      */
     bool isSocket() const {
-        return m_isSocket;
+        return m_isSocket.load(std::memory_order_relaxed);
     }
 
     /**
      * @brief 是否关闭
      */
     bool isClose() const {
-        return m_isClosed;
+        return m_isClosed.load(std::memory_order_relaxed);
     }
 
     /**
      * @brief 设置hook非阻塞
      */
     void setSysNonblock(bool v) {
-        m_sysNonblock = v;
+        m_sysNonblock.store(v, std::memory_order_relaxed);
     }
 
     /**
      * @brief 获取hook非阻塞
      */
     bool getSysNonblock() const {
-        return m_sysNonblock;
+        return m_sysNonblock.load(std::memory_order_relaxed);
     }
 
     /**
      * @brief 设置用户非阻塞
      */
     void setUserNonblock(bool v) {
-        m_userNonblock = v;
+        m_userNonblock.store(v, std::memory_order_relaxed);
     }
 
     /**
      * @brief 获取用户非阻塞
      */
     bool getUserNonblock() const {
-        return m_userNonblock;
+        return m_userNonblock.load(std::memory_order_relaxed);
     }
 
     /**
@@ -89,29 +89,76 @@ public:
      */
     uint64_t getTimeout(int type);
 
+    /**
+     * @brief 开始一次带超时的等待，hook在资源不可用时调用
+     * @param[in] type 超时时间类型
+     * @return 本次等待的序号
+     */
+    uint64_t beginWait(int type) {
+        return m_waitSeq[waitIndex(type)].fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    /**
+     * @brief 定时器到期时调用，标记等待超时
+     * @param[in] type 超时时间类型
+     * @param[in] seq 等待序号
+     * @return 等待已经结束或者被新的等待替代返回false
+     */
+    bool expireWait(int type, uint64_t seq) {
+        int i = waitIndex(type);
+        if(m_waitSeq[i].load(std::memory_order_relaxed) != seq) {
+            return false;
+        }
+        m_timedoutSeq[i].store(seq, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 等待是否已经超时
+     * @param[in] type 超时时间类型
+     * @param[in] seq 等待序号
+     */
+    bool isWaitTimedout(int type, uint64_t seq) const {
+        return m_timedoutSeq[waitIndex(type)].load(std::memory_order_acquire) == seq;
+    }
+
 private:
+    friend class FdManager;
+
+    /**
+     * @brief 超时时间类型对应的等待下标
+     */
+    static int waitIndex(int type);
+
     /**
      * @brief 初始化
+     * @param[in] fd 文件句柄
      */
-    bool init();
+    bool init(int fd);
 
 private:
-    bool m_isInit; // 是否初始化
-    bool m_isSocket; // 是否是套接字
-    bool m_sysNonblock; // 是否hook非阻塞
-    bool m_userNonblock; // 是否用户设置非阻塞
-    bool m_isClosed; // 是否关闭
-    int m_fd; // 句柄
-    uint64_t m_recvTimeout; // 读超时时间毫秒
-    uint64_t m_sendTimeout; // 写超时时间毫秒
+    std::atomic<bool> m_live = {false}; // 是否在使用，FdManager据此判断是否存在
+    std::atomic<bool> m_isInit = {false}; // 是否初始化
+    std::atomic<bool> m_isSocket = {false}; // 是否是套接字
+    std::atomic<bool> m_sysNonblock = {false}; // 是否hook非阻塞
+    std::atomic<bool> m_userNonblock = {false}; // 是否用户设置非阻塞
+    std::atomic<bool> m_isClosed = {false}; // 是否关闭
+    int m_fd = -1; // 句柄
+    std::atomic<uint64_t> m_recvTimeout = {(uint64_t)-1}; // 读超时时间毫秒
+    std::atomic<uint64_t> m_sendTimeout = {(uint64_t)-1}; // 写超时时间毫秒
+    // 读写各自的等待序号，上下文常驻，重新打开后也不重置，过期的定时器不会误判
+    std::atomic<uint64_t> m_waitSeq[2] = {}; // 最近一次等待的序号
+    std::atomic<uint64_t> m_timedoutSeq[2] = {}; // 最近一次超时的等待序号
 };
 
 /**
  * @brief 句柄管理类
+ * @details 上下文按页分配，页只增不减，查找只有原子读，不加锁也不修改引用计数；
+ *          创建和删除加锁，只在socket、accept、close等调用中发生
  */
 class FdManager {
 public:
-    using RWMutexType = RWMutex;
+    using MutexType = Mutex;
 
     /**
      * @brief 构造函数
@@ -122,8 +169,18 @@ public:
      * @brief 获取句柄类
      * @param[in] fd 句柄
      * @param[in] autoCreate 是否自动创建
+     * @return 不存在返回nullptr，返回的指针一直有效
      */
-    FdCtx::ptr get(int fd, bool autoCreate = false);
+    FdCtx* get(int fd, bool autoCreate = false) {
+        if(fd < 0) {
+            return nullptr;
+        }
+        FdCtx* ctx = m_ctxs.get(fd);
+        if(ctx && ctx->m_live.load(std::memory_order_acquire)) {
+            return ctx;
+        }
+        return autoCreate? create(fd): nullptr;
+    }
 
     /**
      * @brief 删除句柄
@@ -132,8 +189,14 @@ public:
     void del(int fd);
 
 private:
-    RWMutexType m_mutex; // 读写锁
-    std::vector<FdCtx::ptr> m_fds; // 句柄集合
+    /**
+     * @brief 创建句柄上下文，需要时分配页
+     */
+    FdCtx* create(int fd);
+
+private:
+    MutexType m_mutex; // 创建和删除的锁
+    PageTable<FdCtx> m_ctxs; // 上下文的页表，与IOManager一样可以增长
 };
 
 // 单例句柄管理类
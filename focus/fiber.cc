@@ -4,6 +4,8 @@
 #include "config.h"
 #include "scheduler.h"
 #include <atomic>
+#include <algorithm>
+#include <sys/mman.h>
 
 namespace focus {
 
@@ -17,6 +19,11 @@ static std::atomic<uint64_t> s_fiber_count = {0};
 
 // 线程局部变量，当前运行的协程原始指针
 static thread_local Fiber* t_fiber = nullptr;
+
+// 已分配的协程局部变量槽位数
+static std::atomic<size_t> s_local_slot_count = {0};
+// 每个槽位的销毁函数
+static void (*s_local_dtors[Fiber::LOCAL_SLOTS])(void*);
 // 线程局部变量，当前线程的主线程
 static thread_local Fiber::ptr t_thread_fiber = nullptr;
 
@@ -24,21 +31,235 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size = 
     Config::LookUp<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
 
+// 协程栈大小分级，只在第一次分配时读取
+static ConfigVar<std::vector<uint32_t>>::ptr g_fiber_stack_classes =
+    Config::LookUp("fiber.stack_classes",
+                   std::vector<uint32_t>{64 * 1024, 128 * 1024, 256 * 1024, 512 * 1024, 1024 * 1024},
+                   "fiber stack size classes");
+
+// 每个线程每一级缓存的栈数量
+static ConfigVar<uint32_t>::ptr g_fiber_stack_thread_cache =
+    Config::LookUp<uint32_t>("fiber.stack_thread_cache", 16, "fiber stack per thread cache count");
+
+// 全局每一级缓存的栈数量
+static ConfigVar<uint32_t>::ptr g_fiber_stack_global_cache =
+    Config::LookUp<uint32_t>("fiber.stack_global_cache", 256, "fiber stack global cache count");
+
+// 栈池统计
+static std::atomic<uint64_t> s_stack_pool_hits = {0};
+static std::atomic<uint64_t> s_stack_pool_misses = {0};
+
+// 缓存的数量上限，配置变更时在其他线程修改
+static std::atomic<uint32_t> s_stack_thread_cache = {16};
+static std::atomic<uint32_t> s_stack_global_cache = {256};
+
 /**
- * @brief 栈内存分配器
+ * @brief 全局栈池，线程缓存满时溢出到这里，按NUMA节点分开
+ * @attention 不会析构，避免退出时线程缓存访问已析构的对象
  */
-class MallocStackAllocator {
+struct StackGlobalPool {
+    StackGlobalPool() {
+        m_pageSize = sysconf(_SC_PAGESIZE);
+        m_classes = g_fiber_stack_classes->getVal();
+        std::sort(m_classes.begin(), m_classes.end());
+        // 按页对齐
+        for(auto& size: m_classes) {
+            size = (size + m_pageSize - 1) / m_pageSize * m_pageSize;
+        }
+        m_classes.erase(std::unique(m_classes.begin(), m_classes.end()), m_classes.end());
+        // 每个NUMA节点单独缓存，避免线程拿到其他节点上的栈
+        m_free.resize(GetNumaNodeCount(), std::vector<std::vector<void*>>(m_classes.size()));
+
+        s_stack_thread_cache.store(g_fiber_stack_thread_cache->getVal(), std::memory_order_relaxed);
+        s_stack_global_cache.store(g_fiber_stack_global_cache->getVal(), std::memory_order_relaxed);
+        g_fiber_stack_thread_cache->addCallBack([](const uint32_t& oldVal, const uint32_t& newVal){
+            s_stack_thread_cache.store(newVal, std::memory_order_relaxed);
+        });
+        g_fiber_stack_global_cache->addCallBack([](const uint32_t& oldVal, const uint32_t& newVal){
+            s_stack_global_cache.store(newVal, std::memory_order_relaxed);
+        });
+    }
+
+    /**
+     * @brief 获取栈大小所属的级别，-1表示不缓存
+     */
+    int getClass(size_t size) const {
+        for(size_t i = 0; i < m_classes.size(); ++i) {
+            if(size <= m_classes[i]) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief 获取实际映射的栈大小(不含保护页)
+     */
+    size_t getMapSize(size_t size) const {
+        int idx = getClass(size);
+        if(-1 != idx) {
+            return m_classes[idx];
+        }
+        return (size + m_pageSize - 1) / m_pageSize * m_pageSize;
+    }
+
+    /**
+     * @brief 获取当前线程所在节点的空闲栈
+     */
+    std::vector<void*>& getFree(int idx) {
+        size_t node = GetCurrentNumaNode();
+        return m_free[node < m_free.size()? node: 0][idx];
+    }
+
+    Mutex m_mutex; // 锁
+    size_t m_pageSize = 4096; // 页大小
+    std::vector<uint32_t> m_classes; // 栈大小分级
+    std::vector<std::vector<std::vector<void*>>> m_free; // 每个节点每一级空闲的栈
+};
+
+static StackGlobalPool* GetStackGlobalPool() {
+    static StackGlobalPool* s_pool = new StackGlobalPool;
+    return s_pool;
+}
+
+/**
+ * @brief 线程栈缓存
+ */
+struct StackThreadCache {
+    StackThreadCache() {
+        m_free.resize(GetStackGlobalPool()->m_classes.size());
+    }
+
+    /**
+     * @brief 线程退出时归还到全局栈池
+     */
+    ~StackThreadCache();
+
+    std::vector<std::vector<void*>> m_free; // 每一级空闲的栈
+};
+
+// 线程局部变量，线程栈缓存，线程退出后为空
+static thread_local StackThreadCache* t_stack_cache = nullptr;
+
+/**
+ * @brief 管理线程栈缓存的生命周期
+ */
+struct StackThreadCacheHolder {
+    StackThreadCache* get() {
+        if(!m_cache && !m_destroyed) {
+            m_cache = new StackThreadCache;
+            t_stack_cache = m_cache;
+        }
+        return m_cache;
+    }
+
+    ~StackThreadCacheHolder() {
+        t_stack_cache = nullptr;
+        m_destroyed = true;
+        delete m_cache;
+        m_cache = nullptr;
+    }
+
+    StackThreadCache* m_cache = nullptr;
+    bool m_destroyed = false;
+};
+
+static thread_local StackThreadCacheHolder t_stack_cache_holder;
+
+/**
+ * @brief mmap栈内存分配器
+ * @details 栈底有一个PROT_NONE的保护页，栈溢出时直接段错误而不是破坏堆。
+ *          按大小分级缓存，优先从线程缓存获取，其次当前NUMA节点的全局栈池，最后mmap(首次访问时分配在本节点)
+ */
+class PooledStackAllocator {
 public:
     static void* Alloc(size_t size) {
-        return malloc(size);
+        StackGlobalPool* pool = GetStackGlobalPool();
+        int idx = pool->getClass(size);
+        if(-1 != idx) {
+            // 线程缓存
+            StackThreadCache* cache = t_stack_cache_holder.get();
+            if(cache && !cache->m_free[idx].empty()) {
+                void* vp = cache->m_free[idx].back();
+                cache->m_free[idx].pop_back();
+                ++s_stack_pool_hits;
+                return vp;
+            }
+            // 全局栈池
+            {
+                Mutex::Lock lock(pool->m_mutex);
+                std::vector<void*>& free = pool->getFree(idx);
+                if(!free.empty()) {
+                    void* vp = free.back();
+                    free.pop_back();
+                    ++s_stack_pool_hits;
+                    return vp;
+                }
+            }
+        }
+        ++s_stack_pool_misses;
+        return Map(pool->getMapSize(size), pool->m_pageSize);
     }
 
     static void Dealloc(void* vp, size_t size) {
-        return free(vp);
+        StackGlobalPool* pool = GetStackGlobalPool();
+        int idx = pool->getClass(size);
+        if(-1 == idx) {
+            Unmap(vp, pool->getMapSize(size), pool->m_pageSize);
+            return ;
+        }
+        // 线程缓存
+        StackThreadCache* cache = t_stack_cache;
+        if(cache && cache->m_free[idx].size() < s_stack_thread_cache.load(std::memory_order_relaxed)) {
+            cache->m_free[idx].emplace_back(vp);
+            return ;
+        }
+        Release(idx, vp);
+    }
+
+    /**
+     * @brief 归还到全局栈池，满了就释放
+     */
+    static void Release(int idx, void* vp) {
+        StackGlobalPool* pool = GetStackGlobalPool();
+        {
+            Mutex::Lock lock(pool->m_mutex);
+            std::vector<void*>& free = pool->getFree(idx);
+            if(free.size() < s_stack_global_cache.load(std::memory_order_relaxed)) {
+                free.emplace_back(vp);
+                return ;
+            }
+        }
+        Unmap(vp, pool->m_classes[idx], pool->m_pageSize);
+    }
+
+private:
+    static void* Map(size_t size, size_t pageSize) {
+        void* base = mmap(nullptr, size + pageSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        FOCUS_ASSERT2(MAP_FAILED != base, "mmap fiber stack size = " << size << " errno = " << errno);
+        // 栈向下增长，保护页放在最低地址
+        if(mprotect(base, pageSize, PROT_NONE)) {
+            FOCUS_LOG_ERROR(g_logger) << "mprotect fiber stack guard page errno = " << errno
+                                      << " errstr = " << strerror(errno);
+        }
+        return (char*)base + pageSize;
+    }
+
+    static void Unmap(void* vp, size_t size, size_t pageSize) {
+        munmap((char*)vp - pageSize, size + pageSize);
     }
 };
 
-using StackAllocator = MallocStackAllocator;
+StackThreadCache::~StackThreadCache() {
+    for(size_t i = 0; i < m_free.size(); ++i) {
+        for(auto vp: m_free[i]) {
+            PooledStackAllocator::Release(i, vp);
+        }
+    }
+}
+
+using StackAllocator = PooledStackAllocator;
 
 Fiber::Fiber() {
     // 设置当前协程指针    
@@ -47,8 +268,8 @@ Fiber::Fiber() {
     m_state = RUNNING;
 
     // 获取上下文
-    if(getcontext(&m_uctx)) {
-        FOCUS_ASSERT2(false, "Fiber::Fiber() getcontext");
+    if(!InitContext(&m_ctx)) {
+        FOCUS_ASSERT2(false, "Fiber::Fiber() InitContext");
     }
 
     // 总数加1
@@ -69,19 +290,11 @@ Fiber::Fiber(std::function<void()> cb, uint32_t stacksize, bool runInScheduler):
     m_stacksize = stacksize? stacksize: g_fiber_stack_size->getVal();
     m_stack = StackAllocator::Alloc(m_stacksize);
 
-    // 获取上下文
-    if(getcontext(&m_uctx)) {
-        FOCUS_ASSERT2(false, "Fiber:Fiber(...) getcontext");
+    // 填充上下文信息，绑定入口函数
+    if(!MakeContext(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc)) {
+        FOCUS_ASSERT2(false, "Fiber:Fiber(...) MakeContext");
     }
 
-    // 填充上下文信息
-    m_uctx.uc_link = nullptr;
-    m_uctx.uc_stack.ss_sp = m_stack;
-    m_uctx.uc_stack.ss_size = m_stacksize;
-
-    // 绑定入口函数
-    makecontext(&m_uctx, &Fiber::MainFunc, 0);
-
     // 调试信息
     FOCUS_LOG_DEBUG(g_logger) << "Fiber::Fiber(...) id = " << m_id;
 }
@@ -92,6 +305,9 @@ Fiber::Fiber(std::function<void()> cb, uint32_t stacksize, bool runInScheduler):
 Fiber::~Fiber() {
     FOCUS_LOG_DEBUG(g_logger) << "Fiber::~Fiber() id = " << m_id;
     --s_fiber_count;
+    // 线程主协程的局部变量在线程退出时销毁
+    clearLocals();
+    delete[] m_locals;
     if(m_stack) {
         // 子协程
         // 确保是结束状态
@@ -123,21 +339,15 @@ void Fiber::reset(std::function<void()> cb) {
     FOCUS_ASSERT(m_stack);
     FOCUS_ASSERT(TERM == m_state);
 
+    // 上一次运行留下的局部变量
+    clearLocals();
     // 重载信息
-    m_cb = cb;
+    m_cb = std::move(cb);
 
-    // 获取上下文
-    if(getcontext(&m_uctx)) {
-        FOCUS_ASSERT2(false, "Fiber::reset getcontext");
+    // 填充上下文信息，绑定入口函数
+    if(!MakeContext(&m_ctx, m_stack, m_stacksize, &Fiber::MainFunc)) {
+        FOCUS_ASSERT2(false, "Fiber::reset MakeContext");
     }
-
-    // 填充上下文信息
-    m_uctx.uc_link = nullptr;
-    m_uctx.uc_stack.ss_sp = m_stack;
-    m_uctx.uc_stack.ss_size = m_stacksize;
-
-    // 绑定入口函数
-    makecontext(&m_uctx, &Fiber::MainFunc, 0);
     m_state = READY;
 }
 
@@ -153,15 +363,20 @@ void Fiber::resume() {
     // 是否参加调度器
     if(m_runInScheduler) {
         // 与调度器的主协程交换
-        if(swapcontext(&(Scheduler::GetMainFiber()->m_uctx), &m_uctx)) {
-            FOCUS_ASSERT2(false, "Fiber::resume() swapcontext from thread to scheduler");
+        if(!SwapContext(&(Scheduler::GetMainFiber()->m_ctx), &m_ctx)) {
+            FOCUS_ASSERT2(false, "Fiber::resume() SwapContext from thread to scheduler");
         }
     }else {
         // 与当前线程的主协程交换
-        if(swapcontext(&(t_thread_fiber->m_uctx), &m_uctx)) {
-            FOCUS_ASSERT2(false, "Fiber::resume() swapcontext from thread to cur");
+        if(!SwapContext(&(t_thread_fiber->m_ctx), &m_ctx)) {
+            FOCUS_ASSERT2(false, "Fiber::resume() SwapContext from thread to cur");
         }
     }
+
+    // 上下文保存完成后才标记为READY，其他线程看到READY时才能resume
+    if(RUNNING == m_state) {
+        m_state = READY;
+    }
 }
 
 /**
@@ -170,22 +385,23 @@ void Fiber::resume() {
  */
 void Fiber::yield() {
     FOCUS_ASSERT(TERM == m_state || RUNNING == m_state);
+#ifndef NDEBUG
+    // 内联任务运行在调度协程上，没有自己的上下文可以让出
+    FOCUS_ASSERT2(!Scheduler::IsInInlineTask(), "Fiber::yield() in inline task");
+#endif
     SetThis(t_thread_fiber.get());
 
-    if(TERM != m_state) {
-        m_state = READY;
-    }
-
+    // 状态保持RUNNING，切换完成后由resume改为READY，避免上下文还没保存就被其他线程resume
     // 是否参加调度器
     if(m_runInScheduler) {
         // 与调度器的主协程交换
-        if(swapcontext(&m_uctx, &(Scheduler::GetMainFiber()->m_uctx))) {
-            FOCUS_ASSERT2(false, "Fiber::yield() swapcontext from scheduler to thread");
+        if(!SwapContext(&m_ctx, &(Scheduler::GetMainFiber()->m_ctx))) {
+            FOCUS_ASSERT2(false, "Fiber::yield() SwapContext from scheduler to thread");
         }
     }else {
         // 与当前线程的主协程交换
-        if(swapcontext(&m_uctx, &(t_thread_fiber->m_uctx))) {
-            FOCUS_ASSERT2(false, "Fiber::yield() swapcontext from cur to thread");
+        if(!SwapContext(&m_ctx, &(t_thread_fiber->m_ctx))) {
+            FOCUS_ASSERT2(false, "Fiber::yield() SwapContext from cur to thread");
         }
     }
 }
@@ -197,6 +413,44 @@ void Fiber::SetThis(Fiber* f) {
     t_fiber = f;
 }
 
+Fiber* Fiber::GetCurrent() {
+    return t_fiber;
+}
+
+size_t Fiber::AllocLocalSlot(void (*dtor)(void*)) {
+    size_t slot = s_local_slot_count.fetch_add(1);
+    FOCUS_ASSERT2(slot < LOCAL_SLOTS, "too many FiberLocal, max = " << LOCAL_SLOTS);
+    s_local_dtors[slot] = dtor;
+    return slot;
+}
+
+void Fiber::setLocal(size_t slot, void* value) {
+    if(!m_locals) {
+        m_locals = new void*[LOCAL_SLOTS]();
+    }
+    m_locals[slot] = value;
+    if(value) {
+        m_localMask |= 1ull << slot;
+    }else {
+        m_localMask &= ~(1ull << slot);
+    }
+}
+
+void Fiber::clearLocals() {
+    // 析构函数中可能又设置了局部变量，最多重复几轮
+    for(int round = 0; m_localMask && round < 4; ++round) {
+        uint64_t mask = m_localMask;
+        m_localMask = 0;
+        while(mask) {
+            size_t slot = __builtin_ctzll(mask);
+            mask &= mask - 1;
+            void* value = m_locals[slot];
+            m_locals[slot] = nullptr;
+            s_local_dtors[slot](value);
+        }
+    }
+}
+
 /**
  * @brief 获取当前协程，同时初始化协程主协程，使用前需要调用
  */
@@ -218,6 +472,14 @@ uint64_t Fiber::TotalFibers() {
     return s_fiber_count.load();
 }
 
+uint64_t Fiber::StackPoolHits() {
+    return s_stack_pool_hits.load();
+}
+
+uint64_t Fiber::StackPoolMisses() {
+    return s_stack_pool_misses.load();
+}
+
 /**
  * @brief 协程入口函数
  */
@@ -228,6 +490,8 @@ void Fiber::MainFunc() {
     // 调用函数，并进入结束状态
     cur->m_cb();
     cur->m_cb = nullptr;
+    // 在协程中销毁局部变量，析构函数还能访问当前协程
+    cur->clearLocals();
     cur->m_state = TERM;
 
     auto raw_ptr = cur.get(); // 引用计数减1
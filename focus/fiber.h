@@ -3,8 +3,10 @@
 
 #include <functional>
 #include <memory>
-#include <ucontext.h>
+#include <atomic>
 #include <cstdint>
+#include "context.h"
+#include "nocopyable.h"
 
 namespace focus {
 
@@ -15,6 +17,9 @@ class Fiber: public std::enable_shared_from_this<Fiber> {
 public:
     using ptr = std::shared_ptr<Fiber>;
 
+    // 协程局部变量的最大槽位数
+    static constexpr size_t LOCAL_SLOTS = 64;
+
     /**
      * 协程状态
      */
@@ -80,6 +85,31 @@ public:
         return m_state;
     }
 
+    /**
+     * @brief 是否参与调度器，线程的主协程和caller的调度协程不参与
+     */
+    bool isRunInScheduler() const {
+        return m_runInScheduler;
+    }
+
+    /**
+     * @brief 获取局部变量槽位的值，没有设置返回nullptr
+     */
+    void* getLocal(size_t slot) const {
+        return m_locals? m_locals[slot]: nullptr;
+    }
+
+    /**
+     * @brief 设置局部变量槽位的值，原来的值不会被销毁
+     */
+    void setLocal(size_t slot, void* value);
+
+    /**
+     * @brief 销毁所有局部变量
+     * @details 协程结束、重置和析构时调用
+     */
+    void clearLocals();
+
 public:
     /**
      * @brief 设置当前协程
@@ -91,11 +121,33 @@ public:
      */
     static Fiber::ptr GetThis();
 
+    /**
+     * @brief 获取当前执行的协程，不创建主协程，不增加引用计数
+     * @return 线程还没有协程时返回nullptr
+     */
+    static Fiber* GetCurrent();
+
+    /**
+     * @brief 分配协程局部变量槽位
+     * @param[in] dtor 协程结束时销毁值的函数
+     */
+    static size_t AllocLocalSlot(void (*dtor)(void*));
+
     /**
      * @brief 获取协程总数
      */
     static uint64_t TotalFibers();
 
+    /**
+     * @brief 获取协程栈池命中次数
+     */
+    static uint64_t StackPoolHits();
+
+    /**
+     * @brief 获取协程栈池未命中次数(需要mmap新栈)
+     */
+    static uint64_t StackPoolMisses();
+
     /**
      * @brief 协程入口函数
      */
@@ -109,11 +161,86 @@ public:
 private:
     uint64_t m_id = 0; // 协程id
     uint32_t m_stacksize = 0; // 协程栈大小
-    State m_state = READY; // 协程状态
-    ucontext_t m_uctx; // 协程上下文
+    std::atomic<State> m_state = {READY}; // 协程状态，其他线程调度时会读取
+    Context m_ctx; // 协程上下文
     void* m_stack = nullptr; // 协程栈地址
     std::function<void()> m_cb; // 协程回调函数
-    bool m_runInScheduler; // 是否参与调度器
+    bool m_runInScheduler = false; // 是否参与调度器
+    void** m_locals = nullptr; // 局部变量槽位数组，第一次设置时分配
+    uint64_t m_localMask = 0; // 有值的槽位
+};
+
+/**
+ * @brief 协程局部变量
+ * @details 值保存在当前协程的槽位数组中，第一次访问时构造，协程结束或重置时析构；
+ *          协程在线程间迁移时跟随协程，不在协程中时使用线程的主协程。
+ *          槽位不回收，一般定义为静态变量
+ */
+template<class T>
+class FiberLocal: public Nocopyable {
+public:
+    FiberLocal():
+        m_slot(Fiber::AllocLocalSlot(&FiberLocal::Destroy)) {
+    }
+
+    /**
+     * @brief 获取当前协程的值，没有则默认构造
+     */
+    T& get() {
+        Fiber* fiber = Fiber::GetCurrent();
+        if(!fiber) {
+            fiber = Fiber::GetThis().get();
+        }
+        void* value = fiber->getLocal(m_slot);
+        if(!value) {
+            value = new T();
+            fiber->setLocal(m_slot, value);
+        }
+        return *static_cast<T*>(value);
+    }
+
+    /**
+     * @brief 获取当前协程的值，没有返回nullptr，不会构造
+     */
+    T* tryGet() const {
+        Fiber* fiber = Fiber::GetCurrent();
+        return fiber? static_cast<T*>(fiber->getLocal(m_slot)): nullptr;
+    }
+
+    /**
+     * @brief 设置当前协程的值
+     */
+    void set(T v) {
+        get() = std::move(v);
+    }
+
+    /**
+     * @brief 销毁当前协程的值
+     */
+    void reset() {
+        Fiber* fiber = Fiber::GetCurrent();
+        void* value = fiber? fiber->getLocal(m_slot): nullptr;
+        if(value) {
+            fiber->setLocal(m_slot, nullptr);
+            Destroy(value);
+        }
+    }
+
+    T& operator*() {
+        return get();
+    }
+
+    T* operator->() {
+        return &get();
+    }
+
+private:
+    static void Destroy(void* value) {
+        delete static_cast<T*>(value);
+    }
+
+private:
+    size_t m_slot; // 槽位
 };
 
 } // namespace focus
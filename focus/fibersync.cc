@@ -0,0 +1,233 @@
+#include "fibersync.h"
+#include "scheduler.h"
+#include "macro.h"
+
+namespace focus {
+
+void FiberWaitQueue::push(FiberWaiter* waiter) {
+    waiter->m_next = nullptr;
+    ++m_size;
+    if(m_tail) {
+        m_tail->m_next = waiter;
+    }else {
+        m_head = waiter;
+    }
+    m_tail = waiter;
+}
+
+FiberWaiter* FiberWaitQueue::pop() {
+    FiberWaiter* waiter = m_head;
+    if(waiter) {
+        --m_size;
+        m_head = waiter->m_next;
+        if(!m_head) {
+            m_tail = nullptr;
+        }
+        waiter->m_next = nullptr;
+    }
+    return waiter;
+}
+
+void FiberWaitQueue::Park(FiberWaiter& waiter, SpinLock::Lock& lock) {
+    Scheduler* scheduler = Scheduler::GetThis();
+    Fiber::ptr fiber = Fiber::GetThis();
+    if(scheduler && fiber->isRunInScheduler()) {
+        // 唤醒时协程可能还没有让出，调度器会等到它让出后再执行
+        waiter.m_scheduler = scheduler;
+        waiter.m_fiber = fiber;
+        Fiber* raw = fiber.get();
+        fiber.reset();
+        lock.unlock();
+        raw->yield();
+        return;
+    }
+
+    // 不在调度器的协程中，阻塞线程
+    fiber.reset();
+    Semaphore sem;
+    waiter.m_sem = &sem;
+    lock.unlock();
+    sem.wait();
+}
+
+void FiberWaitQueue::Wake(FiberWaiter* waiter) {
+    if(waiter->m_sem) {
+        waiter->m_sem->notify();
+        return;
+    }
+    Scheduler* scheduler = waiter->m_scheduler;
+    Fiber::ptr fiber;
+    fiber.swap(waiter->m_fiber);
+    FOCUS_ASSERT(scheduler && fiber);
+    scheduler->schedule(fiber);
+}
+
+void FiberMutex::lockSlow() {
+    SpinLock::Lock lock(m_mutex);
+    // 标记有竞争，持有者解锁时走加锁路径
+    if(UNLOCKED == m_state.exchange(CONTENDED, std::memory_order_acquire)) {
+        return;
+    }
+    FiberWaiter waiter;
+    m_waiters.push(&waiter);
+    FiberWaitQueue::Park(waiter, lock);
+    // 解锁者已经把锁交给了当前协程
+}
+
+void FiberMutex::unlockSlow() {
+    SpinLock::Lock lock(m_mutex);
+    FiberWaiter* waiter = m_waiters.pop();
+    if(!waiter) {
+        m_state.store(UNLOCKED, std::memory_order_release);
+        return;
+    }
+    // 状态保持CONTENDED，锁直接交给等待者
+    lock.unlock();
+    FiberWaitQueue::Wake(waiter);
+}
+
+void FiberRWMutex::rdlockSlow() {
+    SpinLock::Lock lock(m_mutex);
+    uint32_t s = m_state.load(std::memory_order_relaxed);
+    while(true) {
+        // 没有写者持有或等待，直接获取
+        if(!(s & WRITER) && m_writers.empty()) {
+            if(m_state.compare_exchange_weak(s, s + 1, std::memory_order_acquire)) {
+                return;
+            }
+            continue;
+        }
+        if(m_state.compare_exchange_weak(s, s | WAITING, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    FiberWaiter waiter;
+    m_readers.push(&waiter);
+    FiberWaitQueue::Park(waiter, lock);
+    // 解锁者已经为当前协程增加了读者计数
+}
+
+void FiberRWMutex::wrlockSlow() {
+    SpinLock::Lock lock(m_mutex);
+    uint32_t s = m_state.load(std::memory_order_relaxed);
+    while(true) {
+        // 没有持有者，直接获取，保留等待标记
+        if(!(s & (WRITER | READERS))) {
+            if(m_state.compare_exchange_weak(s, s | WRITER, std::memory_order_acquire)) {
+                return;
+            }
+            continue;
+        }
+        if(m_state.compare_exchange_weak(s, s | WAITING, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    FiberWaiter waiter;
+    m_writers.push(&waiter);
+    FiberWaitQueue::Park(waiter, lock);
+    // 解锁者已经把写锁交给了当前协程
+}
+
+void FiberRWMutex::unlockSlow() {
+    SpinLock::Lock lock(m_mutex);
+    uint32_t s = m_state.load(std::memory_order_relaxed);
+    uint32_t next = 0;
+    bool wakeWriter = false;
+    bool wakeReaders = false;
+    do {
+        // 释放当前持有者
+        next = (s & WRITER)? (s & ~WRITER): s - 1;
+        wakeWriter = false;
+        wakeReaders = false;
+        if(!(next & (WRITER | READERS))) {
+            if(!m_writers.empty()) {
+                // 没有持有者了，写锁交给第一个写者
+                next |= WRITER;
+                wakeWriter = true;
+            }else if(!m_readers.empty()) {
+                // 没有写者，读锁交给所有读者
+                next += m_readers.size();
+                wakeReaders = true;
+            }
+        }
+        // 唤醒后还有等待者时保留标记，否则恢复无锁路径
+        size_t writers = m_writers.size() - (wakeWriter? 1: 0);
+        size_t readers = wakeReaders? 0: m_readers.size();
+        if(writers || readers) {
+            next |= WAITING;
+        }else {
+            next &= ~WAITING;
+        }
+    }while(!m_state.compare_exchange_weak(s, next, std::memory_order_acq_rel));
+
+    FiberWaitQueue wake;
+    if(wakeWriter) {
+        wake.push(m_writers.pop());
+    }else if(wakeReaders) {
+        for(FiberWaiter* w = m_readers.pop(); w; w = m_readers.pop()) {
+            wake.push(w);
+        }
+    }
+    lock.unlock();
+
+    for(FiberWaiter* w = wake.pop(); w; w = wake.pop()) {
+        FiberWaitQueue::Wake(w);
+    }
+}
+
+void FiberCondVar::notifyOne() {
+    if(0 == m_count) {
+        return;
+    }
+    SpinLock::Lock lock(m_mutex);
+    FiberWaiter* waiter = m_waiters.pop();
+    if(!waiter) {
+        return;
+    }
+    --m_count;
+    lock.unlock();
+    FiberWaitQueue::Wake(waiter);
+}
+
+void FiberCondVar::notifyAll() {
+    if(0 == m_count) {
+        return;
+    }
+    FiberWaitQueue wake;
+    {
+        SpinLock::Lock lock(m_mutex);
+        for(FiberWaiter* w = m_waiters.pop(); w; w = m_waiters.pop()) {
+            wake.push(w);
+            --m_count;
+        }
+    }
+    for(FiberWaiter* w = wake.pop(); w; w = wake.pop()) {
+        FiberWaitQueue::Wake(w);
+    }
+}
+
+void FiberSemaphore::waitSlow() {
+    SpinLock::Lock lock(m_mutex);
+    // 释放者先到，已经留下了唤醒
+    if(m_wakeups > 0) {
+        --m_wakeups;
+        return;
+    }
+    FiberWaiter waiter;
+    m_waiters.push(&waiter);
+    FiberWaitQueue::Park(waiter, lock);
+}
+
+void FiberSemaphore::notifySlow() {
+    SpinLock::Lock lock(m_mutex);
+    FiberWaiter* waiter = m_waiters.pop();
+    if(!waiter) {
+        // 等待者已经减了计数但还没入队
+        ++m_wakeups;
+        return;
+    }
+    lock.unlock();
+    FiberWaitQueue::Wake(waiter);
+}
+
+} // end namespace focus
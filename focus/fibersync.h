@@ -0,0 +1,272 @@
+#ifndef __FOCUS_FIBERSYNC_H__
+#define __FOCUS_FIBERSYNC_H__
+
+#include <atomic>
+#include <cstdint>
+#include "mutex.h"
+#include "fiber.h"
+#include "nocopyable.h"
+
+namespace focus {
+
+class Scheduler;
+
+/**
+ * @brief 等待者，在挂起的协程栈(或线程栈)上
+ */
+struct FiberWaiter {
+    Scheduler* m_scheduler = nullptr; // 协程所在的调度器
+    Fiber::ptr m_fiber; // 挂起的协程
+    Semaphore* m_sem = nullptr; // 不在协程中时阻塞的信号量
+    FiberWaiter* m_next = nullptr; // 队列中的下一个
+};
+
+/**
+ * @brief 等待队列，先进先出，需要外部加锁
+ */
+class FiberWaitQueue: public Nocopyable {
+public:
+    /**
+     * @brief 是否为空
+     */
+    bool empty() const {
+        return !m_head;
+    }
+
+    /**
+     * @brief 等待者数量
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * @brief 放入队尾
+     */
+    void push(FiberWaiter* waiter);
+
+    /**
+     * @brief 取出队首，为空返回nullptr
+     */
+    FiberWaiter* pop();
+
+    /**
+     * @brief 挂起当前协程直到被唤醒
+     * @details waiter放入队列后调用，挂起前释放lock；
+     *          在调度器的协程中让出执行权，否则阻塞当前线程
+     * @param[in] waiter 已经在队列中的等待者
+     * @param[in] lock 保护队列的锁
+     */
+    static void Park(FiberWaiter& waiter, SpinLock::Lock& lock);
+
+    /**
+     * @brief 唤醒等待者，协程通过调度器重新调度
+     * @attention 唤醒后不能再访问waiter
+     */
+    static void Wake(FiberWaiter* waiter);
+
+private:
+    FiberWaiter* m_head = nullptr; // 队首
+    FiberWaiter* m_tail = nullptr; // 队尾
+    size_t m_size = 0; // 等待者数量
+};
+
+/**
+ * @brief 协程互斥量
+ * @details 没有竞争时只有一次CAS，竞争时挂起协程而不阻塞线程，
+ *          释放时直接把锁交给队首的等待者
+ */
+class FiberMutex: public Nocopyable {
+public:
+    using Lock = ScopedLockImpl<FiberMutex>;
+
+    /**
+     * @brief 上锁
+     */
+    void lock() {
+        int expected = UNLOCKED;
+        if(!m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire)) {
+            lockSlow();
+        }
+    }
+
+    /**
+     * @brief 尝试上锁
+     */
+    bool tryLock() {
+        int expected = UNLOCKED;
+        return m_state.compare_exchange_strong(expected, LOCKED, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief 解锁
+     */
+    void unlock() {
+        int expected = LOCKED;
+        if(!m_state.compare_exchange_strong(expected, UNLOCKED, std::memory_order_release)) {
+            unlockSlow();
+        }
+    }
+
+private:
+    void lockSlow();
+    void unlockSlow();
+
+private:
+    /**
+     * @brief 锁状态
+     */
+    enum State {
+        UNLOCKED = 0, // 未上锁
+        LOCKED = 1, // 已上锁，没有等待者
+        CONTENDED = 2 // 已上锁，可能有等待者
+    };
+
+    std::atomic<int> m_state = {UNLOCKED}; // 锁状态
+    SpinLock m_mutex; // 保护等待队列
+    FiberWaitQueue m_waiters; // 等待队列
+};
+
+/**
+ * @brief 协程读写锁
+ * @details 写优先，有写者等待时新的读者排队；没有等待者时读写都只有一次CAS
+ */
+class FiberRWMutex: public Nocopyable {
+public:
+    using ReadLock = ReadScopedLockImpl<FiberRWMutex>;
+    using WriteLock = WriteScopedLockImpl<FiberRWMutex>;
+
+    /**
+     * @brief 上读锁
+     */
+    void rdlock() {
+        uint32_t s = m_state.load(std::memory_order_relaxed);
+        if((s & (WRITER | WAITING)) || !m_state.compare_exchange_strong(s, s + 1, std::memory_order_acquire)) {
+            rdlockSlow();
+        }
+    }
+
+    /**
+     * @brief 上写锁
+     */
+    void wrlock() {
+        uint32_t expected = 0;
+        if(!m_state.compare_exchange_strong(expected, WRITER, std::memory_order_acquire)) {
+            wrlockSlow();
+        }
+    }
+
+    /**
+     * @brief 释放读锁或写锁
+     */
+    void unlock() {
+        uint32_t s = m_state.load(std::memory_order_relaxed);
+        if(!(s & WAITING)) {
+            uint32_t next = (s & WRITER)? 0: s - 1;
+            if(m_state.compare_exchange_strong(s, next, std::memory_order_release)) {
+                return;
+            }
+        }
+        unlockSlow();
+    }
+
+private:
+    void rdlockSlow();
+    void wrlockSlow();
+    void unlockSlow();
+
+private:
+    static const uint32_t WRITER = 1u << 31; // 写者持有
+    static const uint32_t WAITING = 1u << 30; // 有等待者，所有操作走加锁路径
+    static const uint32_t READERS = WAITING - 1; // 读者数量的掩码
+
+    std::atomic<uint32_t> m_state = {0}; // 状态
+    SpinLock m_mutex; // 保护等待队列
+    FiberWaitQueue m_readers; // 等待的读者
+    FiberWaitQueue m_writers; // 等待的写者
+};
+
+/**
+ * @brief 协程条件变量
+ * @details 配合FiberMutex::Lock等ScopedLockImpl使用
+ */
+class FiberCondVar: public Nocopyable {
+public:
+    /**
+     * @brief 释放锁并挂起，被唤醒后重新上锁
+     * @param[in] lock 已经上锁的局部锁
+     */
+    template<class LockType>
+    void wait(LockType& lock) {
+        FiberWaiter waiter;
+        SpinLock::Lock guard(m_mutex);
+        m_waiters.push(&waiter);
+        ++m_count;
+        // 入队后再解锁，之后的notify一定能看到等待者
+        lock.unlock();
+        FiberWaitQueue::Park(waiter, guard);
+        lock.lock();
+    }
+
+    /**
+     * @brief 唤醒一个等待者
+     */
+    void notifyOne();
+
+    /**
+     * @brief 唤醒所有等待者
+     */
+    void notifyAll();
+
+private:
+    std::atomic<size_t> m_count = {0}; // 等待者数量，为0时notify不加锁
+    SpinLock m_mutex; // 保护等待队列
+    FiberWaitQueue m_waiters; // 等待队列
+};
+
+/**
+ * @brief 协程信号量
+ * @details 计数为正时wait/notify只有一次原子操作
+ */
+class FiberSemaphore: public Nocopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] count 初始计数
+     */
+    FiberSemaphore(uint32_t count = 0):
+        m_count(count) {
+    }
+
+    /**
+     * @brief 获取信号量
+     */
+    void wait() {
+        if(m_count.fetch_sub(1, std::memory_order_acquire) <= 0) {
+            waitSlow();
+        }
+    }
+
+    /**
+     * @brief 释放信号量
+     */
+    void notify() {
+        if(m_count.fetch_add(1, std::memory_order_release) < 0) {
+            notifySlow();
+        }
+    }
+
+private:
+    void waitSlow();
+    void notifySlow();
+
+private:
+    std::atomic<int64_t> m_count; // 计数，为负表示等待者数量
+    SpinLock m_mutex; // 保护等待队列
+    FiberWaitQueue m_waiters; // 等待队列
+    uint64_t m_wakeups = 0; // 释放时等待者还没入队，留给它的唤醒次数
+};
+
+} // end namespace focus
+
+#endif
@@ -89,11 +89,74 @@ void setHookEnable(bool flag) {
 } // end namespace focus
 
 /**
- * @brief 定时器是否取消
+ * @brief 内联任务运行在调度协程上，不能进入可能让出的hook调用
+ * @param[in] hookFunName hook的系统调用名
  */
-struct TimerInfo {
-    int cancelled = 0;
-};
+static inline void assertNotInline(const char* hookFunName) {
+#ifndef NDEBUG
+    FOCUS_ASSERT2(!focus::Scheduler::IsInInlineTask(), "hooked " << hookFunName << " in inline task");
+#endif
+}
+
+/**
+ * @brief 填充直接提交的IO请求(read/recv)
+ */
+static bool prepareIo(focus::IORequest& req, void* buf, size_t len, int flags = 0) {
+    req.m_buf = buf;
+    req.m_len = len;
+    req.m_flags = flags;
+    return true;
+}
+
+/**
+ * @brief 填充直接提交的IO请求(write/send)
+ */
+static bool prepareIo(focus::IORequest& req, const void* buf, size_t len, int flags = 0) {
+    return prepareIo(req, (void*)buf, len, flags);
+}
+
+/**
+ * @brief 填充直接提交的IO请求(readv/writev)
+ */
+static bool prepareIo(focus::IORequest& req, const struct iovec* iov, int iovcnt) {
+    req.m_msg.msg_iov = (struct iovec*)iov;
+    req.m_msg.msg_iovlen = iovcnt;
+    return true;
+}
+
+/**
+ * @brief 填充直接提交的IO请求(sendmsg)
+ */
+static bool prepareIo(focus::IORequest& req, const struct msghdr* msg, int flags) {
+    req.m_msgPtr = (struct msghdr*)msg;
+    req.m_flags = flags;
+    return true;
+}
+
+/**
+ * @brief 填充直接提交的IO请求(recvmsg)
+ * @attention 非const的指针需要单独重载，否则会匹配到下面的模版
+ */
+static bool prepareIo(focus::IORequest& req, struct msghdr* msg, int flags) {
+    return prepareIo(req, (const struct msghdr*)msg, flags);
+}
+
+/**
+ * @brief 填充直接提交的IO请求(accept)
+ */
+static bool prepareIo(focus::IORequest& req, struct sockaddr* addr, socklen_t* addrlen) {
+    req.m_addr = addr;
+    req.m_addrlenPtr = addrlen;
+    return true;
+}
+
+/**
+ * @brief 其余系统调用不直接提交
+ */
+template<typename... Args>
+static bool prepareIo(focus::IORequest&, Args&&...) {
+    return false;
+}
 
 /**
  * @brief IO相关系统调用的执行模版函数
@@ -104,17 +167,20 @@ struct TimerInfo {
  * @param[in] hookFunName hook的系统调用名
  * @param[in] event 事件类型
  * @param[in] timeoutType 超时类型
+ * @param[in] op 后端支持直接提交时的IO操作
  * @param[in] args 可变参数包
  */
 template<typename OriginFun, typename... Args>
-static ssize_t doIo(int fd, OriginFun fun, const char* hookFunName, uint32_t event, int timeoutType, Args&&... args) {
+static ssize_t doIo(int fd, OriginFun fun, const char* hookFunName, uint32_t event, int timeoutType,
+                    focus::IORequest::Op op, Args&&... args) {
     // 没有设置hook
     if(!focus::t_hook_enable) {
         return fun(fd, std::forward<Args>(args)...);
     }
+    assertNotInline(hookFunName);
 
     // 没有在fd管理类中找到fd
-    focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(fd);
+    focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(fd);
     if(!ctx) {
         return fun(fd, std::forward<Args>(args)...);
     }
@@ -130,9 +196,10 @@ static ssize_t doIo(int fd, OriginFun fun, const char* hookFunName, uint32_t eve
         return fun(fd, std::forward<Args>(args)...);
     } 
 
-    // 获取超时时间
+    // 获取超时时间，超时的定时器在第一次资源不可用时才创建，重试时复用
     uint64_t to = ctx->getTimeout(timeoutType);
-    std::shared_ptr<TimerInfo> tinfo(new TimerInfo);
+    focus::Timer::ptr timer;
+    uint64_t seq = 0;
 
 retry:
     // 调用实际执行函数
@@ -146,22 +213,46 @@ retry:
     // 如果是由资源不可用导致的失败
     if(-1 == n && EAGAIN == errno) {
         focus::IOManager* iom = focus::IOManager::GetThis();
-        focus::Timer::ptr timer;
-        std::weak_ptr<TimerInfo> winfo(tinfo);
+
+        // 后端支持直接提交IO，完成后直接返回结果
+        if(focus::IORequest::NONE != op && iom->canSubmitIo()) {
+            focus::IORequest req;
+            req.m_op = op;
+            req.m_fd = fd;
+            req.m_timeout = to;
+            if(prepareIo(req, std::forward<Args>(args)...) && 0 == iom->submitIo(req)) {
+                // 后端没有等待，退回到事件方式
+                if(req.m_result >= 0 || req.m_timedout || -EAGAIN != req.m_result) {
+                    if(timer) {
+                        timer->cancel();
+                    }
+                    if(req.m_result >= 0) {
+                        return req.m_result;
+                    }
+                    errno = req.m_timedout? ETIMEDOUT: -req.m_result;
+                    return -1;
+                }
+            }
+        }
 
         // 设置了超时时间
         if((uint64_t)-1 != to) {
-            timer = iom->addConditionTimer([winfo, fd, iom, event](){
-                auto t =winfo.lock();
-                // Timerinfo对象无效或者取消
-                if(!t || t->cancelled) {
-                    return ;
-                }
-                // 超时，并且还未处理
-                t->cancelled = ETIMEDOUT;
-                // 取消事件，并触发一次
-                iom->cancelEvent(fd, (focus::IOManager::Event)(event));
-            },to,winfo);
+            if(!timer) {
+                // 超时状态记录在常驻的fd上下文中，过期的回调通过序号识别
+                seq = ctx->beginWait(timeoutType);
+                timer = iom->addTimer([ctx, fd, iom, event, timeoutType, seq](){
+                    // 等待已经结束，或者不是同一次调用
+                    if(!ctx->expireWait(timeoutType, seq)) {
+                        return ;
+                    }
+                    // 超时，取消事件，并触发一次
+                    iom->cancelEvent(fd, (focus::IOManager::Event)(event));
+                }, to);
+            }else if(!timer->refresh()) {
+                // 定时器已经到期，这次重试之前就超时了
+                errno = ETIMEDOUT;
+                return -1;
+            }
         }
 
         // 在fd上添加事件
@@ -179,20 +270,20 @@ retry:
         }else {
             // 让出执行权，等待事件
             focus::Fiber::GetThis()->yield();
-            // 恢复后，取消先前的定时器
-            if(timer) {
-                timer->cancel();
-            }
             // 如果先前被设置了超时，就是因为超时导致的失败
-            if(tinfo->cancelled) {
-                errno = tinfo->cancelled;
+            if(timer && ctx->isWaitTimedout(timeoutType, seq)) {
+                errno = ETIMEDOUT;
                 return -1;
             }
-            // 没有超时，重新尝试对应操作
+            // 没有超时，重新尝试对应操作，定时器在下次等待前刷新
             goto retry;
         }
     }
 
+    // 结束等待，取消还未到期的定时器
+    if(timer) {
+        timer->cancel();
+    }
     return n;
 }
 
@@ -206,12 +297,14 @@ unsigned int sleep(unsigned int seconds) {
     if(!focus::t_hook_enable) {
         return sleep_f(seconds);
     }
+    assertNotInline("sleep");
 
     focus::Fiber::ptr fiber = focus::Fiber::GetThis();
     focus::IOManager* iom = focus::IOManager::GetThis();
 
     // 添加定时器，等待调度
-    iom->addTimer(std::bind((void(focus::Scheduler::*)(focus::Fiber::ptr, int thread))&focus::IOManager::schedule, iom, fiber, -1),
+    iom->addTimer(std::bind((void(focus::Scheduler::*)(focus::Fiber::ptr, int thread))&focus::IOManager::schedule, iom, fiber,
+                            iom->isPerThread()? focus::GetThreadId(): -1),
                 seconds * 1000);
 
     // 让出执行权
@@ -225,12 +318,14 @@ int usleep(useconds_t usec) {
     if(!focus::t_hook_enable) {
         return usleep_f(usec);
     }
+    assertNotInline("usleep");
 
     focus::Fiber::ptr fiber = focus::Fiber::GetThis();
     focus::IOManager* iom = focus::IOManager::GetThis();
 
     // 添加定时器，等待调度
-    iom->addTimer(std::bind((void(focus::Scheduler::*)(focus::Fiber::ptr, int thread))&focus::IOManager::schedule, iom, fiber, -1),
+    iom->addTimer(std::bind((void(focus::Scheduler::*)(focus::Fiber::ptr, int thread))&focus::IOManager::schedule, iom, fiber,
+                            iom->isPerThread()? focus::GetThreadId(): -1),
                 usec / 1000);
 
     // 让出执行权
@@ -244,13 +339,15 @@ int nanosleep(const struct timespec* req, struct timespec* rem) {
     if(!focus::t_hook_enable) {
         return nanosleep_f(req, rem);
     }
+    assertNotInline("nanosleep");
 
     int timeoutMs = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
     focus::Fiber::ptr fiber = focus::Fiber::GetThis();
     focus::IOManager* iom = focus::IOManager::GetThis();
 
     // 添加定时器，等待调度
-    iom->addTimer(std::bind((void(focus::Scheduler::*)(focus::Fiber::ptr, int thread))&focus::IOManager::schedule, iom, fiber, -1),
+    iom->addTimer(std::bind((void(focus::Scheduler::*)(focus::Fiber::ptr, int thread))&focus::IOManager::schedule, iom, fiber,
+                            iom->isPerThread()? focus::GetThreadId(): -1),
                 timeoutMs);
 
     // 让出执行权
@@ -276,7 +373,7 @@ int socket(int domain, int type, int protocol) {
 
     // 如果用户设置了非阻塞
     if(type & SOCK_NONBLOCK) {
-        focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(fd);
+        focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(fd);
         if(ctx) {
             ctx->setUserNonblock(true);
         }
@@ -291,8 +388,9 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     if(!focus::t_hook_enable) {
         return connect_f(fd, addr, addrlen);
     }
+    assertNotInline("connect");
     // 获取fd上下文
-    focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(fd);
+    focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(fd);
     // 没有上下文或者已经关闭了
     if(!ctx || ctx->isClose()) {
         errno = EBADF; // 设置错误码
@@ -304,6 +402,24 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return connect_f(fd, addr, addrlen);
     }
 
+    focus::IOManager* iom = focus::IOManager::GetThis();
+    // 后端支持直接提交时，连接和超时一起交给后端
+    if(iom->canSubmitIo()) {
+        focus::IORequest req;
+        req.m_op = focus::IORequest::CONNECT;
+        req.m_fd = fd;
+        req.m_addr = (struct sockaddr*)addr;
+        req.m_addrlen = addrlen;
+        req.m_timeout = timeoutMs;
+        if(0 == iom->submitIo(req)) {
+            if(req.m_result >= 0) {
+                return 0;
+            }
+            errno = req.m_timedout? ETIMEDOUT: -req.m_result;
+            return -1;
+        }
+    }
+
     // 直接调用
     int n = connect_f(fd, addr, addrlen);
     if(0 == n) {
@@ -314,24 +430,20 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return n;
     }
 
-    focus::IOManager* iom = focus::IOManager::GetThis();
     focus::Timer::ptr timer;
-    std::shared_ptr<TimerInfo> tinfo(new TimerInfo);
-    std::weak_ptr<TimerInfo> winfo(tinfo);
+    uint64_t seq = 0;
 
     if((uint64_t)-1 != timeoutMs) {
-        // 添加一个定时器
-        timer = iom->addConditionTimer([winfo, fd, iom](){
-            auto t = winfo.lock();
-            // 定时器不存在，或者已经取消，也就是处理了
-            if(!t || t->cancelled) {
+        // 添加一个定时器，和写操作共用fd上下文中的等待状态
+        seq = ctx->beginWait(SO_SNDTIMEO);
+        timer = iom->addTimer([ctx, fd, iom, seq](){
+            // 已经连接完成，或者不是同一次等待
+            if(!ctx->expireWait(SO_SNDTIMEO, seq)) {
                 return ;
             }
-            // 超时未处理
-            t->cancelled = ETIMEDOUT;
-            // 指定触发
+            // 超时未处理，指定触发
             iom->cancelEvent(fd, focus::IOManager::WRITE);
-        }, timeoutMs, winfo);
+        }, timeoutMs);
     }
 
     // 添加一个写事件
@@ -344,8 +456,8 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
             timer->cancel();
         }
         // 超时原因
-        if(tinfo->cancelled) {
-            errno = tinfo->cancelled;
+        if(timer && ctx->isWaitTimedout(SO_SNDTIMEO, seq)) {
+            errno = ETIMEDOUT;
             return -1;
         }
     }else {
@@ -376,7 +488,7 @@ int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
 }
 
 int accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
-    int fd = doIo(s, accept_f, "accept", focus::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    int fd = doIo(s, accept_f, "accept", focus::IOManager::READ, SO_RCVTIMEO, focus::IORequest::ACCEPT, addr, addrlen);
     if(fd >= 0) {
         focus::FdMgr::GetInstance()->get(fd, true);
     }
@@ -384,43 +496,43 @@ int accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
 }
 
 ssize_t read(int fd, void* buf, size_t count) {
-    return doIo(fd, read_f, "read", focus::IOManager::READ, SO_RCVTIMEO, buf, count);
+    return doIo(fd, read_f, "read", focus::IOManager::READ, SO_RCVTIMEO, focus::IORequest::RECV, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
-    return doIo(fd, readv_f, "readv", focus::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+    return doIo(fd, readv_f, "readv", focus::IOManager::READ, SO_RCVTIMEO, focus::IORequest::RECVMSG, iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
-    return doIo(sockfd, recv_f, "recv", focus::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+    return doIo(sockfd, recv_f, "recv", focus::IOManager::READ, SO_RCVTIMEO, focus::IORequest::RECV, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr* srcaddr, socklen_t* addrlen) {
-    return doIo(sockfd, recvfrom_f, "recvfrom", focus::IOManager::READ, SO_RCVTIMEO, buf, len, flags, srcaddr, addrlen);
+    return doIo(sockfd, recvfrom_f, "recvfrom", focus::IOManager::READ, SO_RCVTIMEO, focus::IORequest::NONE, buf, len, flags, srcaddr, addrlen);
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
-    return doIo(sockfd, recvmsg_f, "recvmsg", focus::IOManager::READ, SO_RCVTIMEO, msg, flags);
+    return doIo(sockfd, recvmsg_f, "recvmsg", focus::IOManager::READ, SO_RCVTIMEO, focus::IORequest::RECVMSG, msg, flags);
 }
 
 ssize_t write(int fd, const void* buf, size_t count) {
-    return doIo(fd, write_f, "write", focus::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+    return doIo(fd, write_f, "write", focus::IOManager::WRITE, SO_SNDTIMEO, focus::IORequest::SEND, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
-    return doIo(fd, writev_f, "writev", focus::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+    return doIo(fd, writev_f, "writev", focus::IOManager::WRITE, SO_SNDTIMEO, focus::IORequest::SENDMSG, iov, iovcnt);
 }
 
 ssize_t send(int s, const void* msg, size_t len, int flags) {
-    return doIo(s, send_f, "send", focus::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+    return doIo(s, send_f, "send", focus::IOManager::WRITE, SO_SNDTIMEO, focus::IORequest::SEND, msg, len, flags);
 }
 
 ssize_t sendto(int s, const void* msg, size_t len, int flags, const struct sockaddr* to, socklen_t tolen) {
-    return doIo(s, sendto_f, "sendto", focus::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+    return doIo(s, sendto_f, "sendto", focus::IOManager::WRITE, SO_SNDTIMEO, focus::IORequest::NONE, msg, len, flags, to, tolen);
 }
 
 ssize_t sendmsg(int s, const struct msghdr* msg, int flags) {
-    return doIo(s, sendmsg_f, "sendmsg", focus::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+    return doIo(s, sendmsg_f, "sendmsg", focus::IOManager::WRITE, SO_SNDTIMEO, focus::IORequest::SENDMSG, msg, flags);
 }
 
 int close(int fd) {
@@ -430,7 +542,7 @@ int close(int fd) {
     }
 
     // 获取句柄上下文
-    focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(fd);
+    focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(fd);
     // 处理句柄上下文
     if(ctx) {   
         auto iom = focus::IOManager::GetThis();
@@ -454,7 +566,7 @@ int fcntl(int fd, int cmd, ...) {
         case F_SETFL: {
             int arg = va_arg(va, int);
             va_end(va);
-            focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(fd);
+            focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(fd);
             // 无效或者关闭或者不是套接字
             if(!ctx || ctx->isClose() || !ctx->isSocket()) {
                 return fcntl_f(fd, cmd, arg);
@@ -475,7 +587,7 @@ int fcntl(int fd, int cmd, ...) {
             va_end(va);
             // 获取原先状态
             int arg = fcntl_f(fd, cmd);
-            focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(fd);
+            focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(fd);
             // 无效或者关闭或者不是套接字
             if(!ctx || ctx->isClose() || !ctx->isSocket()) {
                 return arg;
@@ -556,7 +668,7 @@ int ioctl(int d, unsigned long int request, ...) {
     if(request == FIONBIO) {
         // 调用ioctl是为了设置阻塞或者非阻塞
         bool userNonblock = !!*(int*)arg;
-        focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(d);
+        focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(d);
         // 上下文无效，关闭，不是套接字
         if(!ctx || ctx->isClose() || !ctx->isSocket()) {
             return ioctl_f(d, request, arg);
@@ -581,7 +693,7 @@ int setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t
     // 如果level是 SOL_SOCKET ，并且是这是读超时或者写超时
     if(SOL_SOCKET == level) {
         if(SO_RCVTIMEO == optname || SO_SNDTIMEO == optname) {
-            focus::FdCtx::ptr ctx = focus::FdMgr::GetInstance()->get(sockfd);
+            focus::FdCtx* ctx = focus::FdMgr::GetInstance()->get(sockfd);
             if(ctx) {
                 const timeval* v = (const timeval*)optval;
                 // 设置超时时间
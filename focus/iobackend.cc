@@ -0,0 +1,528 @@
+#include "iobackend.h"
+#include "macro.h"
+#include "mutex.h"
+#include "config.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+
+namespace focus {
+
+// 全局日志器
+static Logger::ptr g_logger = FOCUS_LOG_NAME("system");
+
+// epoll事件与IOBackend事件一致
+static_assert(EPOLLIN == POLLIN && EPOLLOUT == POLLOUT, "epoll and poll events mismatch");
+
+// 重载注册操作输出
+static std::ostream& operator<<(std::ostream& os, IOBackend::CtlOp op) {
+    switch(op) {
+#define XX(ctl)                 \
+    case IOBackend::ctl:        \
+        return os << #ctl;
+        XX(ADD);
+        XX(MOD);
+        XX(DEL);
+#undef XX
+        default:
+            return os << (int)op;
+    }
+}
+
+/**
+ * @brief epoll后端，使用边缘触发，eventfd用于唤醒
+ */
+class EpollBackend: public IOBackend {
+public:
+    EpollBackend() {
+        // 创建epoll句柄
+        m_epfd = epoll_create(1);
+        // 判断epoll句柄
+        FOCUS_ASSERT(m_epfd > 0);
+
+        // 创建eventfd，多次唤醒合并为一个计数，一次read即可清空
+        m_tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        // 判断是否成功
+        FOCUS_ASSERT(m_tickleFd >= 0);
+
+        // 关注eventfd的可读事件，用于通知协程
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = nullptr;
+
+        // 使用epoll关注eventfd的可读事件
+        int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd, &event);
+        // 判断是否添加成功
+        FOCUS_ASSERT(!rt);
+    }
+
+    ~EpollBackend() {
+        // 关闭相关句柄
+        close(m_epfd);
+        close(m_tickleFd);
+    }
+
+    const char* getName() const override {
+        return "epoll";
+    }
+
+    bool ctl(CtlOp op, int fd, uint32_t events, void* data) override {
+        static const int s_ops[] = {EPOLL_CTL_ADD, EPOLL_CTL_MOD, EPOLL_CTL_DEL};
+        epoll_event epevent;
+        epevent.events = EPOLLET | events;
+        epevent.data.ptr = data;
+        int rt = epoll_ctl(m_epfd, s_ops[op], fd, &epevent);
+        if(rt) {
+            FOCUS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+                                      << op << ", " << fd << ", " << epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;
+        }
+        return true;
+    }
+
+    int wait(IOReady* ready, int maxReady, int timeoutMs, std::vector<IORequest*>& done) override {
+        static thread_local std::vector<epoll_event> s_events;
+        if((int)s_events.size() < maxReady) {
+            s_events.resize(maxReady);
+        }
+
+        int rt = 0;
+        do {
+            rt = epoll_wait(m_epfd, &s_events[0], maxReady, timeoutMs);
+            // 为了确保中断信号不会导致程序退出或停止等待
+        }while(rt < 0 && errno == EINTR);
+
+        int count = 0;
+        for(int i = 0; i < rt; ++i) {
+            epoll_event& event = s_events[i];
+            if(!event.data.ptr) {
+                // eventfd 用于通知协程
+                uint64_t dummy;
+                while(read(m_tickleFd, &dummy, sizeof(dummy)) < 0 && EINTR == errno);
+                continue;
+            }
+            ready[count].m_data = event.data.ptr;
+            ready[count].m_events = event.events;
+            ++count;
+        }
+        return count;
+    }
+
+    void tickle() override {
+        uint64_t one = 1;
+        int rt = write(m_tickleFd, &one, sizeof(one));
+        FOCUS_ASSERT(sizeof(one) == rt);
+    }
+
+private:
+    int m_epfd = 0; // epoll文件描述符
+    int m_tickleFd = -1; // eventfd文件描述符
+};
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+
+// io_uring配置
+static ConfigVar<uint32_t>::ptr g_iomanager_uring_entries =
+    Config::LookUp<uint32_t>("iomanager.uring_entries", 1024, "io_uring submission queue entries");
+
+/**
+ * @brief io_uring后端
+ * @details 就绪事件使用一次性的POLL_ADD实现，IO请求直接提交，
+ *          超时使用LINK_TIMEOUT，唤醒使用NOP
+ */
+class IoUringBackend: public IOBackend {
+public:
+    using MutexType = Mutex;
+
+    /**
+     * @brief user_data的低两位表示完成事件的类型
+     */
+    enum Tag {
+        TAG_POLL = 0, // 就绪事件，0表示内部请求
+        TAG_REQUEST = 1, // IO请求
+        TAG_TIMEOUT = 2, // IO请求的超时
+        TAG_MASK = 3
+    };
+
+    IoUringBackend(uint32_t entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_ringFd = syscall(__NR_io_uring_setup, entries, &params);
+        if(m_ringFd < 0) {
+            FOCUS_LOG_ERROR(g_logger) << "io_uring_setup(" << entries << ") errno = " << errno
+                                      << " errstr = " << strerror(errno);
+            return ;
+        }
+        // 需要单次mmap和带超时的等待
+        if(!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+            FOCUS_LOG_ERROR(g_logger) << "io_uring features not supported features = " << params.features;
+            close(m_ringFd);
+            m_ringFd = -1;
+            return ;
+        }
+
+        // 映射提交队列和完成队列
+        m_ringSize = std::max(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                              params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+        m_ring = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_ringFd, IORING_OFF_SQ_RING);
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        m_sqes = (struct io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+        if(MAP_FAILED == m_ring || MAP_FAILED == m_sqes) {
+            FOCUS_LOG_ERROR(g_logger) << "io_uring mmap errno = " << errno
+                                      << " errstr = " << strerror(errno);
+            if(MAP_FAILED != m_ring) {
+                munmap(m_ring, m_ringSize);
+            }
+            if(MAP_FAILED != m_sqes) {
+                munmap(m_sqes, m_sqesSize);
+            }
+            m_ring = nullptr;
+            m_sqes = nullptr;
+            close(m_ringFd);
+            m_ringFd = -1;
+            return ;
+        }
+
+        char* ring = (char*)m_ring;
+        m_sqHead = (unsigned*)(ring + params.sq_off.head);
+        m_sqTail = (unsigned*)(ring + params.sq_off.tail);
+        m_sqMask = *(unsigned*)(ring + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        m_sqArray = (unsigned*)(ring + params.sq_off.array);
+        m_cqHead = (unsigned*)(ring + params.cq_off.head);
+        m_cqTail = (unsigned*)(ring + params.cq_off.tail);
+        m_cqMask = *(unsigned*)(ring + params.cq_off.ring_mask);
+        m_cqes = (struct io_uring_cqe*)(ring + params.cq_off.cqes);
+        m_localTail = *m_sqTail;
+
+        // 关闭fd时按fd取消提交的请求，5.19之前不支持，使用epoll
+        if(!probeCancelFd()) {
+            FOCUS_LOG_ERROR(g_logger) << "io_uring cancel by fd not supported";
+            munmap(m_sqes, m_sqesSize);
+            munmap(m_ring, m_ringSize);
+            m_ring = nullptr;
+            m_sqes = nullptr;
+            close(m_ringFd);
+            m_ringFd = -1;
+        }
+    }
+
+    ~IoUringBackend() {
+        if(m_sqes) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if(m_ring) {
+            munmap(m_ring, m_ringSize);
+        }
+        if(m_ringFd >= 0) {
+            close(m_ringFd);
+        }
+    }
+
+    /**
+     * @brief 是否创建成功
+     */
+    bool isValid() const {
+        return m_ringFd >= 0;
+    }
+
+    const char* getName() const override {
+        return "io_uring";
+    }
+
+    bool ctl(CtlOp op, int fd, uint32_t events, void* data) override {
+        MutexType::Lock lock(m_sqMutex);
+        reserve(2);
+        if(ADD != op) {
+            // 删除之前的poll，已经触发过的会返回ENOENT，忽略
+            struct io_uring_sqe* sqe = getSqe();
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = (uint64_t)data;
+            sqe->user_data = 0;
+        }
+        if(DEL != op) {
+            struct io_uring_sqe* sqe = getSqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = events;
+            sqe->user_data = (uint64_t)data;
+        }
+        if(submit() < 0) {
+            FOCUS_LOG_ERROR(g_logger) << "io_uring ctl(" << op << ", " << fd << ", " << events << ")"
+                                      << " errno = " << errno << " errstr = " << strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    int wait(IOReady* ready, int maxReady, int timeoutMs, std::vector<IORequest*>& done) override {
+        bool reaped = false;
+        {
+            MutexType::Lock lock(m_cqMutex);
+            int count = reap(ready, maxReady, done, reaped);
+            if(reaped) {
+                return count;
+            }
+        }
+
+        // 没有完成事件，等待至少一个，不持有锁，其他空闲线程可以同时在ring上等待
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000ll;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)&ts;
+        int rt = syscall(__NR_io_uring_enter, m_ringFd, 0, 1,
+                         IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if(rt < 0 && ETIME != errno && EINTR != errno) {
+            FOCUS_LOG_ERROR(g_logger) << "io_uring_enter wait errno = " << errno
+                                      << " errstr = " << strerror(errno);
+        }
+        // 只在收割完成队列时加锁
+        MutexType::Lock lock(m_cqMutex);
+        return reap(ready, maxReady, done, reaped);
+    }
+
+    void tickle() override {
+        MutexType::Lock lock(m_sqMutex);
+        reserve(1);
+        struct io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_NOP;
+        sqe->fd = -1;
+        sqe->user_data = 0;
+        submit();
+    }
+
+    bool canSubmit() const override {
+        return true;
+    }
+
+    bool submit(IORequest* req) override {
+        MutexType::Lock lock(m_sqMutex);
+        // 请求和超时必须在同一次提交中
+        reserve(2);
+        struct io_uring_sqe* sqe = getSqe();
+        sqe->fd = req->m_fd;
+        switch(req->m_op) {
+            case IORequest::RECV:
+            case IORequest::SEND:
+                sqe->opcode = IORequest::RECV == req->m_op? IORING_OP_RECV: IORING_OP_SEND;
+                sqe->addr = (uint64_t)req->m_buf;
+                sqe->len = req->m_len;
+                sqe->msg_flags = req->m_flags;
+                break;
+            case IORequest::RECVMSG:
+            case IORequest::SENDMSG:
+                sqe->opcode = IORequest::RECVMSG == req->m_op? IORING_OP_RECVMSG: IORING_OP_SENDMSG;
+                sqe->addr = (uint64_t)(req->m_msgPtr? req->m_msgPtr: &req->m_msg);
+                sqe->len = 1;
+                sqe->msg_flags = req->m_flags;
+                break;
+            case IORequest::ACCEPT:
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->addr = (uint64_t)req->m_addr;
+                sqe->addr2 = (uint64_t)req->m_addrlenPtr;
+                break;
+            case IORequest::CONNECT:
+                sqe->opcode = IORING_OP_CONNECT;
+                sqe->addr = (uint64_t)req->m_addr;
+                sqe->off = req->m_addrlen;
+                break;
+            default:
+                // 放弃这个sqe
+                --m_localTail;
+                return false;
+        }
+        sqe->user_data = (uint64_t)req | TAG_REQUEST;
+        req->m_pending = 1;
+        req->m_timedout = false;
+
+        // 超时
+        if((uint64_t)-1 != req->m_timeout) {
+            sqe->flags |= IOSQE_IO_LINK;
+            req->m_ts.tv_sec = req->m_timeout / 1000;
+            req->m_ts.tv_nsec = (req->m_timeout % 1000) * 1000000ll;
+            struct io_uring_sqe* tsqe = getSqe();
+            tsqe->opcode = IORING_OP_LINK_TIMEOUT;
+            tsqe->fd = -1;
+            tsqe->addr = (uint64_t)&req->m_ts;
+            tsqe->len = 1;
+            tsqe->user_data = (uint64_t)req | TAG_TIMEOUT;
+            ++req->m_pending;
+        }
+
+        if(submit() < 0) {
+            FOCUS_LOG_ERROR(g_logger) << "io_uring submit op = " << req->m_op << " fd = " << req->m_fd
+                                      << " errno = " << errno << " errstr = " << strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    void cancel(int fd) override {
+        MutexType::Lock lock(m_sqMutex);
+        reserve(1);
+        struct io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = 0;
+        submit();
+    }
+
+private:
+    /**
+     * @brief 检查是否支持按fd取消，构造时调用
+     * @details 在没有请求的fd上取消，不支持的内核返回EINVAL，支持的返回ENOENT
+     */
+    bool probeCancelFd() {
+        struct io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = m_ringFd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = 0;
+        __atomic_store_n(m_sqTail, m_localTail, __ATOMIC_RELEASE);
+        int rt = 0;
+        do {
+            rt = syscall(__NR_io_uring_enter, m_ringFd, 1, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        }while(rt < 0 && EINTR == errno);
+        unsigned head = *m_cqHead;
+        if(rt < 0 || head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        int res = m_cqes[head & m_cqMask].res;
+        __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+        return -EINVAL != res;
+    }
+
+    /**
+     * @brief 确保提交队列至少有n个空位，持有m_sqMutex时调用
+     */
+    void reserve(unsigned n) {
+        unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if(m_localTail - head + n > m_sqEntries) {
+            submit();
+        }
+    }
+
+    /**
+     * @brief 获取一个清零的sqe，持有m_sqMutex时调用
+     */
+    struct io_uring_sqe* getSqe() {
+        unsigned index = m_localTail & m_sqMask;
+        struct io_uring_sqe* sqe = &m_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        ++m_localTail;
+        return sqe;
+    }
+
+    /**
+     * @brief 提交所有的sqe，持有m_sqMutex时调用
+     */
+    int submit() {
+        __atomic_store_n(m_sqTail, m_localTail, __ATOMIC_RELEASE);
+        // 包括之前没有被内核消费的sqe
+        unsigned toSubmit = m_localTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if(!toSubmit) {
+            return 0;
+        }
+        int rt = 0;
+        do {
+            rt = syscall(__NR_io_uring_enter, m_ringFd, toSubmit, 0, 0, nullptr, 0);
+        }while(rt < 0 && EINTR == errno);
+        return rt;
+    }
+
+    /**
+     * @brief 收割完成事件，持有m_cqMutex时调用
+     * @param[out] reaped 是否收割到了完成事件
+     */
+    int reap(IOReady* ready, int maxReady, std::vector<IORequest*>& done, bool& reaped) {
+        int count = 0;
+        unsigned head = *m_cqHead;
+        unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        while(head != tail && count < maxReady) {
+            struct io_uring_cqe* cqe = &m_cqes[head & m_cqMask];
+            ++head;
+            reaped = true;
+            uint64_t tag = cqe->user_data & TAG_MASK;
+            void* ptr = (void*)(cqe->user_data & ~(uint64_t)TAG_MASK);
+            if(!ptr) {
+                // 内部请求
+                continue;
+            }
+            if(TAG_POLL == tag) {
+                // 被删除的poll
+                if(cqe->res < 0) {
+                    continue;
+                }
+                ready[count].m_data = ptr;
+                ready[count].m_events = cqe->res;
+                ++count;
+                continue;
+            }
+            IORequest* req = (IORequest*)ptr;
+            if(TAG_REQUEST == tag) {
+                req->m_result = cqe->res;
+            }else if(-ETIME == cqe->res) {
+                req->m_timedout = true;
+            }
+            // 请求和超时都完成了
+            if(0 == --req->m_pending) {
+                done.emplace_back(req);
+            }
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    int m_ringFd = -1; // io_uring文件描述符
+    void* m_ring = nullptr; // 提交队列和完成队列的映射
+    size_t m_ringSize = 0; // 队列映射大小
+    struct io_uring_sqe* m_sqes = nullptr; // sqe数组
+    size_t m_sqesSize = 0; // sqe数组大小
+    unsigned* m_sqHead = nullptr; // 提交队列头
+    unsigned* m_sqTail = nullptr; // 提交队列尾
+    unsigned* m_sqArray = nullptr; // 提交队列
+    unsigned m_sqMask = 0; // 提交队列掩码
+    unsigned m_sqEntries = 0; // 提交队列大小
+    unsigned m_localTail = 0; // 还未提交的队列尾
+    unsigned* m_cqHead = nullptr; // 完成队列头
+    unsigned* m_cqTail = nullptr; // 完成队列尾
+    unsigned m_cqMask = 0; // 完成队列掩码
+    struct io_uring_cqe* m_cqes = nullptr; // 完成队列
+    MutexType m_sqMutex; // 提交队列的锁
+    MutexType m_cqMutex; // 完成队列的锁
+};
+
+#endif
+
+IOBackend::ptr IOBackend::Create(const std::string& name) {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+    if("io_uring" == name) {
+        std::shared_ptr<IoUringBackend> backend(new IoUringBackend(g_iomanager_uring_entries->getVal()));
+        if(backend->isValid()) {
+            return backend;
+        }
+        FOCUS_LOG_ERROR(g_logger) << "io_uring backend not available, fallback to epoll";
+    }
+#endif
+    if("epoll" != name && "io_uring" != name) {
+        FOCUS_LOG_ERROR(g_logger) << "unknown iomanager backend " << name << ", fallback to epoll";
+    }
+    return IOBackend::ptr(new EpollBackend);
+}
+
+} // end namespace focus
@@ -0,0 +1,141 @@
+#ifndef __FOCUS_IOBACKEND_H__
+#define __FOCUS_IOBACKEND_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/time_types.h>
+#include "scheduler.h"
+
+namespace focus {
+
+/**
+ * @brief 就绪事件
+ */
+struct IOReady {
+    void* m_data = nullptr; // 注册时传入的数据
+    uint32_t m_events = 0; // 就绪的事件(EPOLLIN/EPOLLOUT/EPOLLERR/EPOLLHUP)
+};
+
+/**
+ * @brief 直接提交给后端的IO请求，完成后恢复提交的协程
+ */
+struct IORequest {
+    /**
+     * @brief IO操作类型
+     */
+    enum Op {
+        NONE = 0, // 不支持直接提交
+        RECV, // read/recv
+        SEND, // write/send
+        RECVMSG, // readv/recvmsg
+        SENDMSG, // writev/sendmsg
+        ACCEPT, // accept
+        CONNECT // connect
+    };
+
+    Op m_op = NONE; // 操作类型
+    int m_fd = -1; // 句柄
+    void* m_buf = nullptr; // 缓冲区
+    size_t m_len = 0; // 缓冲区长度
+    int m_flags = 0; // send/recv的flags
+    struct msghdr m_msg = {}; // readv/writev使用的消息
+    struct msghdr* m_msgPtr = nullptr; // recvmsg/sendmsg使用的消息
+    struct sockaddr* m_addr = nullptr; // accept/connect的地址
+    socklen_t* m_addrlenPtr = nullptr; // accept的地址长度
+    socklen_t m_addrlen = 0; // connect的地址长度
+    uint64_t m_timeout = (uint64_t)-1; // 超时时间毫秒，-1不超时
+
+    int64_t m_result = 0; // 结果，失败为-errno
+    bool m_timedout = false; // 是否超时
+    int m_pending = 0; // 还未收到的完成事件数
+    struct __kernel_timespec m_ts = {}; // 超时时间
+    Scheduler* m_scheduler = nullptr; // 提交时的调度器
+    Fiber::ptr m_fiber; // 提交时的协程
+};
+
+/**
+ * @brief IO事件后端
+ * @details epoll使用边缘触发，io_uring的就绪事件是一次性的；
+ *          调用者在事件触发后都要用剩余的事件重新注册(MOD/DEL)，两种后端的行为一致
+ */
+class IOBackend {
+public:
+    using ptr = std::shared_ptr<IOBackend>;
+
+    /**
+     * @brief 注册操作
+     */
+    enum CtlOp {
+        ADD = 0, // 添加
+        MOD, // 修改
+        DEL // 删除
+    };
+
+    /**
+     * @brief 创建后端
+     * @param[in] name 后端名称(epoll, io_uring)，不支持时回退到epoll
+     */
+    static IOBackend::ptr Create(const std::string& name);
+
+    /**
+     * @brief 析构函数
+     */
+    virtual ~IOBackend() {}
+
+    /**
+     * @brief 获取后端名称
+     */
+    virtual const char* getName() const = 0;
+
+    /**
+     * @brief 修改fd关心的事件
+     * @param[in] op 操作
+     * @param[in] fd 文件描述符
+     * @param[in] events 关心的事件(EPOLLIN/EPOLLOUT)
+     * @param[in] data 就绪时返回的数据
+     */
+    virtual bool ctl(CtlOp op, int fd, uint32_t events, void* data) = 0;
+
+    /**
+     * @brief 等待事件
+     * @param[out] ready 就绪事件
+     * @param[in] maxReady 就绪事件的最大数量
+     * @param[in] timeoutMs 超时时间毫秒
+     * @param[out] done 完成的IO请求
+     * @return 就绪事件的数量
+     */
+    virtual int wait(IOReady* ready, int maxReady, int timeoutMs, std::vector<IORequest*>& done) = 0;
+
+    /**
+     * @brief 唤醒等待的线程
+     */
+    virtual void tickle() = 0;
+
+    /**
+     * @brief 是否支持直接提交IO请求
+     */
+    virtual bool canSubmit() const {
+        return false;
+    }
+
+    /**
+     * @brief 提交IO请求，完成后从wait返回
+     */
+    virtual bool submit(IORequest* req) {
+        return false;
+    }
+
+    /**
+     * @brief 取消fd上所有提交的IO请求
+     */
+    virtual void cancel(int fd) {
+    }
+};
+
+} // end namespace focus
+
+#endif
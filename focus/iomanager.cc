@@ -1,5 +1,6 @@
 #include "iomanager.h"
 #include "macro.h"
+#include "config.h"
 #include <sys/epoll.h>
 #include <fcntl.h>
 
@@ -8,23 +9,21 @@ namespace focus {
 // 全局日志器
 static Logger::ptr g_logger = FOCUS_LOG_NAME("system");
 
-enum EPOLL_CTL_OP_TYPE {
-};
-
-// 重载epoll操作输出
-static std::ostream& operator<<(std::ostream& os, const EPOLL_CTL_OP_TYPE& op) {
-    switch((int)op) {
-#define XX(ctl)         \
-    case ctl:           \
-        return os << #ctl;
-        XX(EPOLL_CTL_ADD);
-        XX(EPOLL_CTL_MOD);
-        XX(EPOLL_CTL_DEL);
-#undef XX
-        default:
-            return os << (int)op;
-    }
-}
+// IO事件后端(epoll, io_uring)
+static ConfigVar<std::string>::ptr g_iomanager_backend =
+    Config::LookUp<std::string>("iomanager.backend", "epoll", "iomanager event backend");
+
+// 定时器的组织方式(set, wheel)
+static ConfigVar<std::string>::ptr g_iomanager_timer =
+    Config::LookUp<std::string>("iomanager.timer", "set", "iomanager timer type");
+
+// 每次等待的就绪事件数量，全部用满时翻倍，最多扩大到16倍
+static ConfigVar<uint32_t>::ptr g_iomanager_max_events =
+    Config::LookUp<uint32_t>("iomanager.max_events", 256, "iomanager ready events per wait");
+
+// 每个调度线程是否有自己的事件后端和定时器
+static ConfigVar<bool>::ptr g_iomanager_per_thread =
+    Config::LookUp<bool>("iomanager.per_thread", false, "iomanager per-thread backend and timers");
 
 // 重载epoll事件类型输出
 static std::ostream& operator<<(std::ostream& os, EPOLL_EVENTS events) {
@@ -75,52 +74,49 @@ void IOManager::FdContext::resetEventContext(EventContext& ctx) {
     ctx.m_cb = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(Event event) {
+void IOManager::FdContext::triggerEvent(Event event, int thread, TaskBatch* batch) {
     // 必须注册过
     FOCUS_ASSERT(m_events & event);
     // 清除事件，只会触发一次
     m_events = (Event)(m_events & ~event);
     // 调度协程
     EventContext& ctx = getEventContext(event);
-    if(ctx.m_cb) {
-        ctx.m_scheduler->schedule(ctx.m_cb);
+    // 只有当前调度器的线程可以绑定
+    if(ctx.m_scheduler != Scheduler::GetThis()) {
+        thread = -1;
+        batch = nullptr;
+    }
+    if(batch) {
+        if(ctx.m_cb) {
+            batch->m_cbs.emplace_back(std::move(ctx.m_cb));
+        }else {
+            batch->m_fibers.emplace_back(std::move(ctx.m_fiber));
+        }
+    }else if(ctx.m_cb) {
+        ctx.m_scheduler->schedule(ctx.m_cb, thread);
     }else {
-        ctx.m_scheduler->schedule(ctx.m_fiber);
+        ctx.m_scheduler->schedule(ctx.m_fiber, thread);
     }
     resetEventContext(ctx);
     return ;
 }
 
 IOManager::IOManager(size_t threads, bool useCaller, const std::string& name):
-    Scheduler(threads, useCaller, name) {
-    // 创建epoll句柄
-    m_epfd = epoll_create(1);
-    // 判断epoll句柄
-    FOCUS_ASSERT(m_epfd > 0);
-
-    // 创建管道
-    int rt = pipe(m_tickleFd);
-    // 判断是否成功
-    FOCUS_ASSERT(!rt);
-
-    // 关注管道读句柄的可读事件，用于通知协程
-    epoll_event event;
-    memset(&event, 0, sizeof(epoll_event));
-    event.events = EPOLLIN | EPOLLET;
-    event.data.fd = m_tickleFd[0];
-
-    // 非阻塞
-    rt = fcntl(m_tickleFd[0], F_SETFL, O_NONBLOCK);
-    // 判断是否设置成功
-    FOCUS_ASSERT(!rt);
-
-    // 使用epoll关注管道读句柄的可读事件
-    rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd[0], &event);
-    // 判断是否添加成功
-    FOCUS_ASSERT(!rt);
-
-    // 设置fd上下文集合
-    resizeContext(32);
+    Scheduler(threads, useCaller, name),
+    TimerManager(TimerManager::TimerTypeFromString(g_iomanager_timer->getVal())),
+    m_fdContexts(GetFdLimit()) {
+    // 创建事件后端
+    m_backend = IOBackend::Create(g_iomanager_backend->getVal());
+    FOCUS_LOG_DEBUG(g_logger) << "IOManager backend = " << m_backend->getName();
+
+    // 每个调度线程一个事件后端和定时器，第一个线程复用已创建的后端
+    if(g_iomanager_per_thread->getVal()) {
+        for(size_t i = 0; i < getWorkerCount(); ++i) {
+            IOWorker* worker = new IOWorker(this, getTimerType());
+            worker->m_backend = i? IOBackend::Create(g_iomanager_backend->getVal()): m_backend;
+            m_ioWorkers.emplace_back(worker);
+        }
+    }
 
     // 启动调度器
     start();
@@ -129,34 +125,20 @@ IOManager::IOManager(size_t threads, bool useCaller, const std::string& name):
 IOManager::~IOManager() {
     // 停止调度器
     stop();
-    // 关闭相关句柄
-    close(m_epfd);
-    close(m_tickleFd[0]);
-    close(m_tickleFd[1]);
-
-    // 释放内存
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(m_fdContexts[i]) {
-            delete m_fdContexts[i];
-            m_fdContexts[i] = nullptr;
-        }
+    // 关闭后端
+    for(auto worker: m_ioWorkers) {
+        delete worker;
     }
+    m_ioWorkers.clear();
+    m_backend.reset();
 }
 
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     // 找到fd对应的fdContext
-    FdContext* fdCtx = nullptr;
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() > fd) {
-        // 足够
-        fdCtx = m_fdContexts[fd];
-        lock.unlock();
-    }else {
-        lock.unlock();
-        // 扩容
-        RWMutexType::WriteLock lock2(m_mutex);
-        resizeContext(fd * 1.5);
-        fdCtx = m_fdContexts[fd];
+    FdContext* fdCtx = getFdContext(fd, true);
+    if(FOCUS_UNLIKELY(!fdCtx)) {
+        FOCUS_LOG_ERROR(g_logger) << "addEvent invalid fd = " << fd;
+        return -1;
     }
 
     // 同一个fd不可以重复添加相同的事件
@@ -168,19 +150,17 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
         FOCUS_ASSERT(!(fdCtx->m_events & event));
     }
 
-    // 构造epoll_event
-    int op = fdCtx->m_events? EPOLL_CTL_MOD: EPOLL_CTL_ADD;
-    epoll_event epevent;
-    epevent.events = EPOLLET | fdCtx->m_events | event;
-    epevent.data.ptr = fdCtx;
+    // 没有注册过事件的fd归属于当前线程，不是调度线程时轮流分配
+    if(!m_ioWorkers.empty() && !fdCtx->m_events) {
+        int index = getLocalWorkerIndex();
+        fdCtx->m_owner = index >= 0? index: m_nextOwner++ % m_ioWorkers.size();
+    }
 
     // 添加新的事件
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        FOCUS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd <<", "
-                                  << (EPOLL_CTL_OP_TYPE)op <<", " << fd <<", " << (EPOLL_EVENTS)epevent.events <<"):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ") fdCtx->events = "
-                                  << (EPOLL_EVENTS)fdCtx->m_events;
+    IOBackend::CtlOp op = fdCtx->m_events? IOBackend::MOD: IOBackend::ADD;
+    if(!getBackend(fdCtx)->ctl(op, fd, fdCtx->m_events | event, fdCtx)) {
+        FOCUS_LOG_ERROR(g_logger) << "addEvent fd = " << fd << " event = " << (EPOLL_EVENTS)event
+                                  << " fdCtx->events = " << (EPOLL_EVENTS)fdCtx->m_events;
         return -1;
     }
 
@@ -207,12 +187,10 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
 
 bool IOManager::delEvent(int fd, Event event) {
     // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fdCtx = getFdContext(fd, false);
+    if(!fdCtx) {
         return false;
     }
-    FdContext* fdCtx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fdCtx->m_mutex);
     if(FOCUS_UNLIKELY(!(fdCtx->m_events & event))) {
@@ -221,17 +199,8 @@ bool IOManager::delEvent(int fd, Event event) {
 
     // 清除指定的事件
     Event newEvents = (Event)(fdCtx->m_events & ~event);
-    int op = newEvents? EPOLL_CTL_MOD: EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = EPOLLET | newEvents;
-    epevent.data.ptr = fdCtx;
-
-    // 操作epoll
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        FOCUS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EPOLL_CTL_OP_TYPE)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events <<"): "
-                                  << rt << "(" << errno << ") (" << strerror(errno) << ")";
+    IOBackend::CtlOp op = newEvents? IOBackend::MOD: IOBackend::DEL;
+    if(!getBackend(fdCtx)->ctl(op, fd, newEvents, fdCtx)) {
         return false;   
     }
 
@@ -247,31 +216,20 @@ bool IOManager::delEvent(int fd, Event event) {
 
 bool IOManager::cancelEvent(int fd, Event event) {
     // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fdCtx = getFdContext(fd, false);
+    if(!fdCtx) {
         return false;
     }
-    FdContext* fdCtx = m_fdContexts[fd];
-    lock.unlock();
 
     FdContext::MutexType::Lock lock2(fdCtx->m_mutex);
     if(FOCUS_UNLIKELY(!(fdCtx->m_events & event))) {
         return false;
     }
 
-    // 构造epool_event
-    Event newEvents = (Event)(fdCtx->m_events & ~event);
-    int op = newEvents? EPOLL_CTL_MOD: EPOLL_CTL_ADD;
-    epoll_event epevent;
-    epevent.events = EPOLLET | newEvents;
-    epevent.data.ptr = fdCtx;
-
     // 删除事件
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        FOCUS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EPOLL_CTL_OP_TYPE)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
+    Event newEvents = (Event)(fdCtx->m_events & ~event);
+    IOBackend::CtlOp op = newEvents? IOBackend::MOD: IOBackend::DEL;
+    if(!getBackend(fdCtx)->ctl(op, fd, newEvents, fdCtx)) {
         return false;
     }
 
@@ -284,30 +242,30 @@ bool IOManager::cancelEvent(int fd, Event event) {
 
 bool IOManager::cancelAll(int fd) {
     // 找到fd对应的FdContext
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fdCtx = getFdContext(fd, false);
+    if(!fdCtx) {
         return false;
     }
-    FdContext* fdCtx = m_fdContexts[fd];
-    lock.unlock();
+
+    // 取消直接提交的IO请求
+    if(fdCtx->m_submitted > 0) {
+        if(m_ioWorkers.empty()) {
+            m_backend->cancel(fd);
+        }else {
+            // 请求提交在提交线程的后端上
+            for(auto worker: m_ioWorkers) {
+                worker->m_backend->cancel(fd);
+            }
+        }
+    }
 
     FdContext::MutexType::Lock lock2(fdCtx->m_mutex);
     if(!fdCtx->m_events) {
         return false;
     }
 
-    // 构造epoll_event
-    int op = EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = 0;
-    epevent.data.ptr = fdCtx;
-
     //删除全部事件
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        FOCUS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EPOLL_CTL_OP_TYPE)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-                                  << rt << " (" << errno << ") (" << strerror(errno) << ")";
+    if(!getBackend(fdCtx)->ctl(IOBackend::DEL, fd, 0, fdCtx)) {
         return false;
     }
 
@@ -328,6 +286,31 @@ bool IOManager::cancelAll(int fd) {
     return true;
 }
 
+int IOManager::submitIo(IORequest& req) {
+    FdContext* fdCtx = getFdContext(req.m_fd, true);
+    if(FOCUS_UNLIKELY(!fdCtx)) {
+        return -1;
+    }
+    req.m_scheduler = Scheduler::GetThis();
+    req.m_fiber = Fiber::GetThis();
+    ++fdCtx->m_submitted;
+    ++m_pendingEventCount;
+    IOWorker* worker = getLocalIOWorker();
+    IOBackend* backend = worker? worker->m_backend.get(): m_backend.get();
+    if(!backend->submit(&req)) {
+        --fdCtx->m_submitted;
+        --m_pendingEventCount;
+        req.m_scheduler = nullptr;
+        req.m_fiber.reset();
+        return -1;
+    }
+    m_submitIoCount.fetch_add(1, std::memory_order_relaxed);
+    // 让出执行权，完成后在idle中被调度
+    Fiber::GetThis()->yield();
+    --fdCtx->m_submitted;
+    return 0;
+}
+
 IOManager* IOManager::GetThis() {
     // 动态转型
     return dynamic_cast<IOManager*>(Scheduler::GetThis());
@@ -335,85 +318,173 @@ IOManager* IOManager::GetThis() {
 
 void IOManager::tickle() {
     FOCUS_LOG_DEBUG(g_logger) << "tickle";
-    // 没有空闲线程
-    if(!hasIdleThreads()) {
+    m_tickleCount.fetch_add(1, std::memory_order_relaxed);
+    if(!m_ioWorkers.empty()) {
+        // 唤醒有绑定任务的线程，停止时唤醒所有线程
+        bool stopping = isStopping();
+        bool unpinned = hasUnpinnedTasks();
+        for(size_t i = 0; i < m_ioWorkers.size(); ++i) {
+            IOWorker* worker = m_ioWorkers[i];
+            if(!worker->m_sleeping) {
+                continue;
+            }
+            if(stopping || hasPinnedTasks(i)) {
+                tickleWorker(worker);
+            }else if(unpinned) {
+                // 任意线程都可以执行的任务只唤醒一个线程
+                tickleWorker(worker);
+                unpinned = false;
+            }
+        }
+        return ;
+    }
+    // 没有阻塞在wait中的线程，它们下次wait前会检查任务和定时器
+    if(0 == m_sleepingCount) {
+        return ;
+    }
+    // 已经发出的通知还没有线程醒来处理，醒来的线程取到任务后会继续tickle
+    if(m_tickled.exchange(true)) {
         return ;
     }
     // 唤醒
-    int rt = write(m_tickleFd[1], "T", 1);
-    FOCUS_ASSERT(1 == rt);
+    m_tickleSignalCount.fetch_add(1, std::memory_order_relaxed);
+    m_backend->tickle();
+}
+
+void IOManager::tickleWorker(IOWorker* worker) {
+    if(!worker->m_sleeping || worker->m_tickled.exchange(true)) {
+        return ;
+    }
+    m_tickleSignalCount.fetch_add(1, std::memory_order_relaxed);
+    worker->m_backend->tickle();
+}
+
+Timer::ptr IOManager::addTimer(std::function<void()> cb, uint64_t ms, bool recurring) {
+    IOWorker* worker = getLocalIOWorker();
+    if(worker) {
+        return worker->addTimer(cb, ms, recurring);
+    }
+    return TimerManager::addTimer(cb, ms, recurring);
+}
+
+Timer::ptr IOManager::addConditionTimer(std::function<void()> cb, uint64_t ms, std::weak_ptr<void> cond, bool recurring) {
+    IOWorker* worker = getLocalIOWorker();
+    if(worker) {
+        return worker->addConditionTimer(cb, ms, cond, recurring);
+    }
+    return TimerManager::addConditionTimer(cb, ms, cond, recurring);
+}
+
+IOManager::IOWorker* IOManager::getLocalIOWorker() {
+    if(m_ioWorkers.empty()) {
+        return nullptr;
+    }
+    int index = getLocalWorkerIndex();
+    return index >= 0? m_ioWorkers[index]: nullptr;
 }
 
 void IOManager::idle() {
     FOCUS_LOG_DEBUG(g_logger) << "idle";
 
-    // 等待事件
-    const uint64_t MAX_EVENTS = 256;
-    epoll_event* events = new epoll_event[MAX_EVENTS]();
-    std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){
-        delete[] ptr;
-    });
+    // 等待事件，数量根据每次就绪的数量调整
+    const size_t minEvents = std::max<uint32_t>(g_iomanager_max_events->getVal(), 1);
+    const size_t maxEvents = minEvents * 16;
+    std::vector<IOReady> events(minEvents);
+    std::vector<IORequest*> done;
+    // 一次等待中可以执行的协程和函数，最后批量调度
+    TaskBatch batch;
+    TaskBatch sharedBatch;
+
+    // 按线程分配时使用当前线程的后端
+    int index = getLocalWorkerIndex();
+    IOWorker* worker = getLocalIOWorker();
+    IOBackend* backend = worker? worker->m_backend.get(): m_backend.get();
+    int thread = worker? GetThreadId(): -1;
 
     // 循环
     while(true) {
+        // 先登记为睡眠线程再检查定时器和任务，
+        // 之后添加的任务或首部定时器一定能看到睡眠线程并唤醒
+        if(worker) {
+            worker->m_sleeping = true;
+        }else {
+            ++m_sleepingCount;
+        }
+
         // 判断调度器是否停止
         uint64_t nextTimeout = 0;
         if(FOCUS_UNLIKELY(isCanStop(nextTimeout))) {
             FOCUS_LOG_DEBUG(g_logger) << "name = "<< getName() <<" idle exit";
+            // 把停止通知传给下一个睡眠线程
+            if(worker) {
+                worker->m_sleeping = false;
+                worker->m_tickled = false;
+            }else {
+                --m_sleepingCount;
+                m_tickled = false;
+            }
+            tickle();
             break;
         }
 
         // 等待事件发生或者超时
-        int rt = 0;
-        do {
-            static const int MAX_TIMEOUT = 5000;
-            if(~0ull != nextTimeout) {
-                nextTimeout = std::min((int)nextTimeout, MAX_TIMEOUT);
-            }else {
-                nextTimeout = MAX_TIMEOUT;
-            } 
-            rt = epoll_wait(m_epfd, events, MAX_EVENTS, (int)nextTimeout);
-            // 为了确保中断信号不会导致程序退出或停止等待
-            if(rt < 0 && errno == EINTR) {
-                continue;
-            }else {
-                break;
-            }
-        }while(true);
+        static const int MAX_TIMEOUT = 5000;
+        if(~0ull != nextTimeout) {
+            nextTimeout = std::min((int)nextTimeout, MAX_TIMEOUT);
+        }else {
+            nextTimeout = MAX_TIMEOUT;
+        } 
+        // 已经有当前线程可以执行的任务时不阻塞
+        if(worker? hasPinnedTasks(index) || hasUnpinnedTasks(): hasPendingTasks()) {
+            nextTimeout = 0;
+        }
+        int rt = backend->wait(&events[0], events.size(), (int)nextTimeout, done);
+        if(worker) {
+            worker->m_sleeping = false;
+            worker->m_tickled = false;
+        }else {
+            --m_sleepingCount;
+            m_tickled = false;
+        }
 
         // 获取超时的定时器，执行函数
-        std::vector<std::function<void()>> cbs;
-        listExpiredCb(cbs);
-        if(!cbs.empty()) {
-            for(const auto& cb: cbs) {
-                schedule(cb);
+        // 按线程分配时共享定时器的函数可以在任意线程执行，否则和事件一起调度
+        listExpiredCb(worker? sharedBatch.m_cbs: batch.m_cbs);
+        // 当前线程的定时器在当前线程执行
+        if(worker) {
+            worker->listExpiredCb(batch.m_cbs);
+        }
+
+        // 恢复完成IO请求的协程，请求在协程栈上，调度前取出所有字段
+        for(auto req: done) {
+            Scheduler* scheduler = req->m_scheduler;
+            Fiber::ptr fiber;
+            fiber.swap(req->m_fiber);
+            --m_pendingEventCount;
+            if(scheduler == this) {
+                batch.m_fibers.emplace_back(std::move(fiber));
+            }else {
+                scheduler->schedule(fiber);
             }
-            cbs.clear();
         }
+        done.clear();
 
         // 遍历所有发生的事件
         for(int i = 0; i < rt; ++i) {
-            epoll_event& event = events[i];
-            if(event.data.fd == m_tickleFd[0]) {
-                // ticklefd[0] 用于通知协程
-                uint8_t dummy[256];
-                while(read(m_tickleFd[0], dummy, sizeof(dummy)) > 0);
-                continue;
-            }
-
-            FdContext* fdCtx = (FdContext*)event.data.ptr;
+            IOReady& event = events[i];
+            FdContext* fdCtx = (FdContext*)event.m_data;
             FdContext::MutexType::Lock lock(fdCtx->m_mutex);
 
             // 获取实际事件
             // 这两种错误都要触发读和写事件
-            if(event.events & (EPOLLERR | EPOLLHUP)) {
-                event.events |= (EPOLLIN | EPOLLOUT) & fdCtx->m_events;
+            if(event.m_events & (EPOLLERR | EPOLLHUP)) {
+                event.m_events |= (EPOLLIN | EPOLLOUT) & fdCtx->m_events;
             }
             int realEvents = NONE;
-            if(event.events & EPOLLIN) {
+            if(event.m_events & EPOLLIN) {
                 realEvents |= READ;
             }
-            if(event.events & EPOLLOUT) {
+            if(event.m_events & EPOLLOUT) {
                 realEvents |= WRITE;
             }
 
@@ -423,29 +494,39 @@ void IOManager::idle() {
 
             // 获取剩余的事件
             int leftEvents = (fdCtx->m_events & ~realEvents);
-            int op = leftEvents? EPOLL_CTL_MOD: EPOLL_CTL_DEL;
-            event.events = EPOLLET | leftEvents;
+            IOBackend::CtlOp op = leftEvents? IOBackend::MOD: IOBackend::DEL;
 
             // 添加剩余的事件
-            int rt2 = epoll_ctl(m_epfd, op, fdCtx->m_fd, &event);
-            if(rt2) {
-                FOCUS_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                                  << (EPOLL_CTL_OP_TYPE)op << ", " << fdCtx->m_fd << ", " << (EPOLL_EVENTS)event.events << "):"
-                                  << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+            if(!backend->ctl(op, fdCtx->m_fd, leftEvents, fdCtx)) {
                 continue;
             }
 
             // 处理已经发生的事件
             if(realEvents & READ) {
-                fdCtx->triggerEvent(READ);
+                fdCtx->triggerEvent(READ, thread, &batch);
                 --m_pendingEventCount;
             }
             if(realEvents & WRITE) {
-                fdCtx->triggerEvent(WRITE);
+                fdCtx->triggerEvent(WRITE, thread, &batch);
                 --m_pendingEventCount;
             }
         }
 
+        // 一次加锁放入，最多通知一次
+        if(!sharedBatch.empty()) {
+            scheduleBatch(sharedBatch);
+        }
+        if(!batch.empty()) {
+            scheduleBatch(batch, thread);
+        }
+
+        // 就绪事件用满时扩大，使用不到四分之一时缩小
+        if(rt == (int)events.size() && events.size() < maxEvents) {
+            events.resize(events.size() * 2);
+        }else if(rt < (int)events.size() / 4 && events.size() > minEvents) {
+            events.resize(events.size() / 2);
+        }
+
         // 一旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)重新检查是否有新任务要调度
         Fiber::ptr cur = Fiber::GetThis();
         auto raw_ptr   = cur.get();
@@ -463,22 +544,49 @@ bool IOManager::isCanStop() {
 bool IOManager::isCanStop(uint64_t& timeout) {
     // 等待所有IO事件 确保没有剩余的定时器
     timeout = getNextTimer();
-    return ~0ull == timeout && 0 == m_pendingEventCount && Scheduler::isCanStop();
+    IOWorker* worker = getLocalIOWorker();
+    if(worker) {
+        timeout = std::min(timeout, worker->getNextTimer());
+    }
+    if(~0ull != timeout || 0 != m_pendingEventCount || !Scheduler::isCanStop()) {
+        return false;
+    }
+    for(auto w: m_ioWorkers) {
+        if(w->hasTimer()) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void IOManager::onTimerInsertAtFront() {
+    if(!m_ioWorkers.empty()) {
+        // 共享的定时器唤醒一个睡眠的线程重新计算超时
+        for(auto worker: m_ioWorkers) {
+            if(worker->m_sleeping) {
+                tickleWorker(worker);
+                return ;
+            }
+        }
+        return ;
+    }
     tickle();
 }
 
-void IOManager::resizeContext(size_t size) {
-    m_fdContexts.resize(size);
-
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(!m_fdContexts[i]) {
-            m_fdContexts[i] = new FdContext;
-            m_fdContexts[i]->m_fd = i;
-        }
+IOManager::FdContext* IOManager::getFdContext(int fd, bool autoCreate) {
+    if(FOCUS_UNLIKELY(fd < 0)) {
+        return nullptr;
+    }
+    FdContext* fdCtx = m_fdContexts.get(fd);
+    if(FOCUS_UNLIKELY(!fdCtx && autoCreate)) {
+        // 一页连续分配，已有的页不会移动
+        fdCtx = m_fdContexts.getOrCreate(fd, [](FdContext* ctxs, size_t first){
+            for(size_t i = 0; i < PageTable<FdContext>::PAGE_SIZE; ++i) {
+                ctxs[i].m_fd = first + i;
+            }
+        });
     }
+    return fdCtx;
 }
 
 } // end namespace focus
\ No newline at end of file
@@ -4,11 +4,18 @@
 #include <vector>
 #include "scheduler.h"
 #include "timer.h"
+#include "iobackend.h"
+#include "pagetable.h"
 
 namespace focus {
 
 /**
  * @brief IO调度器
+ * @details 配置iomanager.per_thread为true时，每个调度线程有自己的事件后端和定时器，
+ *          fd第一次注册事件时归属于注册的线程(不是调度线程时轮流分配)，
+ *          之后该fd的事件都由所属线程等待和执行。
+ *          监听fd可以在每个线程(getThreadIds)上各创建一个SO_REUSEPORT的监听，
+ *          由内核把新连接分散到各个线程
  */
 class IOManager: public Scheduler, public TimerManager {
 public:
@@ -28,8 +35,9 @@ public:
 private:
     /**
      * @brief fd上下文
+     * @details 按缓存行对齐，相邻fd的上下文不会互相伪共享
      */
-    struct FdContext {
+    struct alignas(64) FdContext {
         using MutexType = Mutex;
         /**
          * @brief 事件上下文
@@ -55,16 +63,47 @@ private:
         /**
          * @brief 触发事件
          * @param[in] event 要触发事件的类型
+         * @param[in] thread 事件属于当前调度器时绑定的线程，-1表示任意线程
+         * @param[out] batch 不为空时，属于当前调度器的任务放入batch稍后批量调度
          */
-        void triggerEvent(Event event);
+        void triggerEvent(Event event, int thread = -1, TaskBatch* batch = nullptr);
 
         EventContext m_read; // 读事件上下文
         EventContext m_write; // 写事件上下文
         int m_fd = 0; // 事件的文件描述符
         Event m_events = NONE; // 要关心的事件类型
+        std::atomic<int> m_submitted = {0}; // 直接提交给后端还未完成的IO请求数
+        int m_owner = 0; // 按线程分配时，所属调度线程的下标
         MutexType m_mutex; // 事件的锁
     };
 
+    /**
+     * @brief 按线程分配时，每个调度线程的事件后端和定时器
+     */
+    struct IOWorker: public TimerManager {
+        /**
+         * @brief 构造函数
+         * @param[in] iom 所属IO调度器
+         * @param[in] type 定时器的组织方式
+         */
+        IOWorker(IOManager* iom, TimerManager::Type type):
+            TimerManager(type),
+            m_iom(iom) {
+        }
+
+        /**
+         * @brief 有定时器插入首部，唤醒所属线程
+         */
+        void onTimerInsertAtFront() override {
+            m_iom->tickleWorker(this);
+        }
+
+        IOManager* m_iom; // 所属IO调度器
+        IOBackend::ptr m_backend; // 事件后端
+        std::atomic<bool> m_sleeping = {false}; // 是否阻塞在后端wait中
+        std::atomic<bool> m_tickled = {false}; // 是否已经发出唤醒通知且还没有醒来
+    };
+
 public:
     /**
      * @brief 构造函数
@@ -111,6 +150,74 @@ public:
      */
     bool cancelAll(int fd);
 
+    /**
+     * @brief 添加定时器
+     * @details 按线程分配时，调度线程添加的定时器由该线程管理
+     * @param[in] cb 回调函数
+     * @param[in] ms 定时器周期
+     * @param[in] recurring 是否循环
+     */
+    Timer::ptr addTimer(std::function<void()> cb, uint64_t ms, bool recurring = false);
+
+    /**
+     * @brief 添加条件定时器
+     * @details 按线程分配时，调度线程添加的定时器由该线程管理
+     * @param[in] cb 回调函数
+     * @param[in] ms 定时器周期
+     * @param[in] cond 条件
+     * @param[in] recurring 是否循环
+     */
+    Timer::ptr addConditionTimer(std::function<void()> cb, uint64_t ms, std::weak_ptr<void> cond, bool recurring = false);
+
+    /**
+     * @brief 是否每个调度线程有自己的事件后端
+     */
+    bool isPerThread() const {
+        return !m_ioWorkers.empty();
+    }
+
+    /**
+     * @brief 后端是否支持直接提交IO请求
+     */
+    bool canSubmitIo() const {
+        return m_backend->canSubmit();
+    }
+
+    /**
+     * @brief 直接提交IO请求，让出执行权直到完成
+     * @param[in,out] req IO请求，完成后结果在m_result
+     * @return 0表示完成，-1表示提交失败
+     */
+    int submitIo(IORequest& req);
+
+    /**
+     * @brief 获取后端名称
+     */
+    const char* getBackendName() const {
+        return m_backend->getName();
+    }
+
+    /**
+     * @brief 获取调用tickle的次数
+     */
+    uint64_t getTickleCount() const {
+        return m_tickleCount;
+    }
+
+    /**
+     * @brief 获取实际写入唤醒通知的次数
+     */
+    uint64_t getTickleSignalCount() const {
+        return m_tickleSignalCount;
+    }
+
+    /**
+     * @brief 获取直接提交给后端的IO请求数
+     */
+    uint64_t getSubmitIoCount() const {
+        return m_submitIoCount;
+    }
+
     /**
      * @brief 获取当前的IO调度器
      */
@@ -144,17 +251,40 @@ protected:
     void onTimerInsertAtFront();
 
     /**
-     * @brief 重置上下文容器的大小
-     * @param[in] size 重置后的大小
+     * @brief 获取fd上下文，不加锁
+     * @param[in] fd 文件描述符
+     * @param[in] autoCreate 不存在时是否分配
+     */
+    FdContext* getFdContext(int fd, bool autoCreate);
+
+    /**
+     * @brief 获取当前线程的IOWorker，不是按线程分配或不是调度线程返回nullptr
+     */
+    IOWorker* getLocalIOWorker();
+
+    /**
+     * @brief 获取fd所属的事件后端
+     */
+    IOBackend* getBackend(FdContext* fdCtx) {
+        return m_ioWorkers.empty()? m_backend.get(): m_ioWorkers[fdCtx->m_owner]->m_backend.get();
+    }
+
+    /**
+     * @brief 唤醒指定的调度线程
      */
-    void resizeContext(size_t size);
+    void tickleWorker(IOWorker* worker);
 
 private:
-    int m_epfd = 0; // epoll文件描述符
-    int m_tickleFd[2]; // pipe文件描述符，fd[0]读端，fd[1]写端
+    IOBackend::ptr m_backend; // 事件后端
     std::atomic<size_t> m_pendingEventCount = {0}; // 当前等待执行的IO事件数量
-    RWMutexType m_mutex; // 调度器的锁
-    std::vector<FdContext*> m_fdContexts; // fd事件上下文集合
+    std::atomic<size_t> m_sleepingCount = {0}; // 阻塞在后端wait中的线程数
+    std::atomic<bool> m_tickled = {false}; // 是否已经发出唤醒通知且还没有线程醒来
+    std::atomic<uint64_t> m_tickleCount = {0}; // tickle调用次数
+    std::atomic<uint64_t> m_tickleSignalCount = {0}; // 实际唤醒通知次数
+    std::atomic<uint64_t> m_submitIoCount = {0}; // 直接提交的IO请求数
+    std::vector<IOWorker*> m_ioWorkers; // 按线程分配时，每个调度线程的事件后端和定时器
+    std::atomic<uint32_t> m_nextOwner = {0}; // 非调度线程注册fd时轮流分配的下标
+    PageTable<FdContext> m_fdContexts; // fd事件上下文的页表，页和目录只增不减
 };
 
 } // end namespace focus
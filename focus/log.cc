@@ -1,9 +1,21 @@
 #include "log.h"
+#include "config.h"
 #include <iostream>
 #include <time.h>
 #include <unordered_map>
 #include <functional>
 #include <cstdarg>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <cstring>
+#include <algorithm>
+#include "macro.h"
+#include "fiber.h"
 
 namespace focus{
 
@@ -44,11 +56,80 @@ LogLevel::Level LogLevel::FromString(const std::string& s){
     return LogLevel::UNKNOWN;
 }
 
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type c){
+    if(traits_type::eq_int_type(c,traits_type::eof())){
+        return traits_type::not_eof(c);
+    }
+    spill();
+    overflow_.push_back(traits_type::to_char_type(c));
+    return c;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* s,std::streamsize n){
+    if(!spilled_&&epptr()-pptr()>=n){
+        memcpy(pptr(),s,n);
+        pbump(n);
+        return n;
+    }
+    spill();
+    overflow_.append(s,n);
+    return n;
+}
+
+void LogStreamBuf::spill(){
+    if(spilled_){
+        return ;
+    }
+    overflow_.assign(pbase(),pptr()-pbase());
+    spilled_=true;
+    // 之后的写入都走overflow/xsputn
+    setp(nullptr,nullptr);
+}
+
+// 当前协程的请求id
+static FiberLocal<std::string> s_request_id;
+
+void SetLogRequestId(const std::string& id){
+    s_request_id.set(id);
+}
+
+std::string GetLogRequestId(){
+    const std::string* requestId=s_request_id.tryGet();
+    return requestId?*requestId:std::string();
+}
+
 LogEvent::LogEvent(std::shared_ptr<Logger> logger,const char* file,std::int32_t line,uint32_t elapse,uint32_t threadId,
             uint32_t fiberId,uint64_t time,const std::string& threadName,LogLevel::Level level):
             logger_(logger),file_(file),line_(line),elapse_(elapse),threadId_(threadId),
-            fiberId_(fiberId),time_(time),threadName_(threadName),level_(level)
-            {}
+            fiberId_(fiberId),time_(time),level_(level)
+            {
+    size_t len=std::min(threadName.size(),sizeof(threadName_)-1);
+    memcpy(threadName_,threadName.data(),len);
+    threadName_[len]='\0';
+    const std::string* requestId=s_request_id.tryGet();
+    len=requestId?std::min(requestId->size(),sizeof(requestId_)-1):0;
+    memcpy(requestId_,requestId?requestId->data():"",len);
+    requestId_[len]='\0';
+}
+
+std::ostream& LogEvent::GetThreadStream(){
+    static thread_local std::ostream t_stream(nullptr);
+    return t_stream;
+}
+
+std::ostream& LogEvent::getSS(std::streambuf** prev){
+    std::ostream& t_stream=GetThreadStream();
+    std::streambuf* old=t_stream.rdbuf(&buf_);
+    if(prev){
+        *prev=old;
+    }
+    // 重置上一条日志留下的格式状态
+    t_stream.flags(std::ios_base::skipws|std::ios_base::dec);
+    t_stream.fill(' ');
+    t_stream.precision(6);
+    t_stream.width(0);
+    return t_stream;
+}
 
 void LogEvent::format(const char* fmt,...){
     va_list al;
@@ -58,25 +139,212 @@ void LogEvent::format(const char* fmt,...){
 }
 
 void LogEvent::format(const char* fmt,va_list al){
+    // 先尝试栈上缓冲区，放不下再申请
+    char stackBuf[512];
+    va_list copy;
+    va_copy(copy,al);
+    int len=vsnprintf(stackBuf,sizeof(stackBuf),fmt,copy);
+    va_end(copy);
+    if(len<0){
+        return ;
+    }
+    if((size_t)len<sizeof(stackBuf)){
+        buf_.sputn(stackBuf,len);
+        return ;
+    }
     char* buf=nullptr;
-    int len=vasprintf(&buf,fmt,al);
+    len=vasprintf(&buf,fmt,al);
     if(len!=-1){
-        ss_<<std::string(buf,len);
+        buf_.sputn(buf,len);
         free(buf);
     }
 }
 
+/**
+ * @brief 线程本地的日志事件内存池
+ * @details 只有所属线程从本地链表分配和释放，
+ *          其他线程(如异步输出器的后台线程)释放的内存块放入无锁的远程链表，
+ *          所属线程本地链表为空时一次性取回。线程退出后池不会释放，
+ *          而是留给之后创建的线程复用，保证跨线程释放时池仍然有效
+ */
+class LogEventPool{
+public:
+    // 内存块头部
+    struct Block{
+        LogEventPool* owner; // 所属的池，nullptr表示直接从堆申请
+        Block* next; // 空闲链表的下一块
+    };
+
+    // 内存块可用大小，足够放下LogEvent和shared_ptr的控制块
+    static const size_t PAYLOAD_SIZE=sizeof(LogEvent)+64;
+    // 本地链表最多缓存的块数
+    static const size_t MAX_FREE=1024;
+
+    static void* Allocate(size_t size);
+    static void Deallocate(void* p);
+
+private:
+    // 获取当前线程的池
+    static LogEventPool* GetThis();
+
+    void* allocate();
+    void free(Block* block);
+
+private:
+    Block* free_=nullptr; // 本地空闲链表
+    size_t freeCount_=0; // 本地空闲块数
+    std::atomic<Block*> remote_={nullptr}; // 其他线程释放的块
+};
+
+/**
+ * @brief 线程退出时将池交给全局，供之后的线程复用
+ */
+struct LogEventPoolHolder{
+    ~LogEventPoolHolder();
+
+    LogEventPool* pool=nullptr;
+};
+
+// 线程退出后留下的池，不释放以保证跨线程释放安全
+static Mutex& GetOrphanPoolsMutex(){
+    static Mutex* s_mutex=new Mutex();
+    return *s_mutex;
+}
+
+static std::vector<LogEventPool*>& GetOrphanPools(){
+    static std::vector<LogEventPool*>* s_pools=new std::vector<LogEventPool*>();
+    return *s_pools;
+}
+
+static thread_local LogEventPoolHolder t_log_event_pool;
+
+LogEventPoolHolder::~LogEventPoolHolder(){
+    if(pool){
+        Mutex::Lock lock(GetOrphanPoolsMutex());
+        GetOrphanPools().push_back(pool);
+        pool=nullptr;
+    }
+}
+
+LogEventPool* LogEventPool::GetThis(){
+    LogEventPool*& pool=t_log_event_pool.pool;
+    if(FOCUS_UNLIKELY(!pool)){
+        {
+            Mutex::Lock lock(GetOrphanPoolsMutex());
+            auto& pools=GetOrphanPools();
+            if(!pools.empty()){
+                pool=pools.back();
+                pools.pop_back();
+            }
+        }
+        if(!pool){
+            pool=new LogEventPool();
+        }
+    }
+    return pool;
+}
+
+void* LogEventPool::Allocate(size_t size){
+    if(size>PAYLOAD_SIZE){
+        Block* block=(Block*)::operator new(sizeof(Block)+size);
+        block->owner=nullptr;
+        return block+1;
+    }
+    return GetThis()->allocate();
+}
+
+void LogEventPool::Deallocate(void* p){
+    Block* block=(Block*)p-1;
+    if(!block->owner){
+        ::operator delete(block);
+        return ;
+    }
+    block->owner->free(block);
+}
+
+void* LogEventPool::allocate(){
+    if(!free_){
+        // 取回其他线程释放的块
+        free_=remote_.exchange(nullptr,std::memory_order_acquire);
+    }
+    Block* block=free_;
+    if(block){
+        free_=block->next;
+        if(freeCount_>0){
+            --freeCount_;
+        }
+    }else{
+        block=(Block*)::operator new(sizeof(Block)+PAYLOAD_SIZE);
+        block->owner=this;
+    }
+    return block+1;
+}
+
+void LogEventPool::free(Block* block){
+    if(t_log_event_pool.pool!=this){
+        // 其他线程释放，放入远程链表
+        Block* head=remote_.load(std::memory_order_relaxed);
+        do{
+            block->next=head;
+        }while(!remote_.compare_exchange_weak(head,block,
+                std::memory_order_release,std::memory_order_relaxed));
+        return ;
+    }
+    if(freeCount_>=MAX_FREE){
+        ::operator delete(block);
+        return ;
+    }
+    block->next=free_;
+    free_=block;
+    ++freeCount_;
+}
+
+/**
+ * @brief 从LogEventPool分配内存的分配器，用于allocate_shared
+ */
+template<class T>
+class LogEventAllocator{
+public:
+    using value_type=T;
+
+    LogEventAllocator()=default;
+
+    template<class U>
+    LogEventAllocator(const LogEventAllocator<U>&){}
+
+    T* allocate(size_t n){
+        return (T*)LogEventPool::Allocate(n*sizeof(T));
+    }
+
+    void deallocate(T* p,size_t n){
+        LogEventPool::Deallocate(p);
+    }
+
+    template<class U>
+    bool operator==(const LogEventAllocator<U>&) const {return true;}
+
+    template<class U>
+    bool operator!=(const LogEventAllocator<U>&) const {return false;}
+};
+
+LogEvent::ptr LogEvent::Create(std::shared_ptr<Logger> logger,const char* file,int32_t line,uint32_t elapse,uint32_t threadId,
+            uint32_t fiberId,uint64_t time,const std::string& threadName,LogLevel::Level level){
+    return std::allocate_shared<LogEvent>(LogEventAllocator<LogEvent>(),std::move(logger),file,line,
+        elapse,threadId,fiberId,time,threadName,level);
+}
 
 void Logger::log(LogLevel::Level level,LogEvent::ptr event){
     if(level_>level) return ;
+    auto self=shared_from_this();
+    RWMutex::ReadLock lock(mutex_);
     for(auto& it: appenders_){
-        auto self=shared_from_this();
         if(it->isEmpty()) it->setLogFormatter(logformatter_);
         it->log(self,level_,event);
     }
 }
 
 void Logger::setLogFormatter(const std::string& pattern){
+    RWMutex::WriteLock lock(mutex_);
     logformatter_.reset(new LogFormatter(pattern));
     for(auto& it: appenders_){
         it->setLogFormatter(logformatter_);
@@ -105,10 +373,12 @@ void Logger::fatal(LogEvent::ptr event){
 }
 
 void Logger::addAppender(LogAppender::ptr appender){
+    RWMutex::WriteLock lock(mutex_);
     appenders_.push_back(appender);
 }
 
 void Logger::delAppender(LogAppender::ptr appender){
+    RWMutex::WriteLock lock(mutex_);
     for(auto it=appenders_.begin();it!=appenders_.end();++it){
         if(*it==appender){
             appenders_.erase(it);
@@ -118,6 +388,7 @@ void Logger::delAppender(LogAppender::ptr appender){
 }   
 
 void Logger::clearAppenders(){
+    RWMutex::WriteLock lock(mutex_);
     appenders_.clear();
 }
 
@@ -141,26 +412,64 @@ std::ostream& LogFormatter::format(std::ostream& os,std::shared_ptr<Logger> logg
     return os;
 }
 
+/**
+ * @brief 循环writev直到全部写完
+ */
+static bool WriteAll(int fd,const struct iovec* iov,int cnt){
+    std::vector<struct iovec> rest(iov,iov+cnt);
+    size_t idx=0;
+    while(idx<rest.size()){
+        int n=std::min<size_t>(rest.size()-idx,IOV_MAX);
+        ssize_t ret=::writev(fd,&rest[idx],n);
+        if(ret<0){
+            if(EINTR==errno){
+                continue;
+            }
+            return false;
+        }
+        // 跳过已经写完的部分
+        size_t left=ret;
+        while(idx<rest.size()&&left>=rest[idx].iov_len){
+            left-=rest[idx].iov_len;
+            ++idx;
+        }
+        if(left>0){
+            rest[idx].iov_base=(char*)rest[idx].iov_base+left;
+            rest[idx].iov_len-=left;
+        }
+    }
+    return true;
+}
+
 void StdOutLogAppender::log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event){
     if(level_>level) return ;
     MutexType::Lock lock(mutex_);
     logformatter_->format(std::cout,logger,level,event);
 }
 
+bool StdOutLogAppender::writeBatch(const struct iovec* iov,int cnt){
+    MutexType::Lock lock(mutex_);
+    // 保证与std::cout的输出顺序一致
+    std::cout.flush();
+    return WriteAll(STDOUT_FILENO,iov,cnt);
+}
+
 FileLogAppender::FileLogAppender(const std::string& file):file_(file){
     reopen();
 }
 
 FileLogAppender::~FileLogAppender(){
-    ofs.close();
+    if(fd_>=0){
+        ::close(fd_);
+    }
 }
 
 bool FileLogAppender::reopen(){
-    if(ofs.is_open()){
+    if(fd_>=0){
         return true;
     }
-    ofs.open(file_,std::ios::app);
-    if(ofs.fail()){
+    fd_=::open(file_.c_str(),O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC,0644);
+    if(fd_<0){
         std::cerr<<"file open fail"<<std::endl;
         return false;
     }
@@ -169,8 +478,367 @@ bool FileLogAppender::reopen(){
 
 void FileLogAppender::log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event){
     if(level_>level||!reopen()) return ;
+    std::string str=logformatter_->format(logger,level,event);
+    struct iovec iov;
+    iov.iov_base=(void*)str.data();
+    iov.iov_len=str.size();
+    MutexType::Lock lock(mutex_);
+    WriteAll(fd_,&iov,1);
+}
+
+bool FileLogAppender::writeBatch(const struct iovec* iov,int cnt){
+    if(!reopen()) return false;
+    MutexType::Lock lock(mutex_);
+    return WriteAll(fd_,iov,cnt);
+}
+
+/**
+ * @brief 格式化到线程本地的缓冲区，避免每条日志申请内存
+ */
+static const LogStreamBuf& FormatToThreadBuf(LogFormatter::ptr formatter,Logger::ptr logger,
+        LogLevel::Level level,LogEvent::ptr event){
+    static thread_local LogStreamBuf t_buf;
+    static thread_local std::ostream t_os(&t_buf);
+    t_buf.reset();
+    formatter->format(t_os,logger,level,event);
+    return t_buf;
+}
+
+RotatingFileLogAppender::RotatingFileLogAppender(const std::string& file,uint64_t maxSize,bool hourly,
+        uint32_t maxFiles,size_t chunkSize):
+    file_(file),maxSize_(maxSize),hourly_(hourly),maxFiles_(maxFiles){
+    // 映射块按页对齐
+    size_t page=sysconf(_SC_PAGESIZE);
+    chunkSize_=std::max(page,(chunkSize+page-1)/page*page);
+    MutexType::Lock lock(mutex_);
+    open();
+}
+
+RotatingFileLogAppender::~RotatingFileLogAppender(){
+    MutexType::Lock lock(mutex_);
+    close();
+}
+
+bool RotatingFileLogAppender::open(){
+    if(fd_>=0){
+        return true;
+    }
+    fd_=::open(file_.c_str(),O_RDWR|O_CREAT|O_CLOEXEC,0644);
+    if(fd_<0){
+        std::cerr<<"file open fail"<<std::endl;
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd_,&st)){
+        ::close(fd_);
+        fd_=-1;
+        return false;
+    }
+    size_=st.st_size;
+    if(!mapNext()){
+        return false;
+    }
+    // 下一个整点
+    if(hourly_){
+        time_t now=time(0);
+        struct tm tm;
+        localtime_r(&now,&tm);
+        nextRotate_=now-tm.tm_min*60-tm.tm_sec+3600;
+    }
+    return true;
+}
+
+void RotatingFileLogAppender::close(){
+    if(fd_<0){
+        return ;
+    }
+    if(map_){
+        munmap(map_,chunkSize_);
+        map_=nullptr;
+    }
+    // 截掉预留的空间
+    if(ftruncate(fd_,size_)){
+        std::cerr<<"log file truncate fail"<<std::endl;
+    }
+    ::close(fd_);
+    fd_=-1;
+}
+
+bool RotatingFileLogAppender::mapNext(){
+    if(map_){
+        munmap(map_,chunkSize_);
+        map_=nullptr;
+    }
+    // 从写入位置所在的页开始映射一块
+    size_t page=sysconf(_SC_PAGESIZE);
+    mapOffset_=size_/page*page;
+    mapPos_=size_-mapOffset_;
+    // 预先分配磁盘空间，避免写映射时因磁盘满收到SIGBUS
+    if(posix_fallocate(fd_,mapOffset_,chunkSize_)){
+        return false;
+    }
+    void* addr=mmap(nullptr,chunkSize_,PROT_READ|PROT_WRITE,MAP_SHARED,fd_,mapOffset_);
+    if(MAP_FAILED==addr){
+        return false;
+    }
+    map_=(char*)addr;
+    return true;
+}
+
+bool RotatingFileLogAppender::append(const char* data,size_t len){
+    while(len>0){
+        if(!map_||mapPos_==chunkSize_){
+            if(!mapNext()){
+                // 无法映射，退回到write
+                ssize_t n=::pwrite(fd_,data,len,size_);
+                if(n<0){
+                    return false;
+                }
+                size_+=n;
+                data+=n;
+                len-=n;
+                continue;
+            }
+        }
+        size_t n=std::min(len,chunkSize_-mapPos_);
+        memcpy(map_+mapPos_,data,n);
+        mapPos_+=n;
+        size_+=n;
+        data+=n;
+        len-=n;
+    }
+    return true;
+}
+
+void RotatingFileLogAppender::checkRotate(size_t len){
+    bool need=false;
+    if(maxSize_>0&&size_>0&&size_+len>maxSize_){
+        need=true;
+    }
+    if(hourly_&&time(0)>=nextRotate_){
+        need=true;
+    }
+    if(need){
+        rotateLocked();
+    }
+}
+
+bool RotatingFileLogAppender::rotateLocked(){
+    close();
+    if(maxFiles_>0){
+        // file.N-1 -> file.N, ..., file -> file.1
+        for(uint32_t i=maxFiles_;i>1;--i){
+            std::string from=file_+"."+std::to_string(i-1);
+            std::string to=file_+"."+std::to_string(i);
+            ::rename(from.c_str(),to.c_str());
+        }
+        ::rename(file_.c_str(),(file_+".1").c_str());
+    }else{
+        ::unlink(file_.c_str());
+    }
+    return open();
+}
+
+bool RotatingFileLogAppender::rotate(){
+    MutexType::Lock lock(mutex_);
+    return rotateLocked();
+}
+
+void RotatingFileLogAppender::log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event){
+    if(level_>level) return ;
+    const LogStreamBuf& buf=FormatToThreadBuf(logformatter_,logger,level,event);
+    MutexType::Lock lock(mutex_);
+    if(!open()) return ;
+    checkRotate(buf.size());
+    append(buf.data(),buf.size());
+}
+
+bool RotatingFileLogAppender::writeBatch(const struct iovec* iov,int cnt){
     MutexType::Lock lock(mutex_);
-    logformatter_->format(ofs,logger,level,event);
+    if(!open()) return false;
+    for(int i=0;i<cnt;++i){
+        checkRotate(iov[i].iov_len);
+        if(fd_<0||!append((const char*)iov[i].iov_base,iov[i].iov_len)){
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 异步输出器和后台线程共享的状态
+ * @details 后台线程持有Core而不是输出器本身，
+ *          输出器在后台线程中析构时线程仍然可以安全退出
+ */
+struct AsyncLogAppender::Core{
+    /**
+     * @brief 队列中的日志事件
+     */
+    struct Item{
+        Logger::ptr logger;
+        LogLevel::Level level=LogLevel::UNKNOWN;
+        LogEvent::ptr event;
+    };
+
+    Core(LogAppender::ptr appender,size_t capacity,OverflowPolicy policy,
+            LogLevel::Level dropLevel,size_t batchSize):
+        appender(appender),policy(policy),dropLevel(dropLevel),
+        batchSize(batchSize?batchSize:1),queue(capacity){
+        for(auto& it: dropped){
+            it.store(0,std::memory_order_relaxed);
+        }
+    }
+
+    // 唤醒等待中的后台线程，入队之后调用
+    void wakeup(){
+        // 与Run中的栅栏配对，入队和读取sleeping不能重排
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(sleeping.load(std::memory_order_relaxed)&&sleeping.exchange(false)){
+            semaphore.notify();
+        }
+    }
+
+    // 后台线程执行的函数
+    static void Run(std::shared_ptr<Core> core);
+
+    // 格式化并输出一批日志
+    void flush(std::vector<Item>& items);
+
+    LogAppender::ptr appender; // 被包装的输出器
+    OverflowPolicy policy; // 队列满时的处理策略
+    LogLevel::Level dropLevel; // DROP_BELOW的级别
+    size_t batchSize; // 每批最多输出的日志数
+    MpscQueue<Item> queue; // 日志事件队列
+    std::atomic<uint64_t> dropped[LogLevel::FATAL+1]; // 每个级别丢弃的日志数
+    std::atomic<uint64_t> pushed={0}; // 入队的日志数
+    std::atomic<uint64_t> written={0}; // 已经输出的日志数
+    std::atomic<bool> sleeping={false}; // 后台线程是否在等待
+    std::atomic<bool> stopping={false}; // 是否停止
+    Semaphore semaphore; // 唤醒后台线程
+};
+
+void AsyncLogAppender::Core::Run(std::shared_ptr<Core> core){
+    std::vector<Item> items;
+    items.reserve(core->batchSize);
+    while(true){
+        Item item;
+        while(items.size()<core->batchSize&&core->queue.pop(item)){
+            items.emplace_back(std::move(item));
+        }
+        if(!items.empty()){
+            core->flush(items);
+            continue;
+        }
+        if(core->stopping){
+            break;
+        }
+        // 队列为空，设置等待标记后再检查一次，避免错过唤醒
+        core->sleeping=true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!core->queue.empty()){
+            core->sleeping=false;
+            continue;
+        }
+        core->semaphore.wait();
+        core->sleeping=false;
+    }
+}
+
+void AsyncLogAppender::Core::flush(std::vector<Item>& items){
+    std::vector<std::string> lines;
+    lines.reserve(items.size());
+    LogLevel::Level minLevel=appender->getLevel();
+    LogFormatter::ptr formatter=appender->getLogFormatter();
+    if(formatter){
+        for(auto& it: items){
+            if(minLevel<=it.level){
+                lines.emplace_back(formatter->format(it.logger,it.level,it.event));
+            }
+        }
+    }
+
+    std::vector<struct iovec> iov(lines.size());
+    for(size_t i=0;i<lines.size();++i){
+        iov[i].iov_base=(void*)lines[i].data();
+        iov[i].iov_len=lines[i].size();
+    }
+    if(!iov.empty()&&!appender->writeBatch(&iov[0],iov.size())){
+        // 不支持批量输出，逐条输出
+        for(auto& it: items){
+            appender->log(it.logger,it.level,it.event);
+        }
+    }
+    size_t n=items.size();
+    // 可能释放最后一个日志器的引用，导致输出器在本线程析构
+    items.clear();
+    written.fetch_add(n);
+}
+
+AsyncLogAppender::AsyncLogAppender(LogAppender::ptr appender,size_t capacity,
+        OverflowPolicy policy,LogLevel::Level dropLevel,size_t batchSize):
+    core_(new Core(appender,capacity,policy,dropLevel,batchSize)){
+    logformatter_=appender->getLogFormatter();
+    thread_.reset(new Thread(std::bind(&Core::Run,core_),"log_async"));
+}
+
+AsyncLogAppender::~AsyncLogAppender(){
+    core_->stopping=true;
+    core_->semaphore.notify();
+    // 在后台线程中析构时不能等待自己，线程输出剩余日志后自行退出
+    if(GetThreadId()!=thread_->getId()){
+        thread_->join();
+    }
+}
+
+void AsyncLogAppender::setLogFormatter(LogFormatter::ptr val){
+    logformatter_=val;
+    if(core_->appender->isEmpty()){
+        core_->appender->setLogFormatter(val);
+    }
+}
+
+void AsyncLogAppender::log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event){
+    if(level_>level) return ;
+    Core::Item item;
+    item.logger=logger;
+    item.level=level;
+    item.event=event;
+    while(!core_->queue.push(item)){
+        // 队列已满
+        if(DROP==core_->policy||(DROP_BELOW==core_->policy&&event->getLevel()<core_->dropLevel)){
+            core_->dropped[event->getLevel()].fetch_add(1,std::memory_order_relaxed);
+            return ;
+        }
+        core_->wakeup();
+        sched_yield();
+    }
+    core_->pushed.fetch_add(1);
+    // 后台线程在等待时才唤醒
+    core_->wakeup();
+}
+
+void AsyncLogAppender::flush(){
+    uint64_t target=core_->pushed.load();
+    while(core_->written.load()<target){
+        core_->wakeup();
+        sched_yield();
+    }
+}
+
+LogAppender::ptr AsyncLogAppender::getAppender() const{
+    return core_->appender;
+}
+
+uint64_t AsyncLogAppender::getDropped() const{
+    uint64_t total=0;
+    for(auto& it: core_->dropped){
+        total+=it.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t AsyncLogAppender::getDropped(LogLevel::Level level) const{
+    return core_->dropped[level].load(std::memory_order_relaxed);
 }
 
 // 日志器名字
@@ -257,29 +925,142 @@ private:
     std::string m_string;
 };
 
+// 请求ID
+class RequestIdFormatItem: public LogFormatter::FormatItem{
+public:
+    RequestIdFormatItem(const std::string& string = ""):
+        m_string(string) {
+    }
+
+    void format(std::ostream& os,std::shared_ptr<Logger> logger,LogLevel::Level level,LogEvent::ptr event) override{
+        os<<event->getRequestId();
+    }
+private:
+    std::string m_string;
+};
+
 // 时间
 class DateTimeFormatItem: public LogFormatter::FormatItem{
 public:
     DateTimeFormatItem(const std::string& pattern="%Y-%m-%d %H:%M:%S"):
-        pattern_(pattern)
+        pattern_(pattern),
+        id_(++s_nextId)
     {
         if(pattern_.empty()) {
             pattern_ = "%Y-%m-%d %H:%M:%S";
         }
+        // 按亚秒格式%L/%f拆分，其余部分交给strftime
+        std::string segment;
+        for(size_t i=0;i<pattern_.size();++i){
+            if('%'==pattern_[i]&&i+1<pattern_.size()){
+                char c=pattern_[i+1];
+                if(('L'==c||'f'==c)&&digits_.size()<MAX_SUBSEC){
+                    segments_.push_back(segment);
+                    segment.clear();
+                    digits_.push_back('L'==c?3:6);
+                }else{
+                    segment.append(pattern_,i,2);
+                }
+                ++i;
+                continue;
+            }
+            segment.push_back(pattern_[i]);
+        }
+        segments_.push_back(segment);
     }
 
     void format(std::ostream& os,std::shared_ptr<Logger> logger,LogLevel::Level level,LogEvent::ptr event) override{
+        uint64_t us=event->getTimeUs();
+        const Cache& cache=getCache(us/1000000);
+        if(digits_.empty()){
+            os.write(cache.buf,cache.len);
+            return ;
+        }
+        // 秒以上的部分不变，只填入亚秒的数字
+        char buf[sizeof(cache.buf)];
+        memcpy(buf,cache.buf,cache.len);
+        uint32_t sub=us%1000000;
+        for(size_t i=0;i<digits_.size();++i){
+            // 格式化结果被截断
+            if(cache.offsets[i]+digits_[i]>cache.len){
+                break;
+            }
+            uint32_t v=3==digits_[i]?sub/1000:sub;
+            char* p=buf+cache.offsets[i]+digits_[i];
+            for(int j=0;j<digits_[i];++j){
+                *--p='0'+v%10;
+                v/=10;
+            }
+        }
+        os.write(buf,cache.len);
+    }
+
+private:
+    static const size_t MAX_SUBSEC=4; // 最多支持的亚秒格式数
+    static const size_t CACHE_COUNT=4; // 每个线程缓存的格式数
+
+    /**
+     * @brief 线程本地的格式化结果，秒变化时才重新格式化
+     */
+    struct Cache{
+        uint64_t id=0; // 所属的格式项
+        time_t sec=-1; // 格式化的秒
+        char buf[128]; // 格式化结果，亚秒部分待填充
+        size_t len=0; // 结果长度
+        size_t offsets[MAX_SUBSEC]; // 亚秒数字在结果中的位置
+    };
+
+    // 获取当前线程本格式项在sec秒的缓存
+    const Cache& getCache(time_t sec){
+        static thread_local Cache t_caches[CACHE_COUNT];
+        static thread_local size_t t_next=0;
+        Cache* cache=nullptr;
+        for(auto& it: t_caches){
+            if(it.id==id_){
+                cache=&it;
+                break;
+            }
+        }
+        if(!cache){
+            cache=&t_caches[t_next++%CACHE_COUNT];
+            cache->id=id_;
+            cache->sec=-1;
+        }
+        if(cache->sec!=sec){
+            refresh(*cache,sec);
+        }
+        return *cache;
+    }
+
+    // 重新格式化秒以上的部分
+    void refresh(Cache& cache,time_t sec){
         struct tm tm;
-        time_t time=event->getTime();
-        localtime_r(&time,&tm);
-        char buf[64];
-        strftime(buf,sizeof(buf),pattern_.c_str(),&tm);
-        os<<buf;
+        localtime_r(&sec,&tm);
+        cache.sec=sec;
+        cache.len=0;
+        for(size_t i=0;i<segments_.size();++i){
+            if(!segments_[i].empty()){
+                cache.len+=strftime(cache.buf+cache.len,sizeof(cache.buf)-cache.len,segments_[i].c_str(),&tm);
+            }
+            if(i<digits_.size()){
+                size_t n=std::min<size_t>(digits_[i],sizeof(cache.buf)-cache.len);
+                cache.offsets[i]=cache.len;
+                memset(cache.buf+cache.len,'0',n);
+                cache.len+=n;
+            }
+        }
     }
+
 private:
+    static std::atomic<uint64_t> s_nextId; // 格式项的唯一id
     std::string pattern_;
+    uint64_t id_; // 区分线程缓存属于哪个格式项
+    std::vector<std::string> segments_; // 亚秒格式之间的strftime格式
+    std::vector<int> digits_; // 每个亚秒格式的位数
 };
 
+std::atomic<uint64_t> DateTimeFormatItem::s_nextId={0};
+
 // 线程名
 class ThreadNameFormatItem: public LogFormatter::FormatItem{
 public:
@@ -302,7 +1083,7 @@ public:
     }
 
     void format(std::ostream& os,std::shared_ptr<Logger> logger,LogLevel::Level level,LogEvent::ptr event) override{
-        os<<event->getContext();
+        os.write(event->getData(),event->getSize());
     }
 private:
     std::string m_string;
@@ -454,6 +1235,7 @@ void LogFormatter::init(){
         XX(T, TabFormatItem),
         XX(F, FiberIDFormatItem),
         XX(N, ThreadNameFormatItem),
+        XX(R, RequestIdFormatItem),
 #undef XX
     };
 
@@ -485,10 +1267,11 @@ void LogManager::init(){
     root_->addAppender(LogAppender::ptr(new StdOutLogAppender()));
     // 相对路径
     root_->addAppender(LogAppender::ptr(new FileLogAppender("./logs/log.txt")));
+    loggers_[root_->getName()]=root_;
 }
 
 Logger::ptr LogManager::getLogger(const std::string& name){
-    // TODO
+    Mutex::Lock lock(mutex_);
     auto it = loggers_.find(name);
     if(it != loggers_.end()){
         return it->second;
@@ -501,4 +1284,214 @@ Logger::ptr LogManager::getLogger(const std::string& name){
     return logger;
 }   
 
-}
\ No newline at end of file
+/**
+ * @brief 输出器配置
+ */
+struct LogAppenderDefine{
+    std::string type; // StdoutLogAppender, FileLogAppender, RotatingFileLogAppender
+    LogLevel::Level level=LogLevel::UNKNOWN; // 级别，UNKNOWN表示不限制
+    std::string formatter; // 格式，为空使用日志器的格式
+    std::string file; // 文件路径
+    uint64_t maxSize=0; // 滚动的文件大小，0表示不按大小滚动
+    bool hourly=false; // 是否每小时滚动
+    uint32_t maxFiles=10; // 保留的历史文件数
+    bool async=false; // 是否用AsyncLogAppender包装
+
+    bool operator==(const LogAppenderDefine& oth) const{
+        return type==oth.type&&level==oth.level&&formatter==oth.formatter
+            &&file==oth.file&&maxSize==oth.maxSize&&hourly==oth.hourly
+            &&maxFiles==oth.maxFiles&&async==oth.async;
+    }
+};
+
+/**
+ * @brief 日志器配置
+ */
+struct LogDefine{
+    std::string name; // 名称
+    LogLevel::Level level=LogLevel::UNKNOWN; // 级别
+    std::string formatter; // 格式
+    std::vector<LogAppenderDefine> appenders; // 输出器
+
+    bool operator==(const LogDefine& oth) const{
+        return name==oth.name&&level==oth.level&&formatter==oth.formatter
+            &&appenders==oth.appenders;
+    }
+};
+
+/**
+ * @brief 模版特化(YAML String 转换成 LogDefine)
+ */
+template<>
+class LexicalCast<std::string,LogDefine>{
+public:
+    LogDefine operator()(const std::string& v){
+        YAML::Node node=YAML::Load(v);
+        LogDefine ld;
+        if(!node["name"].IsDefined()){
+            throw std::logic_error("log config name is null");
+        }
+        ld.name=node["name"].as<std::string>();
+        if(node["level"].IsDefined()){
+            ld.level=LogLevel::FromString(node["level"].as<std::string>());
+        }
+        if(node["formatter"].IsDefined()){
+            ld.formatter=node["formatter"].as<std::string>();
+        }
+        if(node["appenders"].IsDefined()){
+            for(size_t i=0;i<node["appenders"].size();++i){
+                auto a=node["appenders"][i];
+                if(!a["type"].IsDefined()){
+                    throw std::logic_error("log appender type is null");
+                }
+                LogAppenderDefine lad;
+                lad.type=a["type"].as<std::string>();
+                if(a["level"].IsDefined()){
+                    lad.level=LogLevel::FromString(a["level"].as<std::string>());
+                }
+                if(a["formatter"].IsDefined()){
+                    lad.formatter=a["formatter"].as<std::string>();
+                }
+                if(a["file"].IsDefined()){
+                    lad.file=a["file"].as<std::string>();
+                }
+                if(a["max_size"].IsDefined()){
+                    lad.maxSize=a["max_size"].as<uint64_t>();
+                }
+                if(a["hourly"].IsDefined()){
+                    lad.hourly=a["hourly"].as<bool>();
+                }
+                if(a["max_files"].IsDefined()){
+                    lad.maxFiles=a["max_files"].as<uint32_t>();
+                }
+                if(a["async"].IsDefined()){
+                    lad.async=a["async"].as<bool>();
+                }
+                if(("FileLogAppender"==lad.type||"RotatingFileLogAppender"==lad.type)&&lad.file.empty()){
+                    throw std::logic_error("log appender file is null");
+                }
+                ld.appenders.push_back(lad);
+            }
+        }
+        return ld;
+    }
+};
+
+/**
+ * @brief 模版特化(LogDefine 转换成 YAML String)
+ */
+template<>
+class LexicalCast<LogDefine,std::string>{
+public:
+    std::string operator()(const LogDefine& v){
+        YAML::Node node;
+        node["name"]=v.name;
+        if(LogLevel::UNKNOWN!=v.level){
+            node["level"]=LogLevel::ToString(v.level);
+        }
+        if(!v.formatter.empty()){
+            node["formatter"]=v.formatter;
+        }
+        for(auto& a: v.appenders){
+            YAML::Node na;
+            na["type"]=a.type;
+            if(LogLevel::UNKNOWN!=a.level){
+                na["level"]=LogLevel::ToString(a.level);
+            }
+            if(!a.formatter.empty()){
+                na["formatter"]=a.formatter;
+            }
+            if(!a.file.empty()){
+                na["file"]=a.file;
+            }
+            if("RotatingFileLogAppender"==a.type){
+                na["max_size"]=a.maxSize;
+                na["hourly"]=a.hourly;
+                na["max_files"]=a.maxFiles;
+            }
+            if(a.async){
+                na["async"]=true;
+            }
+            node["appenders"].push_back(na);
+        }
+        std::stringstream ss;
+        ss<<node;
+        return ss.str();
+    }
+};
+
+// 日志配置
+static ConfigVar<std::vector<LogDefine>>::ptr g_log_defines=
+    Config::LookUp("logs",std::vector<LogDefine>(),"logs config");
+
+/**
+ * @brief 根据配置创建输出器
+ */
+static LogAppender::ptr CreateAppender(const LogAppenderDefine& a){
+    LogAppender::ptr ap;
+    if("StdoutLogAppender"==a.type){
+        ap.reset(new StdOutLogAppender());
+    }else if("FileLogAppender"==a.type){
+        ap.reset(new FileLogAppender(a.file));
+    }else if("RotatingFileLogAppender"==a.type){
+        ap.reset(new RotatingFileLogAppender(a.file,a.maxSize,a.hourly,a.maxFiles));
+    }else{
+        std::cerr<<"log appender type invalid: "<<a.type<<std::endl;
+        return nullptr;
+    }
+    if(LogLevel::UNKNOWN!=a.level){
+        ap->setLevel(a.level);
+    }
+    if(!a.formatter.empty()){
+        LogFormatter::ptr fmt(new LogFormatter(a.formatter));
+        if(fmt->isError()){
+            std::cerr<<"log appender formatter invalid: "<<a.formatter<<std::endl;
+        }else{
+            ap->setLogFormatter(fmt);
+        }
+    }
+    if(a.async){
+        ap.reset(new AsyncLogAppender(ap));
+    }
+    return ap;
+}
+
+/**
+ * @brief 监听日志配置的变化，重建日志器的输出器
+ */
+struct LogIniter{
+    LogIniter(){
+        g_log_defines->addCallBack([](const std::vector<LogDefine>& oldVal,const std::vector<LogDefine>& newVal){
+            for(auto& ld: newVal){
+                Logger::ptr logger=FOCUS_LOG_NAME(ld.name);
+                logger->setLevel(LogLevel::UNKNOWN==ld.level?LogLevel::DEBUG:ld.level);
+                if(!ld.formatter.empty()){
+                    logger->setLogFormatter(ld.formatter);
+                }
+                logger->clearAppenders();
+                for(auto& a: ld.appenders){
+                    LogAppender::ptr ap=CreateAppender(a);
+                    if(ap){
+                        logger->addAppender(ap);
+                    }
+                }
+            }
+            // 删除的日志器恢复默认输出
+            for(auto& ld: oldVal){
+                auto it=std::find_if(newVal.begin(),newVal.end(),[&ld](const LogDefine& v){
+                    return v.name==ld.name;
+                });
+                if(newVal.end()==it){
+                    Logger::ptr logger=FOCUS_LOG_NAME(ld.name);
+                    logger->setLevel(LogLevel::DEBUG);
+                    logger->clearAppenders();
+                    logger->addAppender(LogAppender::ptr(new StdOutLogAppender()));
+                }
+            }
+        });
+    }
+};
+
+static LogIniter s_log_initer;
+
+}
@@ -9,15 +9,18 @@
 #include <stdint.h>
 #include <map>
 #include <fstream>
+#include <atomic>
+#include <sys/uio.h>
 
 #include "singleton.h"
 #include "util.h"
 #include "thread.h"
+#include "mpscqueue.h"
 
-// 日志流式输出
+// 日志流式输出，先判断级别，被过滤的日志不会构造日志事件
 #define FOCUS_LOG_LEVEL(logger,level) \
     if(level>=logger->getLevel())     \
-    focus::LogEventWrap(focus::LogEvent::ptr(new focus::LogEvent(logger,__FILE__,__LINE__,0,focus::GetThreadId(),focus::GetFiberId(),time(0),focus::Thread::GetName(),level))).getSS()
+    focus::LogEventWrap(focus::LogEvent::Create(logger,__FILE__,__LINE__,0,focus::GetThreadId(),focus::GetFiberId(),focus::GetCurrentUS(),focus::Thread::GetName(),level)).getSS()
 
 #define FOCUS_LOG_DEBUG(logger) FOCUS_LOG_LEVEL(logger,focus::LogLevel::DEBUG)
 #define FOCUS_LOG_INFO(logger) FOCUS_LOG_LEVEL(logger,focus::LogLevel::INFO)
@@ -28,7 +31,7 @@
 // 日志格式化输出
 #define FOCUS_LOG_FMT_LEVEL(logger,level,fmt,...) \
     if(level>=logger->getLevel())                 \
-    focus::LogEventWrap(focus::LogEvent::ptr(new focus::LogEvent(logger,__FILE__,__LINE__,0,focus::GetThreadId(),focus::GetFiberId(),time(0),focus::Thread::GetName(),level))).getEvent()->format(fmt,##__VA_ARGS__)
+    focus::LogEventWrap(focus::LogEvent::Create(logger,__FILE__,__LINE__,0,focus::GetThreadId(),focus::GetFiberId(),focus::GetCurrentUS(),focus::Thread::GetName(),level)).getEvent()->format(fmt,##__VA_ARGS__)
 
 #define FOCUS_LOG_FMT_DEBUG(logger,fmt,...) FOCUS_LOG_FMT_LEVEL(logger,focus::LogLevel::DEBUG,fmt,##__VA_ARGS__)
 #define FOCUS_LOG_FMT_INFO(logger,fmt,...) FOCUS_LOG_FMT_LEVEL(logger,focus::LogLevel::INFO,fmt,##__VA_ARGS__)
@@ -64,14 +67,60 @@ public:
     static LogLevel::Level FromString(const std::string& s);
 };
 
+/**
+ * @brief 日志消息缓冲区
+ * @details 消息先写入内联缓冲区，超出后才转存到std::string，
+ *          大部分日志不需要申请堆内存
+ */
+class LogStreamBuf: public std::streambuf{
+public:
+    static const size_t INLINE_SIZE=512; // 内联缓冲区大小
+
+    LogStreamBuf(){
+        setp(inline_,inline_+INLINE_SIZE);
+    }
+
+    // 清空内容，复用缓冲区
+    void reset(){
+        overflow_.clear();
+        spilled_=false;
+        setp(inline_,inline_+INLINE_SIZE);
+    }
+
+    const char* data() const {return spilled_?overflow_.data():pbase();}
+    size_t size() const {return spilled_?overflow_.size():(size_t)(pptr()-pbase());}
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s,std::streamsize n) override;
+
+private:
+    // 内联缓冲区用完，转存到overflow_
+    void spill();
+
+private:
+    char inline_[INLINE_SIZE]; // 内联缓冲区
+    std::string overflow_; // 超出内联缓冲区后的存储
+    bool spilled_=false; // 是否已经转存
+};
+
 // 日志事件
 class LogEvent{
 public:
     using ptr=std::shared_ptr<LogEvent>;
 
+    // time为微秒级时间戳
     LogEvent(std::shared_ptr<Logger> logger,const char* file,int32_t line,uint32_t elapse,uint32_t threadId,
             uint32_t fiberId,uint64_t time,const std::string& threadName,LogLevel::Level level);
 
+    /**
+     * @brief 从当前线程的日志事件池创建日志事件
+     * @details 日志事件和shared_ptr的控制块在同一块内存中，
+     *          释放后回到创建线程的池中复用
+     */
+    static LogEvent::ptr Create(std::shared_ptr<Logger> logger,const char* file,int32_t line,uint32_t elapse,uint32_t threadId,
+            uint32_t fiberId,uint64_t time,const std::string& threadName,LogLevel::Level level);
+
     std::shared_ptr<Logger> getLogger() {return logger_;}
 
     const char* getFile() const {return file_;}
@@ -84,15 +133,38 @@ public:
     
     uint32_t getFiberId() const {return fiberId_;}
     
-    uint64_t getTime() const {return time_;}
+    // 秒级时间戳
+    uint64_t getTime() const {return time_/1000000;}
+
+    // 微秒级时间戳
+    uint64_t getTimeUs() const {return time_;}
     
-    std::string getThreadName() const {return threadName_;}
+    const char* getThreadName() const {return threadName_;}
+
+    // 创建时所在协程的请求id
+    const char* getRequestId() const {return requestId_;}
 
     LogLevel::Level getLevel() const {return level_;}
     
-    std::string getContext() const {return ss_.str();}
+    std::string getContext() const {return std::string(buf_.data(),buf_.size());}
+
+    // 消息内容，不拷贝
+    const char* getData() const {return buf_.data();}
+    size_t getSize() const {return buf_.size();}
     
-    std::stringstream& getSS() {return ss_;}
+    // 消息缓冲区
+    LogStreamBuf* getBuf() {return &buf_;}
+
+    /**
+     * @brief 获取绑定到本事件消息缓冲区的流
+     * @details 流是线程本地的，避免每条日志构造std::ostream，
+     *          返回前会重置格式状态
+     * @param[out] prev 绑定前的流缓冲区
+     */
+    std::ostream& getSS(std::streambuf** prev=nullptr);
+
+    // 获取线程本地的日志流
+    static std::ostream& GetThreadStream();
 
     void format(const char* fmt,...);
 
@@ -105,10 +177,11 @@ private:
     uint32_t elapse_=0; //启动的毫秒数
     uint32_t threadId_=0; //线程ID
     uint32_t fiberId_=0; //协程ID
-    uint64_t time_=0; //时间戳
-    std::string threadName_; //线程名
+    uint64_t time_=0; //时间戳(微秒)
+    char threadName_[32]; //线程名
+    char requestId_[64]; //请求id
     LogLevel::Level level_; //当前日志级别
-    std::stringstream ss_; //日志流
+    LogStreamBuf buf_; //消息缓冲区
 };
 
 // 日志格式化器
@@ -126,12 +199,13 @@ public:
      *  %c 日志名称
      *  %t 线程id
      *  %n 换行
-     *  %d 时间
+     *  %d 时间，格式同strftime，另外支持%L(毫秒)和%f(微秒)
      *  %f 文件名
      *  %l 行号
      *  %T 制表符
      *  %F 协程id
      *  %N 线程名称
+     *  %R 请求id，通过SetLogRequestId设置
      *
      *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
      */
@@ -166,14 +240,22 @@ public:
 
     virtual ~LogAppender(){}
 
-    void setLogFormatter(LogFormatter::ptr val) {logformatter_=val;}
+    virtual void setLogFormatter(LogFormatter::ptr val) {logformatter_=val;}
+    LogFormatter::ptr getLogFormatter() const {return logformatter_;}
     void setLevel(LogLevel::Level val) {level_=val;}
+    LogLevel::Level getLevel() const {return level_;}
     bool isEmpty() {return logformatter_==nullptr;}
 
     virtual void log(std::shared_ptr<Logger> logger,LogLevel::Level level,LogEvent::ptr event)=0;
 
+    /**
+     * @brief 批量输出已经格式化的日志
+     * @return 不支持批量输出返回false，由调用者逐条调用log
+     */
+    virtual bool writeBatch(const struct iovec* iov,int cnt) {return false;}
+
 protected:
-    LogLevel::Level level_; //日志级别
+    LogLevel::Level level_=LogLevel::DEBUG; //日志级别
     LogFormatter::ptr logformatter_=nullptr; //日志格式器
     MutexType mutex_; // 锁
 };
@@ -212,6 +294,7 @@ private:
     std::string name_; //名字
     LogLevel::Level level_; //当前日志器支持的最低日志级别
     std::list<LogAppender::ptr> appenders_; //多处输出地
+    RWMutex mutex_; //保护appenders_，配置变化时会修改
     LogFormatter::ptr logformatter_; //日志格式器
 };
 
@@ -220,6 +303,13 @@ class LogEventWrap{
 public:
     LogEventWrap(LogEvent::ptr event):event_(event){}
     ~LogEventWrap(){
+        // 恢复外层日志的流绑定(流表达式中嵌套输出日志时)
+        if(ss_){
+            ss_->rdbuf(prevBuf_);
+            ss_->flags(prevFlags_);
+            ss_->fill(prevFill_);
+            ss_->precision(prevPrecision_);
+        }
         event_->getLogger()->log(event_->getLevel(),event_);
     }
 
@@ -227,18 +317,29 @@ public:
         return event_;
     }
 
-    std::stringstream& getSS(){
-        return event_->getSS();
+    std::ostream& getSS(){
+        std::ostream& os=LogEvent::GetThreadStream();
+        prevFlags_=os.flags();
+        prevFill_=os.fill();
+        prevPrecision_=os.precision();
+        ss_=&event_->getSS(&prevBuf_);
+        return *ss_;
     }
 
 private:
     LogEvent::ptr event_;
+    std::ostream* ss_=nullptr; // 绑定的线程本地流
+    std::streambuf* prevBuf_=nullptr; // 绑定前的流缓冲区
+    std::ios_base::fmtflags prevFlags_; // 绑定前的格式
+    char prevFill_=' '; // 绑定前的填充字符
+    std::streamsize prevPrecision_=6; // 绑定前的精度
 };
 
 // 控制台输出器
 class StdOutLogAppender:public LogAppender{
 public:
     void log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event) override;
+    bool writeBatch(const struct iovec* iov,int cnt) override;
 };
 
 // 文件输出器
@@ -250,10 +351,131 @@ public:
     bool reopen();
 
     void log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event) override;
+    bool writeBatch(const struct iovec* iov,int cnt) override;
 
 private:
     std::string file_;
-    std::ofstream ofs;
+    int fd_=-1; // 以追加方式打开的文件
+};
+
+/**
+ * @brief 滚动文件输出器
+ * @details 按大小和/或按小时滚动，保留file.1 ~ file.N共N个历史文件。
+ *          日志写入按块扩展的内存映射区域，稳定状态下不调用write，
+ *          文件尾部预留的空间在关闭或滚动时截掉
+ */
+class RotatingFileLogAppender: public LogAppender{
+public:
+    using ptr=std::shared_ptr<RotatingFileLogAppender>;
+
+    /**
+     * @brief 构造函数
+     * @param[in] file 文件路径
+     * @param[in] maxSize 单个文件的最大字节数，0表示不按大小滚动
+     * @param[in] hourly 是否每小时滚动
+     * @param[in] maxFiles 保留的历史文件数
+     * @param[in] chunkSize 每次扩展映射的字节数
+     */
+    RotatingFileLogAppender(const std::string& file,uint64_t maxSize=0,bool hourly=false,
+        uint32_t maxFiles=10,size_t chunkSize=1<<20);
+    ~RotatingFileLogAppender();
+
+    void log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event) override;
+    bool writeBatch(const struct iovec* iov,int cnt) override;
+
+    // 立即滚动
+    bool rotate();
+
+    // 当前文件已写入的字节数
+    uint64_t getSize() const {return size_;}
+
+private:
+    // 打开文件并映射写入位置，需要持有锁
+    bool open();
+    // 解除映射，截掉预留空间并关闭文件，需要持有锁
+    void close();
+    // 重命名历史文件并重新打开，需要持有锁
+    bool rotateLocked();
+    // 映射下一块，需要持有锁
+    bool mapNext();
+    // 写入一段数据，需要持有锁
+    bool append(const char* data,size_t len);
+    // 写入前检查是否需要滚动
+    void checkRotate(size_t len);
+
+private:
+    std::string file_; // 文件路径
+    uint64_t maxSize_; // 单个文件的最大字节数
+    bool hourly_; // 是否每小时滚动
+    uint32_t maxFiles_; // 保留的历史文件数
+    size_t chunkSize_; // 每次扩展映射的字节数
+    int fd_=-1; // 文件描述符
+    char* map_=nullptr; // 当前映射的区域
+    uint64_t mapOffset_=0; // 映射区域在文件中的偏移
+    size_t mapPos_=0; // 映射区域中的写入位置
+    uint64_t size_=0; // 文件已写入的字节数
+    time_t nextRotate_=0; // 下一次按小时滚动的时间
+};
+
+/**
+ * @brief 异步日志输出器
+ * @details 包装任意输出器，日志事件放入有界无锁队列，
+ *          由后台线程批量格式化，并通过被包装输出器的writeBatch(writev)输出
+ */
+class AsyncLogAppender: public LogAppender{
+public:
+    using ptr=std::shared_ptr<AsyncLogAppender>;
+
+    /**
+     * @brief 队列满时的处理策略
+     */
+    enum OverflowPolicy{
+        BLOCK=0, // 等待队列有空间
+        DROP, // 丢弃
+        DROP_BELOW // 丢弃低于dropLevel的日志，其余等待
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] appender 被包装的输出器
+     * @param[in] capacity 队列容量
+     * @param[in] policy 队列满时的处理策略
+     * @param[in] dropLevel DROP_BELOW时丢弃低于该级别的日志
+     * @param[in] batchSize 每批最多输出的日志数
+     */
+    AsyncLogAppender(LogAppender::ptr appender,size_t capacity=8192,
+        OverflowPolicy policy=BLOCK,LogLevel::Level dropLevel=LogLevel::WARN,
+        size_t batchSize=256);
+
+    /**
+     * @brief 析构函数，输出剩余的日志后停止后台线程
+     */
+    ~AsyncLogAppender();
+
+    void setLogFormatter(LogFormatter::ptr val) override;
+
+    void log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event) override;
+
+    /**
+     * @brief 等待已经提交的日志全部输出
+     * @attention 队列中的日志事件持有日志器，日志器持有输出器，
+     *            进程退出前需要调用flush保证日志不丢失
+     */
+    void flush();
+
+    // 获取被包装的输出器
+    LogAppender::ptr getAppender() const;
+
+    // 获取丢弃的日志总数
+    uint64_t getDropped() const;
+
+    // 获取某个级别丢弃的日志数
+    uint64_t getDropped(LogLevel::Level level) const;
+
+private:
+    struct Core;
+    std::shared_ptr<Core> core_; // 队列和后台线程共享的状态
+    Thread::ptr thread_; // 后台线程
 };
  
 // 日志管理器
@@ -271,10 +493,17 @@ public:
 private:
     std::map<std::string,Logger::ptr> loggers_;
     Logger::ptr root_;
+    Mutex mutex_; // 保护loggers_
 };
 
 using LoggerMgr=Singleton<LogManager>;
 
+// 设置当前协程的请求id，保存在协程局部变量中，协程结束后清除，格式化时用%R输出
+void SetLogRequestId(const std::string& id);
+
+// 获取当前协程的请求id，没有设置返回空串
+std::string GetLogRequestId();
+
 }
 
 #endif
\ No newline at end of file
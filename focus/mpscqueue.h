@@ -0,0 +1,130 @@
+#ifndef __FOCUS_MPSCQUEUE_H__
+#define __FOCUS_MPSCQUEUE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "nocopyable.h"
+
+namespace focus {
+
+/**
+ * @brief 有界无锁多生产者单消费者队列
+ * @tparam T 元素类型，需要可默认构造和移动
+ * @details 每个槽带一个序号，生产者通过CAS抢占写位置，
+ *          序号表示槽是否可写/可读，不需要额外的锁
+ */
+template<class T>
+class MpscQueue: public Nocopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量，会向上取整到2的幂
+     */
+    MpscQueue(size_t capacity = 1024) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_mask = cap - 1;
+        m_cells = new Cell[cap];
+        for(size_t i = 0; i < cap; ++i) {
+            m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 析构函数
+     */
+    ~MpscQueue() {
+        delete[] m_cells;
+    }
+
+    /**
+     * @brief 获取容量
+     */
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+    /**
+     * @brief 获取元素个数(近似值)
+     */
+    size_t size() const {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        return tail > head? (size_t)(tail - head): 0;
+    }
+
+    /**
+     * @brief 是否为空(近似值)
+     */
+    bool empty() const {
+        return 0 == size();
+    }
+
+    /**
+     * @brief 入队，可由任意线程调用
+     * @return 队列已满返回false，v不会被移动
+     */
+    bool push(T& v) {
+        uint64_t pos = m_tail.load(std::memory_order_relaxed);
+        while(true) {
+            Cell& cell = m_cells[pos & m_mask];
+            uint64_t seq = cell.m_seq.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)seq - (int64_t)pos;
+            if(0 == diff) {
+                // 槽可写，抢占写位置
+                if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.m_value = std::move(v);
+                    cell.m_seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }else if(diff < 0) {
+                // 槽还没被消费，队列已满
+                return false;
+            }else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief 出队，只能由消费者线程调用
+     * @return 队列为空返回false
+     */
+    bool pop(T& v) {
+        uint64_t pos = m_head.load(std::memory_order_relaxed);
+        Cell& cell = m_cells[pos & m_mask];
+        uint64_t seq = cell.m_seq.load(std::memory_order_acquire);
+        if(seq != pos + 1) {
+            return false;
+        }
+        v = std::move(cell.m_value);
+        cell.m_value = T();
+        // 槽在下一圈可写
+        cell.m_seq.store(pos + m_mask + 1, std::memory_order_release);
+        m_head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    /**
+     * @brief 队列的槽
+     */
+    struct Cell {
+        std::atomic<uint64_t> m_seq = {0}; // 序号
+        T m_value; // 元素
+    };
+
+private:
+    alignas(64) std::atomic<uint64_t> m_tail = {0}; // 生产者写位置
+    alignas(64) std::atomic<uint64_t> m_head = {0}; // 消费者读位置
+    Cell* m_cells = nullptr; // 环形缓冲区
+    size_t m_mask = 0; // 容量掩码
+};
+
+} // end namespace focus
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef __FOCUS_PAGETABLE_H__
+#define __FOCUS_PAGETABLE_H__
+
+#include <atomic>
+#include <cstddef>
+#include "mutex.h"
+#include "nocopyable.h"
+
+namespace focus {
+
+/**
+ * @brief 按下标分页的表，页和目录都只增不减
+ * @tparam T 元素类型，需要默认构造
+ * @tparam SHIFT 每页元素数量的位数
+ * @details 读取只有目录和页两次原子读，不加锁；
+ *          分配页和扩大目录加锁，扩大时复制已有页的指针后发布新的目录，
+ *          旧的目录保留到析构，还在使用旧目录的读者不受影响
+ */
+template<class T, size_t SHIFT = 8>
+class PageTable: public Nocopyable {
+public:
+    static const size_t PAGE_SIZE = (size_t)1 << SHIFT; // 每页元素数量
+
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 初始的元素容量，超过后目录自动扩大
+     */
+    PageTable(size_t capacity = 1024) {
+        size_t count = (capacity + PAGE_SIZE - 1) >> SHIFT;
+        m_dir.store(newDirectory(count? count: 1, nullptr), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 析构函数，释放所有页和目录
+     */
+    ~PageTable() {
+        Directory* dir = m_dir.load(std::memory_order_acquire);
+        // 最新的目录包含所有的页
+        for(size_t i = 0; i < dir->m_count; ++i) {
+            delete[] dir->m_pages[i].load(std::memory_order_relaxed);
+        }
+        while(dir) {
+            Directory* prev = dir->m_prev;
+            delete[] dir->m_pages;
+            delete dir;
+            dir = prev;
+        }
+    }
+
+    /**
+     * @brief 获取元素，不加锁
+     * @return 所在的页还没有分配返回nullptr，返回的指针一直有效
+     */
+    T* get(size_t index) const {
+        Directory* dir = m_dir.load(std::memory_order_acquire);
+        size_t page = index >> SHIFT;
+        if(page >= dir->m_count) {
+            return nullptr;
+        }
+        T* items = dir->m_pages[page].load(std::memory_order_acquire);
+        return items? &items[index & (PAGE_SIZE - 1)]: nullptr;
+    }
+
+    /**
+     * @brief 获取元素，所在的页不存在时分配
+     * @param[in] index 下标
+     * @param[in] init 新页发布前的初始化函数 void(T* page, size_t first)，first为页首的下标
+     */
+    template<class Init>
+    T* getOrCreate(size_t index, Init init) {
+        T* item = get(index);
+        if(item) {
+            return item;
+        }
+        size_t page = index >> SHIFT;
+        MutexType::Lock lock(m_mutex);
+        Directory* dir = m_dir.load(std::memory_order_relaxed);
+        if(page >= dir->m_count) {
+            // 扩大目录，至少翻倍
+            size_t count = dir->m_count * 2;
+            while(count <= page) {
+                count *= 2;
+            }
+            dir = newDirectory(count, dir);
+            m_dir.store(dir, std::memory_order_release);
+        }
+        T* items = dir->m_pages[page].load(std::memory_order_relaxed);
+        if(!items) {
+            items = new T[PAGE_SIZE];
+            init(items, page << SHIFT);
+            dir->m_pages[page].store(items, std::memory_order_release);
+        }
+        return &items[index & (PAGE_SIZE - 1)];
+    }
+
+    /**
+     * @brief 获取元素，所在的页不存在时分配
+     */
+    T* getOrCreate(size_t index) {
+        return getOrCreate(index, [](T*, size_t){});
+    }
+
+    /**
+     * @brief 获取当前的元素容量
+     */
+    size_t capacity() const {
+        return m_dir.load(std::memory_order_acquire)->m_count << SHIFT;
+    }
+
+private:
+    using MutexType = Mutex;
+
+    /**
+     * @brief 页目录
+     */
+    struct Directory {
+        size_t m_count = 0; // 页数
+        std::atomic<T*>* m_pages = nullptr; // 页指针
+        Directory* m_prev = nullptr; // 被替换的旧目录
+    };
+
+    /**
+     * @brief 分配目录，复制旧目录中的页，持有锁或构造时调用
+     */
+    static Directory* newDirectory(size_t count, Directory* prev) {
+        Directory* dir = new Directory;
+        dir->m_count = count;
+        dir->m_pages = new std::atomic<T*>[count];
+        for(size_t i = 0; i < count; ++i) {
+            T* items = prev && i < prev->m_count? prev->m_pages[i].load(std::memory_order_relaxed): nullptr;
+            dir->m_pages[i].store(items, std::memory_order_relaxed);
+        }
+        dir->m_prev = prev;
+        return dir;
+    }
+
+private:
+    std::atomic<Directory*> m_dir = {nullptr}; // 当前的目录
+    MutexType m_mutex; // 分配页和扩大目录的锁
+};
+
+} // end namespace focus
+
+#endif
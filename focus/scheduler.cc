@@ -1,16 +1,46 @@
 #include "scheduler.h"
 #include "macro.h"
 #include "hook.h"
+#include "config.h"
 
 namespace focus {
 
 // 全局的日志器
 static Logger::ptr g_logger = FOCUS_LOG_NAME("system");
 
+// 每个调度线程本地队列的容量
+static ConfigVar<uint32_t>::ptr g_scheduler_local_queue_size =
+    Config::LookUp<uint32_t>("scheduler.local_queue_size", 256, "scheduler local queue size");
+
+// 每个调度线程缓存的回调协程上限
+static ConfigVar<uint32_t>::ptr g_scheduler_fiber_cache_size =
+    Config::LookUp<uint32_t>("scheduler.fiber_cache_size", 32, "scheduler callback fiber cache size per thread");
+
+// 缓存多久没有使用后，空闲时开始释放(毫秒)
+static ConfigVar<uint32_t>::ptr g_scheduler_fiber_cache_idle_ms =
+    Config::LookUp<uint32_t>("scheduler.fiber_cache_idle_ms", 1000, "scheduler callback fiber cache idle trim ms");
+
+// 各优先级的调度权重(高，普通，后台)，同时有任务时按权重比例轮流执行
+static ConfigVar<std::vector<uint32_t>>::ptr g_scheduler_priority_weights =
+    Config::LookUp("scheduler.priority_weights", std::vector<uint32_t>{8, 4, 1},
+                   "scheduler weights of high, normal and background priority");
+
+// 每个调度线程绑定的CPU列表，按线程顺序循环使用，如["0-3", "4-7"]
+static ConfigVar<std::vector<std::string>>::ptr g_scheduler_cpu_sets =
+    Config::LookUp("scheduler.cpu_sets", std::vector<std::string>(), "scheduler thread cpu sets");
+
+// 没有配置cpu_sets时，是否自动把调度线程分散绑定到各NUMA节点的物理核上
+static ConfigVar<bool>::ptr g_scheduler_auto_affinity =
+    Config::LookUp("scheduler.auto_affinity", false, "scheduler spread threads across numa nodes and cores");
+
 // 当前线程的调度器实例
 static thread_local Scheduler* t_scheduler = nullptr;
 // 当前线程的调度协程
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+// 当前线程在调度器中的队列下标
+static thread_local int t_worker_index = -1;
+// 当前线程是否正在执行内联任务
+static thread_local bool t_inline_task = false;
 
 Scheduler::Scheduler(size_t threads, bool useCaller, const std::string name) {
     // 判断线程数
@@ -19,6 +49,19 @@ Scheduler::Scheduler(size_t threads, bool useCaller, const std::string name) {
     m_useCaller = useCaller;
     m_name = name;
 
+    // 每个调度线程(包括caller线程)一个任务队列
+    m_localQueueSize = g_scheduler_local_queue_size->getVal();
+    for(size_t i = 0; i < threads; ++i) {
+        m_workers.emplace_back(new Worker(m_localQueueSize));
+    }
+    m_fiberCacheCap = g_scheduler_fiber_cache_size->getVal();
+    m_fiberCacheIdleMs = g_scheduler_fiber_cache_idle_ms->getVal();
+    // 权重至少为1，保证低优先级不会被饿死
+    std::vector<uint32_t> weights = g_scheduler_priority_weights->getVal();
+    for(int i = 0; i < PRIORITY_COUNT; ++i) {
+        m_weights[i] = i < (int)weights.size() && weights[i] > 0? weights[i]: 1;
+    }
+
     // 如果要当前线程要参与
     if(useCaller) {
         --threads;
@@ -37,6 +80,9 @@ Scheduler::Scheduler(size_t threads, bool useCaller, const std::string name) {
         t_scheduler_fiber = m_rootFiber.get();
         m_rootThread = GetThreadId();
         m_threadIds.emplace_back(m_rootThread);
+        // caller线程使用第一个队列
+        m_workers[0]->m_threadId = m_rootThread;
+        t_worker_index = 0;
     }else {
         m_rootThread = -1;
     }
@@ -49,16 +95,70 @@ Scheduler::~Scheduler() {
     if(GetThis() == this) {
         t_scheduler = nullptr;
     }
+
+    // 释放剩余的任务和队列
+    for(auto& queue: m_queues) {
+        for(auto task: queue.m_tasks) {
+            delete task;
+        }
+        for(auto& i: queue.m_deadlineTasks) {
+            delete i.second;
+        }
+    }
+    for(auto worker: m_workers) {
+        for(auto task: worker->m_pinned) {
+            delete task;
+        }
+        while(ScheduleTask* task = worker->m_local.pop()) {
+            delete task;
+        }
+        delete worker;
+    }
 }
 
 Scheduler* Scheduler::GetThis() {
     return t_scheduler;
 }
 
+bool Scheduler::IsInInlineTask() {
+    return t_inline_task;
+}
+
 Fiber* Scheduler::GetMainFiber() {
     return t_scheduler_fiber;
 }
 
+/**
+ * @brief 根据配置计算每个调度线程绑定的CPU
+ * @param[in] threads 调度线程数，不包括caller线程
+ * @return 不绑定返回空
+ */
+static std::vector<std::vector<int>> GetWorkerCpus(size_t threads) {
+    std::vector<std::vector<int>> result;
+    std::vector<std::string> sets = g_scheduler_cpu_sets->getVal();
+    if(!sets.empty()) {
+        std::vector<std::vector<int>> cpuSets;
+        for(auto& i: sets) {
+            std::vector<int> cpus = ParseCpuList(i);
+            if(cpus.empty()) {
+                FOCUS_LOG_ERROR(g_logger) << "invalid scheduler.cpu_sets item: " << i;
+                return result;
+            }
+            cpuSets.emplace_back(cpus);
+        }
+        for(size_t i = 0; i < threads; ++i) {
+            result.emplace_back(cpuSets[i % cpuSets.size()]);
+        }
+    }else if(g_scheduler_auto_affinity->getVal()) {
+        // 每个线程一个CPU，依次分散到各节点的物理核
+        std::vector<int> cpus = GetSpreadCpus();
+        for(size_t i = 0; i < threads && !cpus.empty(); ++i) {
+            result.emplace_back(1, cpus[i % cpus.size()]);
+        }
+    }
+    return result;
+}
+
 void Scheduler::start() {
     FOCUS_LOG_DEBUG(g_logger) << "start";
     MutexType::Lock lock(m_mutex);
@@ -68,9 +168,39 @@ void Scheduler::start() {
     }
     FOCUS_ASSERT(m_threads.empty());
     m_threads.resize(m_threadCount);
+    // caller线程占用了第一个队列，caller线程不绑定CPU
+    size_t offset = m_useCaller? 1: 0;
+    std::vector<std::vector<int>> placement = GetWorkerCpus(m_threadCount);
+    std::shared_ptr<Semaphore> placed(new Semaphore);
+    std::shared_ptr<Semaphore> started(new Semaphore);
+    size_t pinned = 0;
+    for(size_t i = 0; i < m_threadCount; ++i) {
+        int index = i + offset;
+        std::vector<int> cpus = placement.empty()? std::vector<int>(): placement[i];
+        bool local = !cpus.empty();
+        pinned += local? 1: 0;
+        m_threads[i].reset(new Thread([this, index, local, placed, started](){
+            t_worker_index = index;
+            if(local) {
+                // 已经绑定了CPU，在本节点重新分配任务队列，所有线程分配完成后再开始调度
+                Worker* worker = new Worker(m_localQueueSize);
+                std::swap(worker, m_workers[index]);
+                delete worker;
+                placed->notify();
+                started->wait();
+            }
+            run();
+        }, m_name + "_" + std::to_string(i), cpus));
+    }
+    for(size_t i = 0; i < pinned; ++i) {
+        placed->wait();
+    }
     for(size_t i = 0; i < m_threadCount; ++i) {
-        m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this), m_name + "_" + std::to_string(i)));
         m_threadIds.emplace_back(m_threads[i]->getId());
+        m_workers[i + offset]->m_threadId = m_threads[i]->getId();
+    }
+    for(size_t i = 0; i < pinned; ++i) {
+        started->notify();
     }
 }
 
@@ -130,48 +260,25 @@ void Scheduler::run() {
         t_scheduler_fiber = Fiber::GetThis().get();
     }
 
-    // 存储空闲协程，回调协程
+    // 存储空闲协程
     Fiber::ptr idleFiber(new Fiber(std::bind(&Scheduler::idle, this)));
-    Fiber::ptr cbFiber;
+
+    // 当前线程的任务队列
+    Worker* self = getLocalWorker();
+    FOCUS_ASSERT(self);
 
     // 存储拿到的调度任务
     ScheduleTask task;
     while(true) {
         task.reset();
-        bool tickleMe = false; // 是否tickle其他线程进行调度
-        {
-            MutexType::Lock lock(m_mutex);
-            auto it = m_tasks.begin();
-            // 遍历所有调度任务
-            while(it != m_tasks.end()) {
-                if(it->m_thread != -1 && it->m_thread != GetThreadId()) {
-                    // 指定了线程号，但不是当前线程
-                    ++it;
-                    tickleMe = true;
-                    continue;
-                }
-
-                // 没有实际执行对象
-                FOCUS_ASSERT(it->m_fiber || it->m_cb);
-
-                // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
-                if(it->m_fiber && Fiber::RUNNING == it->m_fiber->getState()) {
-                    ++it;
-                    continue;
-                }
-
-                // 拿到调度任务
-                task = *it;
-                m_tasks.erase(it++);
-                ++m_activeThreadCount;
-                break;
-            }
-            // 当前线程拿完还有任务
-            tickleMe |= (m_tasks.end() != it);
+        ScheduleTask* ptask = takeTask(self);
+        if(ptask) {
+            task = std::move(*ptask);
+            delete ptask;
         }
 
-        // 需要通知
-        if(tickleMe) {
+        // 当前线程拿完还有任务，tickle其他线程进行调度
+        if(m_taskCount > 0) {
             tickle();
         }
 
@@ -181,17 +288,20 @@ void Scheduler::run() {
             task.m_fiber->resume();
             --m_activeThreadCount;
             task.reset();
+        }else if(task.m_cb && task.m_inline) {
+            // 内联任务直接在调度协程上执行
+            t_inline_task = true;
+            task.m_cb();
+            t_inline_task = false;
+            --m_activeThreadCount;
+            task.reset();
         }else if(task.m_cb) {
-            // 将函数包装成协程
-            if(cbFiber) {
-                cbFiber->reset(task.m_cb);
-            }else {
-                cbFiber.reset(new Fiber(task.m_cb));
-            }
+            // 将函数包装成协程，优先复用执行结束的协程
+            Fiber::ptr cbFiber = takeCbFiber(self, task.m_cb);
             task.reset();
             cbFiber->resume();
             --m_activeThreadCount;
-            cbFiber.reset();
+            cacheCbFiber(self, cbFiber);
         }else {
             // 任务队列空
             if(Fiber::TERM == idleFiber->getState()) {
@@ -199,14 +309,99 @@ void Scheduler::run() {
                 FOCUS_LOG_DEBUG(g_logger) << "idle fiber term";
                 break;
             }
+            trimFiberCache(self);
             ++m_idleThreadCount;
             idleFiber->resume();
             --m_idleThreadCount;
         }
     }
+    self->m_fiberCache.clear();
+    self->m_fiberCacheSize = 0;
     FOCUS_LOG_DEBUG(g_logger) << "Scheduler::run() exit";
 }
 
+Fiber::ptr Scheduler::takeCbFiber(Worker* self, std::function<void()>& cb) {
+    if(!self->m_fiberCache.empty()) {
+        Fiber::ptr fiber = std::move(self->m_fiberCache.back());
+        self->m_fiberCache.pop_back();
+        --self->m_fiberCacheSize;
+        self->m_fiberCacheHits.fetch_add(1, std::memory_order_relaxed);
+        fiber->reset(std::move(cb));
+        return fiber;
+    }
+    self->m_fiberCacheMisses.fetch_add(1, std::memory_order_relaxed);
+    return Fiber::ptr(new Fiber(std::move(cb)));
+}
+
+void Scheduler::cacheCbFiber(Worker* self, Fiber::ptr& fiber) {
+    // 只缓存执行结束并且没有其他持有者的协程，让出的协程由持有者继续调度
+    if(Fiber::TERM == fiber->getState() && 1 == fiber.use_count()
+            && self->m_fiberCache.size() < m_fiberCacheCap) {
+        self->m_fiberCache.push_back(std::move(fiber));
+        ++self->m_fiberCacheSize;
+    }
+    fiber.reset();
+}
+
+void Scheduler::trimFiberCache(Worker* self) {
+    if(self->m_fiberCache.empty()) {
+        return;
+    }
+    // 只在空闲时读时钟，执行回调的路径上只计数
+    uint64_t now = GetCurrentMS();
+    uint64_t takes = self->m_fiberCacheHits.load(std::memory_order_relaxed)
+        + self->m_fiberCacheMisses.load(std::memory_order_relaxed);
+    if(takes != self->m_fiberCacheTakes) {
+        self->m_fiberCacheTakes = takes;
+        self->m_fiberCacheUsed = now;
+        return;
+    }
+    if(now - self->m_fiberCacheUsed < m_fiberCacheIdleMs) {
+        return;
+    }
+    // 一段时间没有使用，每次空闲释放一半
+    self->m_fiberCache.resize(self->m_fiberCache.size() / 2);
+    self->m_fiberCacheSize = self->m_fiberCache.size();
+    self->m_fiberCacheUsed = now;
+}
+
+uint64_t Scheduler::getFiberCacheHits() const {
+    uint64_t hits = 0;
+    for(auto& i: m_workers) {
+        hits += i->m_fiberCacheHits.load(std::memory_order_relaxed);
+    }
+    return hits;
+}
+
+uint64_t Scheduler::getFiberCacheMisses() const {
+    uint64_t misses = 0;
+    for(auto& i: m_workers) {
+        misses += i->m_fiberCacheMisses.load(std::memory_order_relaxed);
+    }
+    return misses;
+}
+
+size_t Scheduler::getFiberCacheSize() const {
+    size_t size = 0;
+    for(auto& i: m_workers) {
+        size += i->m_fiberCacheSize.load(std::memory_order_relaxed);
+    }
+    return size;
+}
+
+Scheduler::PriorityStats Scheduler::getPriorityStats(Priority priority) const {
+    PriorityStats stats;
+    stats.m_depth = m_queues[priority].m_depth.load(std::memory_order_relaxed);
+    for(auto& i: m_workers) {
+        const PriorityCounter& counter = i->m_priorityCounters[priority];
+        stats.m_executed += counter.m_executed.load(std::memory_order_relaxed);
+        stats.m_totalWaitUs += counter.m_waitUs.load(std::memory_order_relaxed);
+        stats.m_maxWaitUs = std::max(stats.m_maxWaitUs, counter.m_maxWaitUs.load(std::memory_order_relaxed));
+        stats.m_deadlineMissed += counter.m_deadlineMissed.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
 void Scheduler::idle() {
     FOCUS_LOG_DEBUG(g_logger) << "idle";
     while(!isCanStop()) {
@@ -215,12 +410,328 @@ void Scheduler::idle() {
 }
 
 bool Scheduler::isCanStop() {
-    MutexType::Lock lock(m_mutex);
-    return m_stopping && m_tasks.empty() && 0 == m_activeThreadCount;
+    return m_stopping && 0 == m_taskCount && 0 == m_activeThreadCount;
 }
 
 void Scheduler::setThis() {
     t_scheduler = this;
 }
 
+bool Scheduler::pushTask(ScheduleTask* task) {
+    // 之前没有任务，需要通知
+    bool needTickle = (0 == m_taskCount++);
+    ++m_queues[task->m_priority].m_depth;
+    task->m_enqueueUs = GetCurrentUS();
+
+    // 指定了线程，放入目标线程的绑定队列
+    if(-1 != task->m_thread) {
+        Worker* worker = getWorker(task->m_thread);
+        if(worker) {
+            MutexType::Lock lock(worker->m_mutex);
+            worker->m_pinned.emplace_back(task);
+            ++worker->m_pinnedCount;
+            // 绑定到其他线程，目标线程可能在等待，需要通知
+            needTickle = needTickle || worker != getLocalWorker();
+        }else {
+            pushGlobal(task);
+        }
+        return needTickle;
+    }
+
+    // 调度线程自己添加的普通任务，放入本地队列，满了放入全局队列
+    // 其他优先级和有截止时间的任务放入对应优先级的全局队列
+    Worker* self = getLocalWorker();
+    if(!self || NORMAL != task->m_priority || task->m_deadline || !self->m_local.push(task)) {
+        pushGlobal(task);
+    }
+    return needTickle;
+}
+
+void Scheduler::scheduleBatch(TaskBatch& batch, int thread) {
+    std::vector<ScheduleTask*> tasks;
+    tasks.reserve(batch.m_fibers.size() + batch.m_cbs.size());
+    for(auto& fiber: batch.m_fibers) {
+        if(fiber) {
+            tasks.push_back(new ScheduleTask(&fiber, thread));
+        }
+    }
+    for(auto& cb: batch.m_cbs) {
+        if(cb) {
+            tasks.push_back(new ScheduleTask(&cb, thread));
+        }
+    }
+    batch.m_fibers.clear();
+    batch.m_cbs.clear();
+    if(tasks.empty()) {
+        return ;
+    }
+    uint64_t now = GetCurrentUS();
+    for(auto task: tasks) {
+        task->m_enqueueUs = now;
+    }
+
+    bool needTickle = (0 == m_taskCount.fetch_add(tasks.size()));
+    m_queues[NORMAL].m_depth += tasks.size();
+    Worker* self = getLocalWorker();
+    Worker* worker = -1 != thread? getWorker(thread): nullptr;
+    if(worker) {
+        // 绑定到同一个线程，一次加锁放入
+        MutexType::Lock lock(worker->m_mutex);
+        worker->m_pinned.insert(worker->m_pinned.end(), tasks.begin(), tasks.end());
+        worker->m_pinnedCount += tasks.size();
+        // 绑定到当前线程不需要通知，当前线程马上会执行
+        needTickle = worker != self;
+    }else {
+        // 先放入本地队列，放不下的一次加锁放入全局队列
+        size_t i = 0;
+        if(self && -1 == thread) {
+            while(i < tasks.size() && self->m_local.push(tasks[i])) {
+                ++i;
+            }
+            // 其他线程可以窃取
+            needTickle = needTickle || tasks.size() > 1;
+        }
+        if(i < tasks.size()) {
+            TaskQueue& queue = m_queues[NORMAL];
+            MutexType::Lock lock(m_mutex);
+            queue.m_tasks.insert(queue.m_tasks.end(), tasks.begin() + i, tasks.end());
+            queue.m_size += tasks.size() - i;
+        }
+    }
+    if(needTickle) {
+        tickle();
+    }
+}
+
+void Scheduler::pushGlobal(ScheduleTask* task) {
+    TaskQueue& queue = m_queues[task->m_priority];
+    MutexType::Lock lock(m_mutex);
+    if(task->m_deadline) {
+        queue.m_deadlineTasks.emplace(task->m_deadline, task);
+        ++m_deadlineCount;
+    }else {
+        queue.m_tasks.emplace_back(task);
+    }
+    ++queue.m_size;
+}
+
+/**
+ * @brief 全局队列中的任务是否可以由当前线程执行
+ */
+static bool CanTakeGlobal(int thread, const Fiber::ptr& fiber) {
+    // 指定了线程号，但不是当前线程
+    if(thread != -1 && thread != GetThreadId()) {
+        return false;
+    }
+    // 协程还没有yield
+    return !fiber || Fiber::RUNNING != fiber->getState();
+}
+
+Scheduler::ScheduleTask* Scheduler::popGlobal(TaskQueue& queue) {
+    // 有截止时间的任务先执行
+    for(auto it = queue.m_deadlineTasks.begin(); it != queue.m_deadlineTasks.end(); ++it) {
+        if(CanTakeGlobal(it->second->m_thread, it->second->m_fiber)) {
+            ScheduleTask* task = it->second;
+            queue.m_deadlineTasks.erase(it);
+            --queue.m_size;
+            --m_deadlineCount;
+            return task;
+        }
+    }
+    for(auto it = queue.m_tasks.begin(); it != queue.m_tasks.end(); ++it) {
+        if(CanTakeGlobal((*it)->m_thread, (*it)->m_fiber)) {
+            ScheduleTask* task = *it;
+            queue.m_tasks.erase(it);
+            --queue.m_size;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+Scheduler::ScheduleTask* Scheduler::takeExpired() {
+    if(0 == m_deadlineCount) {
+        return nullptr;
+    }
+    uint64_t now = GetCurrentUS();
+    MutexType::Lock lock(m_mutex);
+    TaskQueue* expired = nullptr;
+    for(auto& queue: m_queues) {
+        if(queue.m_deadlineTasks.empty()) {
+            continue;
+        }
+        auto it = queue.m_deadlineTasks.begin();
+        if(it->first > now || !CanTakeGlobal(it->second->m_thread, it->second->m_fiber)) {
+            continue;
+        }
+        if(!expired || it->first < expired->m_deadlineTasks.begin()->first) {
+            expired = &queue;
+        }
+    }
+    if(!expired) {
+        return nullptr;
+    }
+    ScheduleTask* task = expired->m_deadlineTasks.begin()->second;
+    expired->m_deadlineTasks.erase(expired->m_deadlineTasks.begin());
+    --expired->m_size;
+    --m_deadlineCount;
+    return task;
+}
+
+int Scheduler::pickPriority(Worker* self) {
+    bool ready[PRIORITY_COUNT];
+    int count = 0;
+    int last = NORMAL;
+    for(int i = 0; i < PRIORITY_COUNT; ++i) {
+        ready[i] = m_queues[i].m_depth > 0;
+        if(ready[i]) {
+            ++count;
+            last = i;
+        }
+    }
+    // 只有一个优先级有任务，不参与轮询
+    if(count <= 1) {
+        return last;
+    }
+    // 平滑加权轮询：各自加上权重，选最大的，再减去总权重
+    int64_t total = 0;
+    int best = -1;
+    for(int i = 0; i < PRIORITY_COUNT; ++i) {
+        if(!ready[i]) {
+            continue;
+        }
+        self->m_weightCurrent[i] += m_weights[i];
+        total += m_weights[i];
+        if(-1 == best || self->m_weightCurrent[i] > self->m_weightCurrent[best]) {
+            best = i;
+        }
+    }
+    self->m_weightCurrent[best] -= total;
+    return best;
+}
+
+Scheduler::ScheduleTask* Scheduler::takeByPriority(Worker* self, int priority) {
+    ScheduleTask* task = nullptr;
+    TaskQueue& queue = m_queues[priority];
+    if(NORMAL == priority) {
+        // 本地队列
+        task = self->m_local.pop();
+    }
+
+    // 全局队列
+    if(!task && queue.m_size > 0) {
+        MutexType::Lock lock(m_mutex);
+        task = popGlobal(queue);
+    }
+
+    // 窃取其他线程的本地队列
+    if(!task && NORMAL == priority) {
+        size_t count = m_workers.size();
+        size_t index = t_worker_index;
+        for(size_t i = 1; i < count && !task; ++i) {
+            task = m_workers[(index + i) % count]->m_local.steal();
+        }
+    }
+    return task;
+}
+
+Scheduler::ScheduleTask* Scheduler::takeTask(Worker* self) {
+    ScheduleTask* task = nullptr;
+
+    // 绑定到当前线程的任务
+    if(self->m_pinnedCount > 0) {
+        MutexType::Lock lock(self->m_mutex);
+        auto it = self->m_pinned.begin();
+        while(it != self->m_pinned.end()) {
+            // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
+            if((*it)->m_fiber && Fiber::RUNNING == (*it)->m_fiber->getState()) {
+                ++it;
+                continue;
+            }
+            task = *it;
+            self->m_pinned.erase(it);
+            --self->m_pinnedCount;
+            break;
+        }
+    }
+
+    // 超过截止时间的任务
+    if(!task) {
+        task = takeExpired();
+    }
+
+    // 按权重选择优先级，选中的优先级没有可执行的任务时按优先级从高到低查找
+    if(!task) {
+        int priority = pickPriority(self);
+        task = takeByPriority(self, priority);
+        for(int i = 0; i < PRIORITY_COUNT && !task; ++i) {
+            if(i != priority) {
+                task = takeByPriority(self, i);
+            }
+        }
+    }
+
+    if(!task) {
+        return nullptr;
+    }
+
+    // 协程还没有yield，放回全局队列稍后再调度
+    if(task->m_fiber && Fiber::RUNNING == task->m_fiber->getState()) {
+        pushGlobal(task);
+        return nullptr;
+    }
+
+    // 先增加活跃线程数，再减少任务数，保证isCanStop不会误判
+    ++m_activeThreadCount;
+    --m_taskCount;
+    --m_queues[task->m_priority].m_depth;
+
+    // 排队时间统计
+    uint64_t now = GetCurrentUS();
+    uint64_t wait = now > task->m_enqueueUs? now - task->m_enqueueUs: 0;
+    PriorityCounter& counter = self->m_priorityCounters[task->m_priority];
+    counter.m_executed.fetch_add(1, std::memory_order_relaxed);
+    counter.m_waitUs.fetch_add(wait, std::memory_order_relaxed);
+    if(wait > counter.m_maxWaitUs.load(std::memory_order_relaxed)) {
+        counter.m_maxWaitUs.store(wait, std::memory_order_relaxed);
+    }
+    if(task->m_deadline && now > task->m_deadline) {
+        counter.m_deadlineMissed.fetch_add(1, std::memory_order_relaxed);
+    }
+    // 没有实际执行对象
+    FOCUS_ASSERT(task->m_fiber || task->m_cb);
+    return task;
+}
+
+int Scheduler::getLocalWorkerIndex() {
+    if(GetThis() != this || t_worker_index < 0 || t_worker_index >= (int)m_workers.size()) {
+        return -1;
+    }
+    return t_worker_index;
+}
+
+bool Scheduler::hasUnpinnedTasks() {
+    size_t pinned = 0;
+    for(auto worker: m_workers) {
+        pinned += worker->m_pinnedCount;
+    }
+    return m_taskCount > pinned;
+}
+
+Scheduler::Worker* Scheduler::getLocalWorker() {
+    if(GetThis() != this || t_worker_index < 0 || t_worker_index >= (int)m_workers.size()) {
+        return nullptr;
+    }
+    return m_workers[t_worker_index];
+}
+
+Scheduler::Worker* Scheduler::getWorker(int thread) {
+    for(auto worker: m_workers) {
+        if(worker->m_threadId == thread) {
+            return worker;
+        }
+    }
+    return nullptr;
+}
+
 } // end namespace focus
\ No newline at end of file
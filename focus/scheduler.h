@@ -6,9 +6,12 @@
 #include <functional>
 #include <vector>
 #include <list>
+#include <map>
 #include "log.h"
 #include "fiber.h"
 #include "thread.h"
+#include "workstealqueue.h"
+#include "util.h"
 
 namespace focus {
 
@@ -20,6 +23,27 @@ public:
     using ptr = std::shared_ptr<Scheduler>;
     using MutexType = Mutex;
 
+    /**
+     * @brief 任务优先级
+     */
+    enum Priority {
+        HIGH = 0, // 延迟敏感的任务，如RPC请求处理
+        NORMAL = 1, // 默认优先级
+        BACKGROUND = 2, // 后台批量任务
+        PRIORITY_COUNT = 3
+    };
+
+    /**
+     * @brief 一个优先级的队列统计
+     */
+    struct PriorityStats {
+        size_t m_depth = 0; // 当前排队的任务数
+        uint64_t m_executed = 0; // 已经开始执行的任务数
+        uint64_t m_totalWaitUs = 0; // 累计排队时间(微秒)
+        uint64_t m_maxWaitUs = 0; // 最大排队时间(微秒)
+        uint64_t m_deadlineMissed = 0; // 开始执行时已经超过截止时间的任务数
+    };
+
     /**
      * @brief 创建调度器
      * @param[in] threads 线程数
@@ -60,6 +84,33 @@ public:
      */
     void stop();
 
+    /**
+     * @brief 获取线程池的线程id，use caller时第一个为caller线程
+     */
+    const std::vector<int>& getThreadIds() const {
+        return m_threadIds;
+    }
+
+    /**
+     * @brief 获取回调协程缓存命中次数
+     */
+    uint64_t getFiberCacheHits() const;
+
+    /**
+     * @brief 获取回调协程缓存未命中次数(新建协程)
+     */
+    uint64_t getFiberCacheMisses() const;
+
+    /**
+     * @brief 获取缓存的回调协程数
+     */
+    size_t getFiberCacheSize() const;
+
+    /**
+     * @brief 获取指定优先级的队列统计
+     */
+    PriorityStats getPriorityStats(Priority priority) const;
+
     /**
      * @brief 添加调度任务
      * @tparam FiberOrCb 调度任务类型
@@ -68,16 +119,51 @@ public:
      */
     template<class FiberOrCb>
     void schedule(FiberOrCb fc, int thread = -1) {
-        bool needTickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            needTickle = scheduleNoLock(fc, thread);
+        if(scheduleNoLock(fc, thread)) {
+            tickle();
         }
-        if(needTickle) {
+    }
+
+    /**
+     * @brief 按优先级添加调度任务
+     * @details 不同优先级的任务按权重轮流执行，后台任务不会被饿死；
+     *          有截止时间的任务在同一优先级中按截止时间先后执行，超过截止时间的最先执行
+     * @tparam FiberOrCb 调度任务类型
+     * @param[in] fc 任务对象
+     * @param[in] priority 优先级
+     * @param[in] deadlineMs 截止时间，距现在的毫秒数，0表示没有截止时间
+     * @param[in] thread 该任务对象的线程号，绑定线程的任务按添加顺序执行
+     */
+    template<class FiberOrCb>
+    void schedule(FiberOrCb fc, Priority priority, uint64_t deadlineMs = 0, int thread = -1) {
+        if(scheduleNoLock(fc, thread, priority, deadlineMs)) {
             tickle();
         }
     }
 
+    /**
+     * @brief 添加内联任务，直接在调度协程上执行，不创建协程也不切换上下文
+     * @details 适用于计数、通知等很短并且不会阻塞的函数
+     * @attention 任务中不能yield，也不能调用会让出的hook函数，调试模式下会断言
+     * @param[in] cb 函数对象
+     * @param[in] thread 该任务的线程号，-1表示任意线程
+     */
+    void scheduleInline(std::function<void()> cb, int thread = -1) {
+        if(!cb) {
+            return;
+        }
+        ScheduleTask* task = new ScheduleTask(&cb, thread);
+        task->m_inline = true;
+        if(pushTask(task)) {
+            tickle();
+        }
+    }
+
+    /**
+     * @brief 当前线程是否正在执行内联任务
+     */
+    static bool IsInInlineTask();
+
     /**
      * @brief 批量添加调度任务
      * @tparam InputIterator 迭代器类型
@@ -87,12 +173,9 @@ public:
     template<class InputIterator>
     void schedule(InputIterator begin, InputIterator end) {
         bool needTickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            while(begin != end) {
-                needTickle = scheduleNoLock(*begin, -1) || needTickle;
-                ++begin;
-            }
+        while(begin != end) {
+            needTickle = scheduleNoLock(*begin, -1) || needTickle;
+            ++begin;
         }
         if(needTickle) {
             tickle();
@@ -132,25 +215,92 @@ protected:
         return m_idleThreadCount > 0;
     }
 
+    /**
+     * @brief 是否有等待调度的任务
+     */
+    bool hasPendingTasks() {
+        return m_taskCount > 0;
+    }
+
+    /**
+     * @brief 是否正在停止
+     */
+    bool isStopping() const {
+        return m_stopping;
+    }
+
+    /**
+     * @brief 获取调度线程数(包括caller线程)
+     */
+    size_t getWorkerCount() const {
+        return m_workers.size();
+    }
+
+    /**
+     * @brief 获取当前线程在本调度器中的下标，不是本调度器的线程返回-1
+     */
+    int getLocalWorkerIndex();
+
+    /**
+     * @brief 指定下标的调度线程是否有绑定任务
+     */
+    bool hasPinnedTasks(size_t index) {
+        return m_workers[index]->m_pinnedCount > 0;
+    }
+
+    /**
+     * @brief 是否有任意线程都可以执行的任务
+     */
+    bool hasUnpinnedTasks();
+
+    /**
+     * @brief 一批待调度的协程和函数
+     */
+    struct TaskBatch {
+        std::vector<Fiber::ptr> m_fibers; // 协程
+        std::vector<std::function<void()>> m_cbs; // 函数
+
+        /**
+         * @brief 是否为空
+         */
+        bool empty() const {
+            return m_fibers.empty() && m_cbs.empty();
+        }
+    };
+
+    /**
+     * @brief 批量添加调度任务
+     * @details 全局队列或绑定队列只加一次锁，最多通知一次，完成后batch为空
+     * @param[in,out] batch 待调度的任务
+     * @param[in] thread 绑定的线程id，-1表示任意线程
+     */
+    void scheduleBatch(TaskBatch& batch, int thread = -1);
+
 private:
     /**
      * @brief 无锁，添加调度任务
      * @tparam FiberOrCb 调度任务类型
      * @param[in] fc 任务对象
      * @param[in] thread 该任务的线程号，-1表示任意线程
+     * @param[in] priority 优先级
+     * @param[in] deadlineMs 截止时间，距现在的毫秒数，0表示没有
+     * @return 是否需要通知
      */
     template<class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread) {
-        // 是否需要通知
-        bool needTickle = m_tasks.empty();
+    bool scheduleNoLock(FiberOrCb fc, int thread, Priority priority = NORMAL, uint64_t deadlineMs = 0) {
         // 创建一个任务
-        ScheduleTask task(fc, thread);
-        // 任务实际对象不空
-        if(task.m_fiber || task.m_cb) {
-            m_tasks.emplace_back(task);
+        ScheduleTask* task = new ScheduleTask(fc, thread);
+        // 任务实际对象为空
+        if(!task->m_fiber && !task->m_cb) {
+            delete task;
+            return false;
+        }
+        task->m_priority = priority;
+        if(deadlineMs) {
+            task->m_deadline = GetCurrentUS() + deadlineMs * 1000;
         }
-        return needTickle;
-    }   
+        return pushTask(task);
+    }
 
 private:
     /**
@@ -160,6 +310,10 @@ private:
         Fiber::ptr m_fiber; // 协程对象
         std::function<void()> m_cb; // 函数
         int m_thread; // 线程id
+        bool m_inline = false; // 是否在调度协程上直接执行
+        Priority m_priority = NORMAL; // 优先级
+        uint64_t m_deadline = 0; // 截止时间(微秒)，0表示没有
+        uint64_t m_enqueueUs = 0; // 入队时间(微秒)
 
         /**
          * @brief 无参构造
@@ -215,14 +369,138 @@ private:
             m_fiber = nullptr;
             m_cb = nullptr;
             m_thread = -1;
+            m_inline = false;
+            m_priority = NORMAL;
+            m_deadline = 0;
+            m_enqueueUs = 0;
+        }
+    };
+
+    /**
+     * @brief 一个优先级的全局队列
+     */
+    struct TaskQueue {
+        std::list<ScheduleTask*> m_tasks; // 没有截止时间的任务，先进先出
+        std::multimap<uint64_t, ScheduleTask*> m_deadlineTasks; // 有截止时间的任务，按截止时间排序
+        std::atomic<size_t> m_size = {0}; // 全局队列中的任务数
+        std::atomic<size_t> m_depth = {0}; // 该优先级排队的任务总数，包括本地队列和绑定队列
+    };
+
+    /**
+     * @brief 工作线程对一个优先级的执行统计，只由所属线程修改
+     */
+    struct PriorityCounter {
+        std::atomic<uint64_t> m_executed = {0}; // 开始执行的任务数
+        std::atomic<uint64_t> m_waitUs = {0}; // 累计排队时间
+        std::atomic<uint64_t> m_maxWaitUs = {0}; // 最大排队时间
+        std::atomic<uint64_t> m_deadlineMissed = {0}; // 超过截止时间才执行的任务数
+    };
+
+    /**
+     * @brief 工作线程的任务队列
+     */
+    struct Worker {
+        /**
+         * @brief 构造函数
+         * @param[in] capacity 本地队列容量
+         */
+        Worker(size_t capacity):
+            m_local(capacity) {
         }
+
+        WorkStealQueue<ScheduleTask*> m_local; // 本地队列，其他线程可以窃取
+        MutexType m_mutex; // 绑定队列的锁
+        std::list<ScheduleTask*> m_pinned; // 绑定到该线程的任务，不可窃取
+        std::atomic<size_t> m_pinnedCount = {0}; // 绑定任务数
+        int m_threadId = -1; // 所属线程id
+        std::vector<Fiber::ptr> m_fiberCache; // 执行结束可以复用的回调协程，只由所属线程访问
+        uint64_t m_fiberCacheUsed = 0; // 空闲时发现缓存被使用过的时间(毫秒)
+        uint64_t m_fiberCacheTakes = 0; // 上次空闲时的取用次数
+        std::atomic<size_t> m_fiberCacheSize = {0}; // 缓存的协程数，用于统计
+        std::atomic<uint64_t> m_fiberCacheHits = {0}; // 缓存命中次数
+        std::atomic<uint64_t> m_fiberCacheMisses = {0}; // 缓存未命中次数
+        int64_t m_weightCurrent[PRIORITY_COUNT] = {0}; // 平滑加权轮询的当前权重
+        PriorityCounter m_priorityCounters[PRIORITY_COUNT]; // 各优先级的执行统计
     };
 
+    /**
+     * @brief 获取执行回调的协程，优先复用缓存
+     */
+    Fiber::ptr takeCbFiber(Worker* self, std::function<void()>& cb);
+
+    /**
+     * @brief 回调执行结束的协程放回缓存
+     */
+    void cacheCbFiber(Worker* self, Fiber::ptr& fiber);
+
+    /**
+     * @brief 空闲时释放长时间没有使用的缓存协程
+     */
+    void trimFiberCache(Worker* self);
+
+    /**
+     * @brief 投递调度任务
+     * @details 绑定线程的任务放入目标线程的绑定队列，
+     *          调度线程自己添加的任务放入本地队列，其余放入全局队列
+     * @param[in] task 调度任务
+     * @return 是否需要通知
+     */
+    bool pushTask(ScheduleTask* task);
+
+    /**
+     * @brief 放入全局队列
+     * @param[in] task 调度任务
+     */
+    void pushGlobal(ScheduleTask* task);
+
+    /**
+     * @brief 取出一个可执行的任务
+     * @details 先查找绑定队列和超过截止时间的任务，再按权重选择优先级；
+     *          普通优先级依次查找本地队列，全局队列，最后窃取其他线程的本地队列
+     * @param[in] self 当前线程的任务队列
+     * @return 没有任务返回nullptr
+     */
+    ScheduleTask* takeTask(Worker* self);
+
+    /**
+     * @brief 从指定优先级的队列中取出任务
+     */
+    ScheduleTask* takeByPriority(Worker* self, int priority);
+
+    /**
+     * @brief 取出已经超过截止时间的任务，截止时间最早的优先
+     */
+    ScheduleTask* takeExpired();
+
+    /**
+     * @brief 从全局队列取出当前线程可以执行的任务，需要持有m_mutex
+     */
+    ScheduleTask* popGlobal(TaskQueue& queue);
+
+    /**
+     * @brief 平滑加权轮询选择本次执行的优先级
+     */
+    int pickPriority(Worker* self);
+
+    /**
+     * @brief 获取当前线程的任务队列，不是本调度器的线程返回nullptr
+     */
+    Worker* getLocalWorker();
+
+    /**
+     * @brief 根据线程id获取任务队列，不是本调度器的线程返回nullptr
+     */
+    Worker* getWorker(int thread);
+
 private:
     std::string m_name; // 协程调度器名称
     MutexType m_mutex; // 互斥锁
     std::vector<Thread::ptr> m_threads; // 线程池
-    std::list<ScheduleTask> m_tasks; // 任务队列
+    TaskQueue m_queues[PRIORITY_COUNT]; // 各优先级的全局任务队列，本地队列满或者非调度线程添加时使用
+    std::atomic<size_t> m_deadlineCount = {0}; // 全局队列中有截止时间的任务数
+    uint32_t m_weights[PRIORITY_COUNT] = {0}; // 各优先级的调度权重
+    std::vector<Worker*> m_workers; // 各调度线程的任务队列
+    std::atomic<size_t> m_taskCount = {0}; // 所有队列中的任务总数
     std::vector<int> m_threadIds; // 线程池的线程id数组
     size_t m_threadCount = 0; // 工作线程数量，不包含use_caller的主线程
     std::atomic<size_t> m_activeThreadCount = {0}; // 活跃线程数
@@ -233,6 +511,9 @@ private:
     int m_rootThread = 0; // use_caller为true时,调度器所在线程的id
 
     bool m_stopping = false; // 是否正在停止
+    uint32_t m_localQueueSize = 0; // 本地队列容量
+    size_t m_fiberCacheCap = 0; // 每个线程缓存的回调协程上限
+    uint64_t m_fiberCacheIdleMs = 0; // 缓存多久没有使用后开始释放
 };
 
 } // end namespace focus
@@ -1,5 +1,6 @@
 #include "thread.h"
 #include "log.h"
+#include <sched.h>
 
 namespace focus {
 
@@ -26,9 +27,10 @@ void Thread::SetName(const std::string& name) {
     t_thread_name=name;
 }
 
-Thread::Thread(std::function<void()> cb,const std::string& name):
+Thread::Thread(std::function<void()> cb,const std::string& name,const std::vector<int>& cpus):
     m_cb(cb),
-    m_name(name) {
+    m_name(name),
+    m_cpus(cpus) {
     if(name.empty()){
         m_name="UNKNOWN";
     }
@@ -59,12 +61,65 @@ void Thread::join() {
     }
 }
 
+/**
+ * @brief 设置pthread线程的CPU亲和性
+ */
+static bool SetAffinity(pthread_t thread,const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(auto cpu:cpus){
+        if(cpu>=0&&cpu<CPU_SETSIZE){
+            CPU_SET(cpu,&set);
+        }
+    }
+    if(0==CPU_COUNT(&set)){
+        return false;
+    }
+    int rt=pthread_setaffinity_np(thread,sizeof(set),&set);
+    if(rt){
+        FOCUS_LOG_ERROR(g_logger)<<"pthread_setaffinity_np fail, rt="<<rt
+            <<" name="<<t_thread_name;
+        return false;
+    }
+    return true;
+}
+
+bool Thread::setAffinity(const std::vector<int>& cpus) {
+    if(!m_thread){
+        return false;
+    }
+    return SetAffinity(m_thread,cpus);
+}
+
+std::vector<int> Thread::getAffinity() const {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(!m_thread||pthread_getaffinity_np(m_thread,sizeof(set),&set)){
+        return cpus;
+    }
+    for(int i=0;i<CPU_SETSIZE;++i){
+        if(CPU_ISSET(i,&set)){
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+bool Thread::SetThisAffinity(const std::vector<int>& cpus) {
+    return SetAffinity(pthread_self(),cpus);
+}
+
 void* Thread::run(void* arg) {
     Thread* thread=(Thread*)arg;
     t_thread=thread;
     t_thread_name=thread->m_name;
     thread->m_id=GetThreadId();
     pthread_setname_np(thread->m_thread,thread->m_name.substr(0,15).c_str());
+    // 在执行函数之前绑定，之后分配的内存按首次访问落在本节点
+    if(!thread->m_cpus.empty()){
+        SetThisAffinity(thread->m_cpus);
+    }
 
     std::function<void()> cb;
     cb.swap(thread->m_cb);
@@ -4,6 +4,7 @@
 #include <functional>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "nocopyable.h"
 #include "mutex.h"
@@ -16,8 +17,13 @@ public:
     // 别名
     using ptr=std::shared_ptr<Thread>;
 
-    // 构造
-    Thread(std::function<void()> cb,const std::string& name);
+    /**
+     * @brief 构造
+     * @param[in] cb 线程执行的函数
+     * @param[in] name 线程名
+     * @param[in] cpus 绑定的CPU，为空不绑定，在执行cb之前设置
+     */
+    Thread(std::function<void()> cb,const std::string& name,const std::vector<int>& cpus={});
 
     // 析构
     ~Thread();
@@ -31,6 +37,12 @@ public:
     // 等待线程执行完成
     void join();
 
+    // 设置线程的CPU亲和性
+    bool setAffinity(const std::vector<int>& cpus);
+
+    // 获取线程允许运行的CPU
+    std::vector<int> getAffinity() const;
+
     // 获取当前线程的指针
     static Thread* GetThis();
 
@@ -39,6 +51,9 @@ public:
 
     // 设置当前线程的名字
     static void SetName(const std::string& name);
+
+    // 设置当前线程的CPU亲和性
+    static bool SetThisAffinity(const std::vector<int>& cpus);
 private:
     // 线程执行的函数
     static void* run(void* arg);
@@ -48,6 +63,7 @@ private:
     pthread_t m_thread=0; // 线程结构
     std::function<void()> m_cb; // 线程执行的函数
     std::string m_name; // 线程名
+    std::vector<int> m_cpus; // 启动时绑定的CPU
     Semaphore m_semaphore; // 信号量
 };
 
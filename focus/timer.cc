@@ -1,6 +1,7 @@
 #include "timer.h"
 #include "macro.h"
 #include "util.h"
+#include <algorithm>
 
 namespace focus {
 
@@ -27,8 +28,7 @@ bool Timer::cancel() {
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
     if(m_cb) {
         m_cb = nullptr;
-        auto it = m_manager->m_timers.find(shared_from_this());
-        m_manager->m_timers.erase(it);
+        m_manager->removeTimer(this);
         return true;
     }
     return false;
@@ -41,14 +41,13 @@ bool Timer::refresh() {
         return false;
     }
     // 没有找到
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(m_manager->m_timers.end() == it) {
+    Timer::ptr self = shared_from_this();
+    if(!m_manager->removeTimer(this)) {
         return false;
     }
-    // 删除并刷新
-    m_manager->m_timers.erase(it);
+    // 刷新
     m_next = GetCurrentMS() + m_ms;
-    m_manager->m_timers.insert(shared_from_this());
+    m_manager->insertTimer(self);
     return true;
 }
 
@@ -62,12 +61,11 @@ bool Timer::reset(uint64_t ms, bool fromNow) {
         return false;
     }
     // 没有找到
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(m_manager->m_timers.end() == it) {
+    Timer::ptr self = shared_from_this();
+    if(!m_manager->removeTimer(this)) {
         return false;
     }
-    // 删除并重置
-    m_manager->m_timers.erase(it);
+    // 重置
     uint64_t start = 0;
     if(fromNow) {
         start = GetCurrentMS();
@@ -76,7 +74,7 @@ bool Timer::reset(uint64_t ms, bool fromNow) {
     }
     m_ms = ms;
     m_next = start + m_ms;
-    m_manager->addTimer(shared_from_this(), lock);
+    m_manager->addTimer(self, lock);
     return true;
 }
 
@@ -92,11 +90,33 @@ Timer::Timer(uint64_t next):
     m_next(next) {
 }
 
-TimerManager::TimerManager() {
+TimerManager::TimerManager(Type type):
+    m_type(type) {
     m_previousTime = GetCurrentMS();
+    m_wheelTick = m_previousTime;
 }
 
 TimerManager::~TimerManager() {
+    // 断开时间轮中定时器对自身的引用
+    for(auto& slot: m_wheel0) {
+        while(slot) {
+            wheelRemove(slot);
+        }
+    }
+    for(auto& level: m_wheelN) {
+        for(auto& slot: level) {
+            while(slot) {
+                wheelRemove(slot);
+            }
+        }
+    }
+}
+
+TimerManager::Type TimerManager::TimerTypeFromString(const std::string& name) {
+    if("wheel" == name) {
+        return WHEEL;
+    }
+    return SET;
 }
 
 Timer::ptr TimerManager::addTimer(std::function<void()> cb, uint64_t ms, bool recurring) {
@@ -118,6 +138,21 @@ Timer::ptr TimerManager::addConditionTimer(std::function<void()> cb, uint64_t ms
 }
 
 uint64_t TimerManager::getNextTimer() {
+    if(WHEEL == m_type) {
+        // 需要更新缓存的最早执行时间
+        RWMutexType::WriteLock lock(m_mutex);
+        m_tickled = false;
+        m_wheelNextExpire = wheelNextExpire();
+        if(~0ull == m_wheelNextExpire) {
+            return ~0ull;
+        }
+        uint64_t nowMs = GetCurrentMS();
+        if(nowMs >= m_wheelNextExpire) {
+            return 0;
+        }
+        return m_wheelNextExpire - nowMs;
+    }
+
     RWMutexType::ReadLock lock(m_mutex);
     m_tickled = false;
     if(m_timers.empty()) {
@@ -137,36 +172,58 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
     std::vector<Timer::ptr> expired;
     {
         RWMutexType::ReadLock lock(m_mutex);
-        if(m_timers.empty()) {
+        if(m_timers.empty() && 0 == m_wheelSize) {
             return ;
         }
     }
     RWMutexType::WriteLock lock(m_mutex);
-    if(m_timers.empty()) {
+    if(m_timers.empty() && 0 == m_wheelSize) {
         return ;
     }
     bool rollover = false;
     if(FOCUS_UNLIKELY(detectClockRollover(nowMs))) {
         rollover = true;
     }
-    if(!rollover && ((*m_timers.begin())->m_next > nowMs)) {
-        return ;
-    }
 
-    Timer::ptr nowTimer(new Timer(nowMs));
-    auto it = rollover? m_timers.end(): m_timers.lower_bound(nowTimer);
-    while(m_timers.end() != it && (*it)->m_next == nowMs) {
-        ++it;
+    if(WHEEL == m_type) {
+        if(rollover) {
+            // 时间被调后，全部视为到期
+            for(auto& slot: m_wheel0) {
+                while(slot) {
+                    expired.emplace_back(wheelRemove(slot));
+                }
+            }
+            for(auto& level: m_wheelN) {
+                for(auto& slot: level) {
+                    while(slot) {
+                        expired.emplace_back(wheelRemove(slot));
+                    }
+                }
+            }
+            m_wheelTick = nowMs;
+        }else {
+            wheelAdvance(nowMs, expired);
+        }
+    }else {
+        if(!rollover && ((*m_timers.begin())->m_next > nowMs)) {
+            return ;
+        }
+
+        Timer::ptr nowTimer(new Timer(nowMs));
+        auto it = rollover? m_timers.end(): m_timers.lower_bound(nowTimer);
+        while(m_timers.end() != it && (*it)->m_next == nowMs) {
+            ++it;
+        }
+        expired.insert(expired.begin(), m_timers.begin(), it);
+        m_timers.erase(m_timers.begin(), it);
     }
-    expired.insert(expired.begin(), m_timers.begin(), it);
-    m_timers.erase(m_timers.begin(), it);
-    cbs.reserve(expired.size());
+    cbs.reserve(cbs.size() + expired.size());
 
     for(auto& timer: expired) {
         cbs.emplace_back(timer->m_cb);
         if(timer->m_recurring) {
             timer->m_next = nowMs + timer->m_ms;
-            m_timers.insert(timer);
+            insertTimer(timer);
         }else {
             timer->m_cb = nullptr;
         }
@@ -175,12 +232,11 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
 
 bool TimerManager::hasTimer() {
     RWMutexType::ReadLock lock(m_mutex);
-    return !m_timers.empty();
+    return !m_timers.empty() || m_wheelSize > 0;
 }
 
 void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
-    auto it = m_timers.insert(val).first;
-    bool atFront = (m_timers.begin() == it) && !m_tickled;
+    bool atFront = insertTimer(val) && !m_tickled;
     if(atFront) {
         m_tickled = true;
     }
@@ -200,4 +256,179 @@ bool TimerManager::detectClockRollover(uint64_t nowMs) {
     return rollover;
 }
 
+bool TimerManager::insertTimer(const Timer::ptr& timer) {
+    if(WHEEL == m_type) {
+        wheelInsert(timer);
+        // 比上次计算的最早执行时间还早，需要唤醒重新计算
+        if(timer->m_next < m_wheelNextExpire) {
+            m_wheelNextExpire = timer->m_next;
+            return true;
+        }
+        return false;
+    }
+    auto it = m_timers.insert(timer).first;
+    return m_timers.begin() == it;
+}
+
+bool TimerManager::removeTimer(Timer* timer) {
+    if(WHEEL == m_type) {
+        return nullptr != wheelRemove(timer);
+    }
+    auto it = m_timers.find(timer->shared_from_this());
+    if(m_timers.end() == it) {
+        return false;
+    }
+    m_timers.erase(it);
+    return true;
+}
+
+void TimerManager::wheelInsert(Timer::ptr timer) {
+    // 已经过期的放到当前时刻
+    uint64_t expires = std::max(timer->m_next, m_wheelTick);
+    uint64_t idx = expires - m_wheelTick;
+    Timer** slot = nullptr;
+    if(idx < (uint64_t)WHEEL_L0_SIZE) {
+        size_t i = expires & (WHEEL_L0_SIZE - 1);
+        slot = &m_wheel0[i];
+        m_wheelBitmap[i / 64] |= 1ull << (i % 64);
+        ++m_wheel0Size;
+    }else {
+        // 超出范围的放在最高层，降层时重新计算
+        uint64_t maxIdx = (1ull << (WHEEL_L0_BITS + WHEEL_LEVELS * WHEEL_LN_BITS)) - 1;
+        if(idx > maxIdx) {
+            expires = m_wheelTick + maxIdx;
+            idx = maxIdx;
+        }
+        int level = 0;
+        while(idx >= (1ull << (WHEEL_L0_BITS + (level + 1) * WHEEL_LN_BITS))) {
+            ++level;
+        }
+        slot = &m_wheelN[level][(expires >> (WHEEL_L0_BITS + level * WHEEL_LN_BITS)) & (WHEEL_LN_SIZE - 1)];
+    }
+
+    // 插入槽的头部
+    timer->m_wheelSlot = slot;
+    timer->m_wheelPrev = nullptr;
+    timer->m_wheelNext = *slot;
+    if(*slot) {
+        (*slot)->m_wheelPrev = timer.get();
+    }
+    *slot = timer.get();
+    ++m_wheelSize;
+    Timer* raw = timer.get();
+    raw->m_wheelHolder = std::move(timer);
+}
+
+Timer::ptr TimerManager::wheelRemove(Timer* timer) {
+    Timer** slot = timer->m_wheelSlot;
+    if(!slot) {
+        return nullptr;
+    }
+    if(timer->m_wheelPrev) {
+        timer->m_wheelPrev->m_wheelNext = timer->m_wheelNext;
+    }else {
+        *slot = timer->m_wheelNext;
+    }
+    if(timer->m_wheelNext) {
+        timer->m_wheelNext->m_wheelPrev = timer->m_wheelPrev;
+    }
+    if(slot >= m_wheel0 && slot < m_wheel0 + WHEEL_L0_SIZE) {
+        --m_wheel0Size;
+        if(!*slot) {
+            size_t i = slot - m_wheel0;
+            m_wheelBitmap[i / 64] &= ~(1ull << (i % 64));
+        }
+    }
+    --m_wheelSize;
+    timer->m_wheelSlot = nullptr;
+    timer->m_wheelPrev = nullptr;
+    timer->m_wheelNext = nullptr;
+    return std::move(timer->m_wheelHolder);
+}
+
+void TimerManager::wheelCascade(Timer** slot) {
+    while(*slot) {
+        wheelInsert(wheelRemove(*slot));
+    }
+}
+
+void TimerManager::wheelAdvance(uint64_t nowMs, std::vector<Timer::ptr>& expired) {
+    while(m_wheelTick <= nowMs) {
+        // 没有定时器，直接跳到当前时刻
+        if(0 == m_wheelSize) {
+            m_wheelTick = nowMs + 1;
+            break;
+        }
+        size_t index = m_wheelTick & (WHEEL_L0_SIZE - 1);
+        if(0 == index) {
+            // 第0层转完一圈，逐层降层
+            for(int level = 0; level < WHEEL_LEVELS; ++level) {
+                size_t i = (m_wheelTick >> (WHEEL_L0_BITS + level * WHEEL_LN_BITS)) & (WHEEL_LN_SIZE - 1);
+                wheelCascade(&m_wheelN[level][i]);
+                if(0 != i) {
+                    break;
+                }
+            }
+        }else if(0 == m_wheel0Size) {
+            // 第0层为空，跳到下一次降层的时刻
+            m_wheelTick = std::min(nowMs + 1, (m_wheelTick | (WHEEL_L0_SIZE - 1)) + 1);
+            continue;
+        }
+
+        Timer* timer = m_wheel0[index];
+        while(timer) {
+            Timer* next = timer->m_wheelNext;
+            Timer::ptr holder = wheelRemove(timer);
+            if(holder->m_next > m_wheelTick) {
+                // 超出范围被截断的定时器，还没有到期
+                wheelInsert(std::move(holder));
+            }else {
+                expired.emplace_back(std::move(holder));
+            }
+            timer = next;
+        }
+        ++m_wheelTick;
+    }
+}
+
+/**
+ * @brief 查找位图中从start开始的第一个置位
+ * @return 没有返回-1
+ */
+static int FindNextBit(const uint64_t* bitmap, size_t words, size_t start) {
+    for(size_t w = start / 64; w < words; ++w) {
+        uint64_t bits = bitmap[w];
+        if(w == start / 64) {
+            bits &= ~0ull << (start % 64);
+        }
+        if(bits) {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+uint64_t TimerManager::wheelNextExpire() const {
+    if(0 == m_wheelSize) {
+        return ~0ull;
+    }
+    uint64_t next = ~0ull;
+    // 高层有定时器时，最晚在下一次降层时醒来
+    if(m_wheelSize > m_wheel0Size) {
+        next = (m_wheelTick | (WHEEL_L0_SIZE - 1)) + 1;
+    }
+    if(m_wheel0Size > 0) {
+        // 第0层的定时器都在[m_wheelTick, m_wheelTick + WHEEL_L0_SIZE)内
+        const size_t words = WHEEL_L0_SIZE / 64;
+        size_t start = m_wheelTick & (WHEEL_L0_SIZE - 1);
+        int pos = FindNextBit(m_wheelBitmap, words, start);
+        if(pos < 0) {
+            pos = FindNextBit(m_wheelBitmap, words, 0);
+        }
+        uint64_t offset = ((size_t)pos - start) & (WHEEL_L0_SIZE - 1);
+        next = std::min(next, m_wheelTick + offset);
+    }
+    return next;
+}
+
 } // end namespace focus
\ No newline at end of file
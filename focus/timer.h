@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <set>
 #include <vector>
+#include <string>
 #include "mutex.h"
 
 namespace focus {
@@ -71,6 +72,12 @@ private:
     uint64_t m_next = 0; // 执行时间
     std::function<void()> m_cb; // 回调函数
     TimerManager* m_manager = nullptr; // 定时器管理器
+
+    // 时间轮使用的侵入式链表
+    Timer* m_wheelPrev = nullptr; // 槽内前一个定时器
+    Timer* m_wheelNext = nullptr; // 槽内后一个定时器
+    Timer** m_wheelSlot = nullptr; // 所在的槽，不在时间轮中为nullptr
+    Timer::ptr m_wheelHolder; // 在时间轮中时持有自身
 };
 
 /**
@@ -81,10 +88,19 @@ class TimerManager {
 public:
     using RWMutexType = RWMutex;
 
+    /**
+     * @brief 定时器的组织方式
+     */
+    enum Type {
+        SET = 0, // 有序集合，O(logn)
+        WHEEL // 分层时间轮，O(1)
+    };
+
     /**
      * @brief 构造函数
+     * @param[in] type 定时器的组织方式
      */
-    TimerManager();
+    TimerManager(Type type = SET);
 
     /**
      * @brief 析构函数
@@ -124,6 +140,18 @@ public:
      */
     bool hasTimer();
 
+    /**
+     * @brief 获取定时器的组织方式
+     */
+    Type getTimerType() const {
+        return m_type;
+    }
+
+    /**
+     * @brief 根据名称解析组织方式(set, wheel)，无法识别返回SET
+     */
+    static Type TimerTypeFromString(const std::string& name);
+
 protected:
     /**
      * @brief 当有新的定时器插入到首部
@@ -141,11 +169,65 @@ private:
      */
     bool detectClockRollover(uint64_t nowMs);
 
+    /**
+     * @brief 插入定时器，需要持有写锁
+     * @return 是否成为最早执行的定时器
+     */
+    bool insertTimer(const Timer::ptr& timer);
+
+    /**
+     * @brief 移除定时器，需要持有写锁
+     * @return 不在管理器中返回false
+     */
+    bool removeTimer(Timer* timer);
+
+    /**
+     * @brief 插入时间轮
+     */
+    void wheelInsert(Timer::ptr timer);
+
+    /**
+     * @brief 从时间轮移除
+     * @return 时间轮持有的引用，不在时间轮中返回nullptr
+     */
+    Timer::ptr wheelRemove(Timer* timer);
+
+    /**
+     * @brief 将时间轮推进到nowMs，收集到期的定时器
+     */
+    void wheelAdvance(uint64_t nowMs, std::vector<Timer::ptr>& expired);
+
+    /**
+     * @brief 将高层的一个槽重新分配到低层
+     */
+    void wheelCascade(Timer** slot);
+
+    /**
+     * @brief 获取时间轮最早可能执行的时间
+     * @details 高层的定时器只能确定下一次降层的时间，返回值不会晚于实际执行时间
+     */
+    uint64_t wheelNextExpire() const;
+
 private:
+    static const int WHEEL_L0_BITS = 8; // 第0层的位数
+    static const int WHEEL_LN_BITS = 6; // 其余层的位数
+    static const int WHEEL_L0_SIZE = 1 << WHEEL_L0_BITS; // 第0层的槽数
+    static const int WHEEL_LN_SIZE = 1 << WHEEL_LN_BITS; // 其余层的槽数
+    static const int WHEEL_LEVELS = 4; // 第0层以外的层数，共覆盖2^32毫秒
+
+    Type m_type = SET; // 定时器的组织方式
     RWMutexType m_mutex; // 读写锁
     std::set<Timer::ptr, Timer::Comparator> m_timers; // 定时器集合
     bool m_tickled = false; // 是否触发首部插入定时器
     uint64_t m_previousTime = 0; // 上一次执行的时间
+
+    Timer* m_wheel0[WHEEL_L0_SIZE] = {}; // 第0层，每个槽对应1毫秒
+    Timer* m_wheelN[WHEEL_LEVELS][WHEEL_LN_SIZE] = {}; // 其余层
+    uint64_t m_wheelBitmap[WHEEL_L0_SIZE / 64] = {}; // 第0层非空槽的位图
+    uint64_t m_wheelTick = 0; // 下一个要处理的时刻
+    size_t m_wheelSize = 0; // 时间轮中的定时器数
+    size_t m_wheel0Size = 0; // 第0层的定时器数
+    uint64_t m_wheelNextExpire = ~0ull; // 上次计算的最早执行时间
 };
 
 } // end namespace focus
@@ -4,6 +4,10 @@
 #include <execinfo.h>
 #include <sstream>
 #include <sys/time.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <fstream>
+#include <algorithm>
 
 namespace focus {
 
@@ -34,6 +38,158 @@ uint64_t GetCurrentMS() {
     return tv.tv_sec * 1000ul  + tv.tv_usec / 1000;
 }
 
+uint64_t GetCurrentUS() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000 * 1000ul  + tv.tv_usec;
+}
+std::vector<int> ParseCpuList(const std::string& str) {
+    std::vector<int> cpus;
+    std::stringstream ss(str);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        // 去掉空白
+        item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+        if(item.empty()) {
+            continue;
+        }
+        int first = -1;
+        int last = -1;
+        int used = 0;
+        // 整项都要被解析，"3x"、"3-5x"都是错误的
+        bool range = 2 == sscanf(item.c_str(), "%d-%d%n", &first, &last, &used)
+                     && (size_t)used == item.size();
+        if(!range) {
+            used = 0;
+            if(1 != sscanf(item.c_str(), "%d%n", &first, &used) || (size_t)used != item.size()) {
+                return std::vector<int>();
+            }
+            last = first;
+        }
+        if(first < 0 || last < first || last >= CPU_SETSIZE) {
+            return std::vector<int>();
+        }
+        for(int i = first; i <= last; ++i) {
+            cpus.push_back(i);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+/**
+ * @brief 读取sysfs中的CPU列表文件
+ */
+static std::vector<int> ReadCpuListFile(const std::string& path) {
+    std::ifstream ifs(path);
+    std::string line;
+    if(!ifs || !std::getline(ifs, line)) {
+        return std::vector<int>();
+    }
+    return ParseCpuList(line);
+}
+
+/**
+ * @brief CPU和NUMA拓扑，第一次使用时从sysfs读取
+ */
+struct CpuTopology {
+    CpuTopology() {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(0 == sched_getaffinity(0, sizeof(set), &set)) {
+            for(int i = 0; i < CPU_SETSIZE; ++i) {
+                if(CPU_ISSET(i, &set)) {
+                    m_allowed.push_back(i);
+                }
+            }
+        }
+        if(m_allowed.empty()) {
+            for(long i = 0; i < sysconf(_SC_NPROCESSORS_ONLN); ++i) {
+                m_allowed.push_back(i);
+            }
+        }
+
+        // 节点编号可能不连续
+        m_cpuNode.assign(CPU_SETSIZE, 0);
+        std::vector<int> nodes = ReadCpuListFile("/sys/devices/system/node/online");
+        for(auto node: nodes) {
+            std::vector<int> cpus = ReadCpuListFile("/sys/devices/system/node/node"
+                + std::to_string(node) + "/cpulist");
+            for(auto cpu: cpus) {
+                m_cpuNode[cpu] = node;
+            }
+            m_nodeCount = std::max(m_nodeCount, node + 1);
+        }
+        FOCUS_LOG_INFO(g_logger) << "cpu topology allowed cpus = " << m_allowed.size()
+                                 << " numa nodes = " << m_nodeCount;
+    }
+
+    std::vector<int> m_allowed; // 进程允许运行的CPU
+    std::vector<int> m_cpuNode; // CPU所属的节点
+    int m_nodeCount = 1; // 节点数
+};
+
+static CpuTopology& GetCpuTopology() {
+    static CpuTopology s_topology;
+    return s_topology;
+}
+
+int GetNumaNodeCount() {
+    return GetCpuTopology().m_nodeCount;
+}
+
+int GetCpuNumaNode(int cpu) {
+    CpuTopology& topology = GetCpuTopology();
+    if(cpu < 0 || cpu >= (int)topology.m_cpuNode.size()) {
+        return 0;
+    }
+    return topology.m_cpuNode[cpu];
+}
+
+int GetCurrentNumaNode() {
+    return GetCpuNumaNode(sched_getcpu());
+}
+
+size_t GetFdLimit() {
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) || RLIM_INFINITY == rl.rlim_cur) {
+        return 1024;
+    }
+    return rl.rlim_cur;
+}
+
+std::vector<int> GetSpreadCpus() {
+    CpuTopology& topology = GetCpuTopology();
+    // 每个节点内，先放每个物理核的第一个超线程，再放其余的超线程
+    std::vector<std::vector<int>> nodeCpus(topology.m_nodeCount);
+    std::vector<std::vector<int>> nodeSiblings(topology.m_nodeCount);
+    for(auto cpu: topology.m_allowed) {
+        std::vector<int> siblings = ReadCpuListFile("/sys/devices/system/cpu/cpu"
+            + std::to_string(cpu) + "/topology/thread_siblings_list");
+        int node = GetCpuNumaNode(cpu);
+        if(siblings.empty() || siblings[0] == cpu) {
+            nodeCpus[node].push_back(cpu);
+        }else {
+            nodeSiblings[node].push_back(cpu);
+        }
+    }
+    for(int i = 0; i < topology.m_nodeCount; ++i) {
+        nodeCpus[i].insert(nodeCpus[i].end(), nodeSiblings[i].begin(), nodeSiblings[i].end());
+    }
+
+    // 各节点轮流取
+    std::vector<int> cpus;
+    for(size_t round = 0; cpus.size() < topology.m_allowed.size(); ++round) {
+        for(auto& i: nodeCpus) {
+            if(round < i.size()) {
+                cpus.push_back(i[round]);
+            }
+        }
+    }
+    return cpus;
+}
+
 // 将编译器读取的函数名编码转成看得懂的
 static std::string demangle(const char* str) {
     size_t size = 0;
@@ -26,6 +26,44 @@ uint64_t GetFiberId();
 // 获取当前时间的毫秒
 uint64_t GetCurrentMS();
 
+// 获取当前时间的微秒
+uint64_t GetCurrentUS();
+
+/**
+ * @brief 解析CPU列表
+ * @param[in] str 格式同sysfs的cpulist，如"0-3,8,10-11"
+ * @return 按升序排列的CPU编号，格式错误返回空
+ */
+std::vector<int> ParseCpuList(const std::string& str);
+
+/**
+ * @brief 获取NUMA节点数，没有NUMA信息时为1
+ */
+int GetNumaNodeCount();
+
+/**
+ * @brief 获取CPU所属的NUMA节点，未知返回0
+ */
+int GetCpuNumaNode(int cpu);
+
+/**
+ * @brief 获取当前线程正在运行的NUMA节点
+ */
+int GetCurrentNumaNode();
+
+/**
+ * @brief 获取自动分散放置时使用的CPU顺序
+ * @details 只包含进程允许运行的CPU，在各NUMA节点间轮流选择，
+ *          同一节点内先选不同的物理核，再选同一物理核的超线程
+ */
+std::vector<int> GetSpreadCpus();
+
+/**
+ * @brief 获取进程可以打开的文件数上限(RLIMIT_NOFILE当前值)
+ * @details 只作为按fd索引的表的初始容量，上限调高后表会继续增长
+ */
+size_t GetFdLimit();
+
 /**
  * @brief 获取当前调用栈
  * @param[out] bt 保存调用栈
@@ -0,0 +1,138 @@
+#ifndef __FOCUS_WORKSTEALQUEUE_H__
+#define __FOCUS_WORKSTEALQUEUE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "nocopyable.h"
+
+namespace focus {
+
+/**
+ * @brief 有界无锁工作窃取双端队列(Chase-Lev)
+ * @tparam T 元素类型，必须是指针
+ * @details 只有队列的所属线程可以调用push和pop(操作队尾)，
+ *          其他线程只能调用steal(操作队首)
+ */
+template<class T>
+class WorkStealQueue: public Nocopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量，会向上取整到2的幂
+     */
+    WorkStealQueue(size_t capacity = 256) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_mask = cap - 1;
+        m_buffer = new std::atomic<T>[cap];
+        for(size_t i = 0; i < cap; ++i) {
+            m_buffer[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 析构函数
+     * @attention 不会释放剩余元素
+     */
+    ~WorkStealQueue() {
+        delete[] m_buffer;
+    }
+
+    /**
+     * @brief 获取容量
+     */
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+    /**
+     * @brief 获取元素个数(近似值)
+     */
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t? (size_t)(b - t): 0;
+    }
+
+    /**
+     * @brief 是否为空(近似值)
+     */
+    bool empty() const {
+        return 0 == size();
+    }
+
+    /**
+     * @brief 队尾插入，只能由所属线程调用
+     * @param[in] v 元素
+     * @return 队列已满返回false
+     */
+    bool push(T v) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if(b - t > (int64_t)m_mask) {
+            return false;
+        }
+        m_buffer[b & m_mask].store(v, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief 队尾弹出，只能由所属线程调用
+     * @return 队列为空返回nullptr
+     */
+    T pop() {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if(t > b) {
+            // 空队列
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T v = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+        if(t == b) {
+            // 最后一个元素，与窃取者竞争
+            if(!m_top.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                v = nullptr;
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return v;
+    }
+
+    /**
+     * @brief 队首窃取，可由任意线程调用
+     * @return 队列为空或者竞争失败返回nullptr
+     */
+    T steal() {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return nullptr;
+        }
+        T v = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        if(!m_top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return v;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> m_top = {0}; // 队首，窃取端
+    alignas(64) std::atomic<int64_t> m_bottom = {0}; // 队尾，所属线程端
+    std::atomic<T>* m_buffer = nullptr; // 环形缓冲区
+    size_t m_mask = 0; // 容量掩码
+};
+
+} // end namespace focus
+
+#endif
@@ -0,0 +1,95 @@
+#include "scheduler.h"
+#include "config.h"
+#include "util.h"
+#include <atomic>
+#include <algorithm>
+#include <sched.h>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_affinity");
+
+/**
+ * @brief CPU列表解析
+ */
+int testParseCpuList() {
+    int failed = 0;
+    failed += (std::vector<int>{0, 1, 2, 3, 8, 10, 11} == ParseCpuList("0-3, 8,10-11"))? 0: 1;
+    failed += (std::vector<int>{1, 2} == ParseCpuList("2,1,2"))? 0: 1;
+    failed += ParseCpuList("3-1").empty()? 0: 1;
+    failed += ParseCpuList("a").empty()? 0: 1;
+    // 有多余字符的项都是错误的
+    failed += ParseCpuList("3x").empty()? 0: 1;
+    failed += ParseCpuList("3,4junk").empty()? 0: 1;
+    failed += ParseCpuList("3-5x").empty()? 0: 1;
+    failed += ParseCpuList("3-").empty()? 0: 1;
+    FOCUS_LOG_INFO(g_logger) << "parse cpu list failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 按配置启动调度器，检查每个调度线程的亲和性
+ * @param[in] expect 每个线程应该绑定的CPU，为空表示不绑定
+ */
+int testScheduler(const std::vector<std::vector<int>>& expect, size_t threads) {
+    std::atomic<int> done = {0};
+    std::atomic<int> wrong = {0};
+    Scheduler sc(threads, false, "affinity");
+    sc.start();
+    // 绑定到每个线程执行一次
+    const std::vector<int> ids = sc.getThreadIds();
+    for(size_t i = 0; i < ids.size(); ++i) {
+        sc.schedule([&, i](){
+            std::vector<int> cpus = Thread::GetThis()->getAffinity();
+            bool ok = expect.empty() || cpus == expect[i];
+            // 绑定后一定运行在允许的CPU上
+            ok = ok && std::find(cpus.begin(), cpus.end(), sched_getcpu()) != cpus.end();
+            wrong += ok? 0: 1;
+            ++done;
+        }, ids[i]);
+    }
+    // 未绑定线程的任务也能执行完
+    for(int i = 0; i < 1000; ++i) {
+        sc.schedule([&done](){
+            ++done;
+        });
+    }
+    while(done < (int)ids.size() + 1000) {
+        usleep(1000);
+    }
+    sc.stop();
+    FOCUS_LOG_INFO(g_logger) << "threads = " << threads << " pinned = " << !expect.empty()
+                             << " wrong = " << wrong;
+    return wrong;
+}
+
+int main(int argc, char* argv[]) {
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    int failed = 0;
+    failed += testParseCpuList();
+
+    std::vector<int> spread = GetSpreadCpus();
+    FOCUS_LOG_INFO(g_logger) << "numa nodes = " << GetNumaNodeCount()
+                             << " spread cpus = " << spread.size()
+                             << " current node = " << GetCurrentNumaNode();
+    failed += spread.empty()? 1: 0;
+
+    // 不绑定
+    failed += testScheduler({}, 2);
+
+    // 自动分散，线程数多于CPU时循环使用
+    Config::LookUpBase("scheduler.auto_affinity")->fromString("true");
+    std::vector<std::vector<int>> expect;
+    for(size_t i = 0; i < 3; ++i) {
+        expect.push_back({spread[i % spread.size()]});
+    }
+    failed += testScheduler(expect, 3);
+
+    // 显式指定CPU集合，优先于自动分散
+    std::string first = std::to_string(spread[0]);
+    Config::LookUpBase("scheduler.cpu_sets")->fromString("[\"" + first + "\", \"" + first + "-" + first + "\"]");
+    failed += testScheduler({{spread[0]}, {spread[0]}}, 2);
+
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
@@ -0,0 +1,244 @@
+#include "channel.h"
+#include "iomanager.h"
+#include "log.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_channel");
+
+/**
+ * @brief 等待计数到达目标值
+ */
+static void WaitFor(std::atomic<int>& count, int target) {
+    while(count < target) {
+        usleep(1000);
+    }
+}
+
+/**
+ * @brief 有界通道的try操作和关闭
+ */
+int testTryAndClose() {
+    Channel<int> ch(4);
+    int failed = 0;
+    for(int i = 0; i < 4; ++i) {
+        failed += ch.trySend(i)? 0: 1;
+    }
+    // 已满
+    failed += ch.trySend(4)? 1: 0;
+    int v = -1;
+    failed += (ch.tryRecv(v) && 0 == v)? 0: 1;
+    failed += ch.trySend(4)? 0: 1;
+    ch.close();
+    // 关闭后不能发送，剩余的数据还能取出
+    failed += ch.send(5)? 1: 0;
+    for(int i = 1; i <= 4; ++i) {
+        failed += (ch.recv(v) && i == v)? 0: 1;
+    }
+    failed += ch.recv(v)? 1: 0;
+    FOCUS_LOG_INFO(g_logger) << "try and close failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 有界通道，多生产者多消费者，发送和接收都会挂起
+ */
+int testBounded(IOManager& iom) {
+    Channel<int> ch(8);
+    const int producers = 16;
+    const int consumers = 16;
+    const int items = 5000;
+    std::atomic<int> sent = {0};
+    std::atomic<int> done = {0};
+    std::atomic<uint64_t> sum = {0};
+    for(int i = 0; i < producers; ++i) {
+        iom.schedule([&](){
+            for(int j = 1; j <= items; ++j) {
+                ch.send(j);
+            }
+            if(producers == ++sent) {
+                ch.close();
+            }
+        });
+    }
+    for(int i = 0; i < consumers; ++i) {
+        iom.schedule([&](){
+            int v = 0;
+            while(ch.recv(v)) {
+                sum += v;
+            }
+            ++done;
+        });
+    }
+    WaitFor(done, consumers);
+    uint64_t expect = (uint64_t)producers * items * (items + 1) / 2;
+    FOCUS_LOG_INFO(g_logger) << "bounded sum = " << sum << " expect = " << expect;
+    return sum == expect? 0: 1;
+}
+
+/**
+ * @brief 无界通道，线程发送协程接收，同一个发送者的数据保持顺序
+ */
+int testUnbounded(IOManager& iom) {
+    Channel<int> ch(0, 64);
+    const int items = 100000;
+    std::atomic<int> done = {0};
+    int wrong = 0;
+    iom.schedule([&](){
+        int v = 0;
+        int expect = 0;
+        while(ch.recv(v)) {
+            if(v != expect++) {
+                ++wrong;
+            }
+        }
+        wrong += (expect == items)? 0: 1;
+        ++done;
+    });
+    // 无界通道发送不会阻塞
+    for(int i = 0; i < items; ++i) {
+        ch.send(i);
+    }
+    ch.close();
+    WaitFor(done, 1);
+    FOCUS_LOG_INFO(g_logger) << "unbounded items = " << items << " wrong = " << wrong;
+    return wrong;
+}
+
+/**
+ * @brief select多个通道，超时使用IOManager的定时器
+ */
+int testSelect(IOManager& iom) {
+    Channel<int> a(1);
+    Channel<std::string> b(1);
+    std::atomic<int> done = {0};
+    int failed = 0;
+    iom.schedule([&](){
+        int x = 0;
+        std::string y;
+        Channel<int>::RecvCase ra(&a, x);
+        Channel<std::string>::RecvCase rb(&b, y);
+
+        // 都没有数据，超时
+        uint64_t start = GetCurrentMS();
+        int idx = Select({&ra, &rb}, 50);
+        uint64_t used = GetCurrentMS() - start;
+        if(-1 != idx || used < 40) {
+            ++failed;
+        }
+
+        // 定时器中发送，挂起后被唤醒
+        iom.addTimer([&](){
+            b.trySend(std::string("hello"));
+        }, 20);
+        idx = Select({&ra, &rb}, 1000);
+        if(1 != idx || !rb.isOk() || "hello" != y) {
+            ++failed;
+        }
+
+        // 发送分支，通道已满时等待接收
+        a.trySend(1);
+        Channel<int>::SendCase sa(&a, 2);
+        iom.addTimer([&](){
+            int v = 0;
+            a.tryRecv(v);
+        }, 20);
+        idx = Select({&sa, &rb}, 1000);
+        if(0 != idx || !sa.isOk()) {
+            ++failed;
+        }
+
+        // 关闭唤醒
+        iom.addTimer([&](){
+            b.close();
+        }, 20);
+        a.tryRecv(x);
+        idx = Select({&ra, &rb});
+        if(1 != idx || rb.isOk()) {
+            ++failed;
+        }
+        ++done;
+    });
+    WaitFor(done, 1);
+    FOCUS_LOG_INFO(g_logger) << "select failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 协程之间的吞吐量
+ */
+void benchFiberToFiber(IOManager& iom, size_t capacity, int items) {
+    Channel<int> ch(capacity);
+    std::atomic<int> done = {0};
+    auto start = std::chrono::steady_clock::now();
+    iom.schedule([&](){
+        for(int i = 0; i < items; ++i) {
+            ch.send(i);
+        }
+        ch.close();
+    });
+    iom.schedule([&](){
+        int v = 0;
+        while(ch.recv(v)) {
+        }
+        ++done;
+    });
+    WaitFor(done, 1);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    FOCUS_LOG_INFO(g_logger) << "fiber->fiber capacity=" << capacity << " "
+        << (double)ns / items << " ns/msg " << (uint64_t)(items * 1e9 / ns) << " msg/s";
+}
+
+/**
+ * @brief 线程到协程的吞吐量
+ */
+void benchThreadToFiber(IOManager& iom, size_t capacity, int items) {
+    Channel<int> ch(capacity);
+    std::atomic<int> done = {0};
+    auto start = std::chrono::steady_clock::now();
+    iom.schedule([&](){
+        int v = 0;
+        while(ch.recv(v)) {
+        }
+        ++done;
+    });
+    std::thread producer([&](){
+        for(int i = 0; i < items; ++i) {
+            ch.send(i);
+        }
+        ch.close();
+    });
+    producer.join();
+    WaitFor(done, 1);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    FOCUS_LOG_INFO(g_logger) << "thread->fiber capacity=" << capacity << " "
+        << (double)ns / items << " ns/msg " << (uint64_t)(items * 1e9 / ns) << " msg/s";
+}
+
+int main(int argc, char* argv[]) {
+    // 关闭系统日志
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    int items = argc > 1? atoi(argv[1]): 1000000;
+    int failed = testTryAndClose();
+    {
+        IOManager iom(4, false, "channel");
+        failed += testBounded(iom);
+        failed += testUnbounded(iom);
+        failed += testSelect(iom);
+    }
+    {
+        IOManager iom(2, false, "channel_bench");
+        benchFiberToFiber(iom, 1, items / 10);
+        benchFiberToFiber(iom, 1024, items);
+        benchFiberToFiber(iom, 0, items);
+        benchThreadToFiber(iom, 1024, items);
+        benchThreadToFiber(iom, 0, items);
+    }
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
@@ -0,0 +1,170 @@
+#include "config.h"
+#include "thread.h"
+#include <atomic>
+#include <chrono>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_config_read");
+
+static ConfigVar<uint32_t>::ptr g_int_value =
+    Config::LookUp<uint32_t>("test.int_value", 1, "test int value");
+
+static ConfigVar<std::vector<int>>::ptr g_vec_value =
+    Config::LookUp("test.vec_value", std::vector<int>(64, 0), "test vector value");
+
+/**
+ * @brief 读线程看到的快照必须完整，不会读到一半修改的值
+ */
+int testConsistency() {
+    std::atomic<bool> stop = {false};
+    std::atomic<int> wrong = {0};
+    std::atomic<uint64_t> reads = {0};
+    std::vector<Thread::ptr> threads;
+    for(int i = 0; i < 3; ++i) {
+        threads.emplace_back(new Thread([&](){
+            uint64_t count = 0;
+            while(!stop) {
+                ConfigSnapshot<std::vector<int>> snap = g_vec_value->getSnapshot();
+                const std::vector<int>& vec = snap;
+                for(auto v: vec) {
+                    if(v != vec[0]) {
+                        ++wrong;
+                        break;
+                    }
+                }
+                ++count;
+            }
+            reads += count;
+        }, "reader_" + std::to_string(i)));
+    }
+    int changes = 0;
+    for(int i = 1; i <= 2000; ++i) {
+        g_vec_value->setVal(std::vector<int>(64, i));
+        g_int_value->setVal(i);
+        ++changes;
+        if(0 == i % 100) {
+            usleep(1000);
+        }
+    }
+    stop = true;
+    for(auto& i: threads) {
+        i->join();
+    }
+    // 修改后立即可以读到新值
+    int failed = wrong;
+    failed += (2000 == g_vec_value->getVal()[63] && 2000 == g_int_value->getVal())? 0: 1;
+    FOCUS_LOG_INFO(g_logger) << "consistency changes = " << changes << " reads = " << reads
+                             << " wrong = " << wrong;
+    return failed;
+}
+
+/**
+ * @brief 回调函数中看到的旧值和新值
+ */
+int testCallBack() {
+    int failed = 0;
+    std::vector<int> oldSeen;
+    std::vector<int> newSeen;
+    uint64_t id = g_vec_value->addCallBack([&](const std::vector<int>& oldVal, const std::vector<int>& newVal){
+        oldSeen = oldVal;
+        newSeen = newVal;
+    });
+    // 持有的快照不受修改影响
+    ConfigSnapshot<std::vector<int>> before = g_vec_value->getSnapshot();
+    g_vec_value->fromString("[1, 2, 3]");
+    failed += (std::vector<int>{1, 2, 3} == newSeen && oldSeen == *before)? 0: 1;
+    failed += (64 == before->size() && 3 == g_vec_value->getVal().size())? 0: 1;
+    failed += ("- 1\n- 2\n- 3" == g_vec_value->toString())? 0: 1;
+    g_vec_value->delCallBack(id - 1);
+    FOCUS_LOG_INFO(g_logger) << "callback failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 读取开销
+ */
+template<class Fun>
+void bench(const char* name, Fun fun) {
+    const int count = 2000000;
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < count; ++i) {
+        sum += fun();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    FOCUS_LOG_INFO(g_logger) << name << " " << (double)ns / count << " ns sum = " << sum;
+}
+
+static ConfigKey<uint32_t> s_int_key("test.int_value", 7, "same variable as g_int_value");
+static ConfigKey<std::string> s_str_key("test.str_value", "hello", "test string value");
+
+/**
+ * @brief 类型化的键和重复查找
+ */
+int testConfigKey() {
+    int failed = 0;
+    // 已经存在的变量，默认值不生效
+    failed += (s_int_key.get() == g_int_value.get() && 2000 == s_int_key.getVal())? 0: 1;
+    failed += ("hello" == *s_str_key.getVal() && s_str_key.get() == s_str_key.get())? 0: 1;
+    failed += (Config::LookUp<std::string>("test.str_value").get() == s_str_key.get())? 0: 1;
+    // getVal按值返回
+    failed += ("hellox" == s_str_key->getVal() + "x" && 5 == s_str_key->getVal().size())? 0: 1;
+    // 类型不匹配
+    failed += (nullptr == Config::LookUp<int>("test.str_value", 0))? 0: 1;
+    ConfigKey<int> wrong("test.str_value", 0);
+    try {
+        wrong.get();
+        ++failed;
+    } catch(std::invalid_argument&) {
+    }
+    // 注册大量变量
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < 500; ++i) {
+        Config::LookUp<int>("test.many.var_" + std::to_string(i), i, "many vars");
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    failed += (499 == Config::LookUp<int>("test.many.var_499")->getVal())? 0: 1;
+    FOCUS_LOG_INFO(g_logger) << "config key failed = " << failed << " register 500 vars " << us << " us";
+    return failed;
+}
+
+int main(int argc, char* argv[]) {
+    int failed = 0;
+    failed += testConsistency();
+    failed += testCallBack();
+    failed += testConfigKey();
+
+    // 对比加读锁并拷贝的读取方式
+    RWMutex mutex;
+    std::vector<int> vec(64, 1);
+    uint32_t value = 1;
+    bench("locked copy uint32", [&](){
+        RWMutex::ReadLock lock(mutex);
+        return value;
+    });
+    bench("getVal uint32", [](){
+        return g_int_value->getVal();
+    });
+    bench("locked copy vector", [&](){
+        RWMutex::ReadLock lock(mutex);
+        std::vector<int> copy = vec;
+        return copy.size();
+    });
+    bench("getVal vector", [](){
+        return g_vec_value->getVal().size();
+    });
+    bench("getSnapshot vector", [](){
+        return g_vec_value->getSnapshot()->size();
+    });
+    bench("LookUp existing", [](){
+        return Config::LookUp<uint32_t>("test.int_value", 1, "test int value")->getVal();
+    });
+    bench("ConfigKey", [](){
+        return s_int_key.getVal();
+    });
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
@@ -0,0 +1,97 @@
+#include "configwatcher.h"
+#include "config.h"
+#include <fstream>
+#include <atomic>
+#include <stdlib.h>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_config_watcher");
+
+static ConfigVar<int>::ptr g_watch_a =
+    Config::LookUp("watch.a", 0, "watched value a");
+
+static ConfigVar<std::vector<int>>::ptr g_watch_b =
+    Config::LookUp("watch.b", std::vector<int>(), "watched value b");
+
+/**
+ * @brief 写入配置文件
+ */
+static void WriteFile(const std::string& path, const std::string& content) {
+    std::ofstream ofs(path, std::ios::trunc);
+    ofs << content;
+}
+
+/**
+ * @brief 等待条件成立，最多等待timeoutMs毫秒
+ */
+template<class Cond>
+static bool WaitFor(Cond cond, uint64_t timeoutMs) {
+    uint64_t end = GetCurrentMS() + timeoutMs;
+    while(!cond() && GetCurrentMS() < end) {
+        usleep(10000);
+    }
+    return cond();
+}
+
+int main(int argc, char* argv[]) {
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::ERROR);
+    int failed = 0;
+    char tmpl[] = "/tmp/focus_conf_XXXXXX";
+    std::string dir = mkdtemp(tmpl);
+    std::string file = dir + "/app.yml";
+    WriteFile(file, "watch:\n  a: 1\n  b: [1, 2]\n");
+    failed += (2 == Config::LoadFromConfDir(dir) && 1 == g_watch_a->getVal())? 0: 1;
+    // 内容没有变化，不再应用
+    failed += (0 == Config::LoadFromConfDir(dir))? 0: 1;
+    // 当前值被修改过，文件没变也要重新应用
+    g_watch_a->setVal(5);
+    failed += (1 == Config::LoadFromConfDir(dir) && 1 == g_watch_a->getVal())? 0: 1;
+
+    std::atomic<int> aChanges = {0};
+    std::atomic<int> bChanges = {0};
+    g_watch_a->addCallBack([&aChanges](const int& oldVal, const int& newVal){
+        ++aChanges;
+    });
+    g_watch_b->addCallBack([&bChanges](const std::vector<int>& oldVal, const std::vector<int>& newVal){
+        ++bChanges;
+    });
+
+    IOManager iom(1, false, "config_watcher");
+    ConfigWatcher::ptr watcher(new ConfigWatcher(&iom, dir));
+    failed += watcher->start()? 0: 1;
+
+    // 只修改a，b的回调不触发
+    WriteFile(file, "watch:\n  a: 2\n  b: [1, 2]\n");
+    failed += WaitFor([&](){ return 2 == g_watch_a->getVal(); }, 2000)? 0: 1;
+    failed += (1 == aChanges && 0 == bChanges && 1 == watcher->getLastApplied())? 0: 1;
+    FOCUS_LOG_INFO(g_logger) << "single change reloads = " << watcher->getReloadCount()
+                             << " applied = " << watcher->getLastApplied();
+
+    // 连续保存多次只加载一次
+    uint64_t reloads = watcher->getReloadCount();
+    for(int i = 3; i <= 22; ++i) {
+        WriteFile(file, "watch:\n  a: " + std::to_string(i) + "\n  b: [1, 2, 3]\n");
+        usleep(2000);
+    }
+    failed += WaitFor([&](){ return 22 == g_watch_a->getVal(); }, 2000)? 0: 1;
+    usleep(500 * 1000);
+    uint64_t stormReloads = watcher->getReloadCount() - reloads;
+    failed += (1 == stormReloads && 2 == aChanges && 1 == bChanges)? 0: 1;
+    FOCUS_LOG_INFO(g_logger) << "save storm writes = 20 reloads = " << stormReloads
+                             << " a changes = " << aChanges << " b changes = " << bChanges;
+
+    // 非yaml文件不触发
+    reloads = watcher->getReloadCount();
+    WriteFile(dir + "/notes.txt", "hello");
+    usleep(500 * 1000);
+    failed += (reloads == watcher->getReloadCount())? 0: 1;
+
+    watcher->stop();
+    iom.stop();
+    unlink(file.c_str());
+    unlink((dir + "/notes.txt").c_str());
+    rmdir(dir.c_str());
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
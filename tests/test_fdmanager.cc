@@ -0,0 +1,211 @@
+#include "fdmanager.h"
+#include "iomanager.h"
+#include "hook.h"
+#include "thread.h"
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_fdmanager");
+
+// 统计当前线程的内存分配次数
+static thread_local uint64_t t_allocs = 0;
+
+void* operator new(size_t size) {
+    ++t_allocs;
+    void* p = malloc(size? size: 1);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+/**
+ * @brief 创建、查找、删除句柄上下文
+ */
+int testLifecycle() {
+    int failed = 0;
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    FdManager* mgr = FdMgr::GetInstance();
+    failed += mgr->get(fds[0])? 1: 0;
+    auto ctx = mgr->get(fds[0], true);
+    failed += (ctx && ctx->isSocket() && ctx->getSysNonblock() && !ctx->isClose())? 0: 1;
+    failed += (mgr->get(fds[0]) == ctx)? 0: 1;
+    mgr->del(fds[0]);
+    failed += mgr->get(fds[0])? 1: 0;
+    // 删除前取到的上下文仍然可以访问，看到的是已经关闭
+    failed += ctx->isClose()? 0: 1;
+    // 重新创建时原地初始化
+    failed += (mgr->get(fds[0], true) == ctx && !ctx->isClose())? 0: 1;
+    mgr->del(fds[0]);
+    // 负数和没有创建的fd
+    failed += mgr->get(-1, true)? 1: 0;
+    failed += mgr->get(1 << 30)? 1: 0;
+    // 超过原来固定上限的fd也能创建
+    failed += mgr->get((1 << 20) + 5, true)? 0: 1;
+    mgr->del((1 << 20) + 5);
+    // 大于默认容量的fd
+    int big = dup2(fds[1], 5000);
+    failed += (5000 == big && mgr->get(big, true) && mgr->get(big)->isSocket())? 0: 1;
+    mgr->del(big);
+    close(big);
+    close(fds[0]);
+    close(fds[1]);
+    FOCUS_LOG_INFO(g_logger) << "lifecycle failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 多线程并发查找的开销
+ * @param[in] threads 线程数
+ */
+void benchLookup(int threads) {
+    const int count = 5000000;
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    FdMgr::GetInstance()->get(fds[0], true);
+    std::atomic<uint64_t> totalNs = {0};
+    std::atomic<uint64_t> found = {0};
+    std::vector<Thread::ptr> workers;
+    for(int t = 0; t < threads; ++t) {
+        workers.emplace_back(new Thread([&](){
+            uint64_t n = 0;
+            auto start = std::chrono::steady_clock::now();
+            for(int i = 0; i < count; ++i) {
+                auto ctx = FdMgr::GetInstance()->get(fds[0]);
+                n += ctx && ctx->isSocket()? 1: 0;
+            }
+            totalNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            found += n;
+        }, "lookup_" + std::to_string(t)));
+    }
+    for(auto& i: workers) {
+        i->join();
+    }
+    FOCUS_LOG_INFO(g_logger) << "FdManager::get threads = " << threads << " "
+                             << (double)totalNs / threads / count << " ns/lookup found = " << found;
+    FdMgr::GetInstance()->del(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * @brief 协程中hook的read开销，数据已经就绪，不会挂起
+ */
+int benchHookedRead() {
+    const int count = 200000;
+    int failed = 0;
+    IOManager iom(1, false, "hooked_read");
+    std::atomic<bool> done = {false};
+    iom.schedule([&done, &failed](){
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        FdMgr::GetInstance()->get(fds[0], true);
+        FdMgr::GetInstance()->get(fds[1], true);
+        // 设置了超时时间也不会在不阻塞时分配
+        struct timeval tv = {1, 0};
+        setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char buf[1] = {'x'};
+        uint64_t readNs = 0;
+        uint64_t allocs = t_allocs;
+        for(int i = 0; i < count; ++i) {
+            write_f(fds[1], buf, 1);
+            auto start = std::chrono::steady_clock::now();
+            read(fds[0], buf, 1);
+            readNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+        allocs = t_allocs - allocs;
+        // 同样的系统调用不经过hook
+        uint64_t rawNs = 0;
+        for(int i = 0; i < count; ++i) {
+            write_f(fds[1], buf, 1);
+            auto start = std::chrono::steady_clock::now();
+            read_f(fds[0], buf, 1);
+            rawNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+        FOCUS_LOG_INFO(g_logger) << "hooked read " << (double)readNs / count << " ns, raw read "
+                                 << (double)rawNs / count << " ns, hook overhead "
+                                 << ((double)readNs - rawNs) / count << " ns, allocs = " << allocs;
+        failed = allocs? 1: 0;
+        close(fds[0]);
+        close(fds[1]);
+        done = true;
+    });
+    while(!done) {
+        usleep(1000);
+    }
+    iom.stop();
+    return failed;
+}
+
+/**
+ * @brief 阻塞的hook读超时，以及超时前就绪时定时器不会影响之后的等待
+ */
+int testReadTimeout() {
+    int failed = 0;
+    IOManager iom(1, false, "read_timeout");
+    std::atomic<bool> done = {false};
+    iom.schedule([&](){
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        FdMgr::GetInstance()->get(fds[0], true);
+        FdMgr::GetInstance()->get(fds[1], true);
+        struct timeval tv = {0, 50000};
+        setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char buf[1] = {'x'};
+        // 没有数据，超时返回
+        uint64_t start = GetCurrentMS();
+        ssize_t n = read(fds[0], buf, 1);
+        uint64_t used = GetCurrentMS() - start;
+        failed += (-1 == n && ETIMEDOUT == errno && used >= 45)? 0: 1;
+        // 超时前写入，读成功
+        for(int i = 0; i < 5; ++i) {
+            IOManager::GetThis()->addTimer([fds](){
+                write_f(fds[1], "y", 1);
+            }, 10);
+            n = read(fds[0], buf, 1);
+            failed += (1 == n && 'y' == buf[0])? 0: 1;
+        }
+        // 之前的定时器已经取消，完整等待一次超时
+        start = GetCurrentMS();
+        n = read(fds[0], buf, 1);
+        used = GetCurrentMS() - start;
+        failed += (-1 == n && ETIMEDOUT == errno && used >= 45)? 0: 1;
+        close(fds[0]);
+        close(fds[1]);
+        done = true;
+    });
+    while(!done) {
+        usleep(1000);
+    }
+    iom.stop();
+    FOCUS_LOG_INFO(g_logger) << "read timeout failed = " << failed;
+    return failed;
+}
+
+int main(int argc, char* argv[]) {
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::ERROR);
+    int failed = testLifecycle();
+    benchLookup(1);
+    benchLookup(4);
+    failed += testReadTimeout();
+    failed += benchHookedRead();
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
@@ -27,5 +27,14 @@ int main(int argc, char* argv[]) {
     vecs[0]->resume();
     sleep(1);
     vecs[1]->resume();
+    vecs.clear();
+
+    // 反复创建销毁协程，栈从栈池中复用
+    for(int i = 0; i < 100; ++i) {
+        Fiber::ptr fiber(new Fiber([](){}, 0, false));
+        fiber->resume();
+    }
+    FOCUS_LOG_DEBUG(g_logger) << "stack pool hits = " << Fiber::StackPoolHits()
+                              << " misses = " << Fiber::StackPoolMisses();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "fiber.h"
+#include "scheduler.h"
+#include "log.h"
+#include <atomic>
+#include <chrono>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_fiber_local");
+
+/**
+ * @brief 统计构造和析构次数
+ */
+struct Counted {
+    Counted() {
+        ++s_created;
+    }
+    ~Counted() {
+        ++s_destroyed;
+    }
+
+    uint64_t m_value = 0;
+    static std::atomic<int> s_created;
+    static std::atomic<int> s_destroyed;
+};
+
+std::atomic<int> Counted::s_created = {0};
+std::atomic<int> Counted::s_destroyed = {0};
+
+static FiberLocal<Counted> s_counted;
+static FiberLocal<uint64_t> s_value;
+static thread_local uint64_t t_value = 0;
+
+/**
+ * @brief 让出执行权并重新调度自己，协程可能被其他线程窃取
+ */
+static void YieldFiber() {
+    Scheduler::GetThis()->schedule(Fiber::GetThis());
+    Fiber::GetThis()->yield();
+}
+
+/**
+ * @brief 等待计数到达目标值
+ */
+static void WaitFor(std::atomic<int>& count, int target) {
+    while(count < target) {
+        usleep(1000);
+    }
+}
+
+/**
+ * @brief 协程在线程间迁移后局部变量保持不变，结束时析构
+ */
+int testMigrate(Scheduler& sc) {
+    const int fibers = 200;
+    std::atomic<int> done = {0};
+    std::atomic<int> wrong = {0};
+    std::atomic<int> migrated = {0};
+    int created = Counted::s_created;
+    int destroyed = Counted::s_destroyed;
+    for(int i = 0; i < fibers; ++i) {
+        sc.schedule([&, i](){
+            pid_t tid = GetThreadId();
+            s_counted->m_value = i;
+            s_value.set(i * 2);
+            for(int j = 0; j < 50; ++j) {
+                YieldFiber();
+                if(s_counted->m_value != (uint64_t)i || s_value.get() != (uint64_t)i * 2) {
+                    ++wrong;
+                }
+            }
+            if(tid != GetThreadId()) {
+                ++migrated;
+            }
+            ++done;
+        });
+    }
+    WaitFor(done, fibers);
+    // 最后一个协程结束后才会析构，等调度线程执行完
+    while(Counted::s_destroyed - destroyed < fibers) {
+        usleep(1000);
+    }
+    created = Counted::s_created - created;
+    destroyed = Counted::s_destroyed - destroyed;
+    FOCUS_LOG_INFO(g_logger) << "migrate wrong = " << wrong << " migrated = " << migrated
+        << " created = " << created << " destroyed = " << destroyed;
+    return (0 == wrong && fibers == created && fibers == destroyed)? 0: 1;
+}
+
+/**
+ * @brief 重置后的协程看不到上一次的值
+ */
+int testReset() {
+    int failed = 0;
+    Fiber::GetThis();
+    Fiber::ptr fiber(new Fiber([](){
+        s_value.set(42);
+    }, 0, false));
+    fiber->resume();
+    fiber->reset([&failed](){
+        failed += s_value.tryGet()? 1: 0;
+        failed += 0 == s_value.get()? 0: 1;
+    });
+    fiber->resume();
+
+    // 不在子协程中时使用线程的主协程
+    s_value.set(7);
+    failed += 7 == *s_value? 0: 1;
+    s_value.reset();
+    failed += s_value.tryGet()? 1: 0;
+    FOCUS_LOG_INFO(g_logger) << "reset failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 日志格式化输出请求id
+ */
+int testLogRequestId(Scheduler& sc) {
+    std::atomic<int> done = {0};
+    int failed = 0;
+    LogFormatter::ptr formatter(new LogFormatter("%R:%m"));
+    Logger::ptr logger(new Logger("request"));
+    sc.schedule([&](){
+        SetLogRequestId("req-1");
+        YieldFiber();
+        LogEvent::ptr event = LogEvent::Create(logger, __FILE__, __LINE__, 0, GetThreadId(),
+            GetFiberId(), GetCurrentUS(), Thread::GetName(), LogLevel::INFO);
+        event->format("hello");
+        std::string str = formatter->format(logger, LogLevel::INFO, event);
+        if("req-1:hello" != str) {
+            ++failed;
+        }
+        ++done;
+    });
+    WaitFor(done, 1);
+    sc.schedule([&](){
+        // 新的协程没有请求id
+        if(!GetLogRequestId().empty()) {
+            ++failed;
+        }
+        ++done;
+    });
+    WaitFor(done, 2);
+    FOCUS_LOG_INFO(g_logger) << "log request id failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 访问开销
+ */
+template<class Fun>
+void bench(const char* name, Fun fun) {
+    const int count = 10000000;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < count; ++i) {
+        fun(i);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    FOCUS_LOG_INFO(g_logger) << name << " " << (double)ns / count << " ns";
+}
+
+int main(int argc, char* argv[]) {
+    // 关闭系统日志
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    int failed = 0;
+    {
+        Scheduler sc(4, false, "fiber_local");
+        sc.start();
+        failed += testMigrate(sc);
+        failed += testLogRequestId(sc);
+        sc.stop();
+    }
+    failed += testReset();
+
+    bench("thread_local", [](int i){
+        t_value += i;
+        __asm__ __volatile__("" ::: "memory");
+    });
+    bench("FiberLocal", [](int i){
+        s_value.get() += i;
+        __asm__ __volatile__("" ::: "memory");
+    });
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
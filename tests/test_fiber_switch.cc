@@ -0,0 +1,71 @@
+#include "fiber.h"
+#include "log.h"
+#include "util.h"
+#include <ucontext.h>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace focus;
+
+// 切换次数
+static const uint64_t s_rounds = 1000000;
+
+static ucontext_t s_uctx_main, s_uctx_fun;
+
+static void printResult(const char* name, uint64_t switches, uint64_t us) {
+    printf("%-10s switches = %lu time = %lu us %.0f switches/s %.1f ns/switch\n",
+           name, switches, us, switches * 1000000.0 / us, us * 1000.0 / switches);
+}
+
+// ucontext基准，与test_ucontext相同的swapcontext用法
+static void ucontextFun() {
+    while(true) {
+        swapcontext(&s_uctx_fun, &s_uctx_main);
+    }
+}
+
+static void benchUcontext() {
+    static char stack[128 * 1024];
+    getcontext(&s_uctx_fun);
+    s_uctx_fun.uc_link = nullptr;
+    s_uctx_fun.uc_stack.ss_sp = stack;
+    s_uctx_fun.uc_stack.ss_size = sizeof(stack);
+    makecontext(&s_uctx_fun, ucontextFun, 0);
+
+    uint64_t start = GetCurrentUS();
+    for(uint64_t i = 0; i < s_rounds; ++i) {
+        swapcontext(&s_uctx_main, &s_uctx_fun);
+    }
+    printResult("ucontext", s_rounds * 2, GetCurrentUS() - start);
+}
+
+// Fiber基准，使用编译时选择的上下文切换方式
+static void benchFiber() {
+    Fiber::GetThis();
+    bool stop = false;
+    Fiber::ptr fiber(new Fiber([&stop](){
+        while(!stop) {
+            Fiber::GetThis()->yield();
+        }
+    }, 0, false));
+
+    uint64_t start = GetCurrentUS();
+    for(uint64_t i = 0; i < s_rounds; ++i) {
+        fiber->resume();
+    }
+#if defined(FOCUS_FIBER_USE_ASM)
+    printResult("fiber(asm)", s_rounds * 2, GetCurrentUS() - start);
+#else
+    printResult("fiber(uctx)", s_rounds * 2, GetCurrentUS() - start);
+#endif
+    // 让协程正常结束后再析构
+    stop = true;
+    fiber->resume();
+}
+
+int main(int argc, char* argv[]) {
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    benchUcontext();
+    benchFiber();
+    return 0;
+}
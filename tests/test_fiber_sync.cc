@@ -0,0 +1,217 @@
+#include "fibersync.h"
+#include "scheduler.h"
+#include "log.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_fiber_sync");
+
+/**
+ * @brief 让出执行权并重新调度自己，模拟临界区内的协程切换
+ */
+static void YieldFiber() {
+    Scheduler::GetThis()->schedule(Fiber::GetThis());
+    Fiber::GetThis()->yield();
+}
+
+/**
+ * @brief 等待计数到达目标值
+ */
+static void WaitFor(std::atomic<int>& count, int target) {
+    while(count < target) {
+        usleep(1000);
+    }
+}
+
+/**
+ * @brief 协程和普通线程同时竞争互斥量
+ */
+int testMutex(Scheduler& sc) {
+    const int fibers = 64;
+    const int loops = 2000;
+    FiberMutex mutex;
+    uint64_t value = 0;
+    std::atomic<int> done = {0};
+    for(int i = 0; i < fibers; ++i) {
+        sc.schedule([&](){
+            for(int j = 0; j < loops; ++j) {
+                FiberMutex::Lock lock(mutex);
+                ++value;
+                if(0 == j % 100) {
+                    YieldFiber();
+                }
+            }
+            ++done;
+        });
+    }
+    // 不在协程中，阻塞线程等待
+    for(int j = 0; j < loops; ++j) {
+        FiberMutex::Lock lock(mutex);
+        ++value;
+    }
+    WaitFor(done, fibers);
+    uint64_t expect = (uint64_t)(fibers + 1) * loops;
+    FOCUS_LOG_INFO(g_logger) << "mutex value = " << value << " expect = " << expect;
+    return value == expect? 0: 1;
+}
+
+/**
+ * @brief 写者成对修改，读者不能看到修改了一半的值
+ */
+int testRWMutex(Scheduler& sc) {
+    FiberRWMutex mutex;
+    uint64_t a = 0;
+    uint64_t b = 0;
+    std::atomic<int> done = {0};
+    std::atomic<int> broken = {0};
+    const int writers = 8;
+    const int readers = 32;
+    for(int i = 0; i < writers; ++i) {
+        sc.schedule([&](){
+            for(int j = 0; j < 1000; ++j) {
+                FiberRWMutex::WriteLock lock(mutex);
+                ++a;
+                if(0 == j % 50) {
+                    YieldFiber();
+                }
+                ++b;
+            }
+            ++done;
+        });
+    }
+    for(int i = 0; i < readers; ++i) {
+        sc.schedule([&](){
+            for(int j = 0; j < 1000; ++j) {
+                FiberRWMutex::ReadLock lock(mutex);
+                if(a != b) {
+                    ++broken;
+                }
+                if(0 == j % 50) {
+                    YieldFiber();
+                }
+            }
+            ++done;
+        });
+    }
+    WaitFor(done, writers + readers);
+    FOCUS_LOG_INFO(g_logger) << "rwmutex a = " << a << " b = " << b << " broken = " << broken;
+    return (a == writers * 1000 && a == b && 0 == broken)? 0: 1;
+}
+
+/**
+ * @brief 条件变量实现的有界队列，多生产者多消费者
+ */
+int testCondVar(Scheduler& sc) {
+    FiberMutex mutex;
+    FiberCondVar notEmpty;
+    FiberCondVar notFull;
+    std::deque<int> queue;
+    const size_t capacity = 4;
+    const int producers = 8;
+    const int items = 1000;
+    std::atomic<int> done = {0};
+    std::atomic<uint64_t> sum = {0};
+    for(int i = 0; i < producers; ++i) {
+        sc.schedule([&](){
+            for(int j = 1; j <= items; ++j) {
+                FiberMutex::Lock lock(mutex);
+                while(queue.size() >= capacity) {
+                    notFull.wait(lock);
+                }
+                queue.push_back(j);
+                notEmpty.notifyOne();
+            }
+        });
+        sc.schedule([&](){
+            for(int j = 0; j < items; ++j) {
+                FiberMutex::Lock lock(mutex);
+                while(queue.empty()) {
+                    notEmpty.wait(lock);
+                }
+                sum += queue.front();
+                queue.pop_front();
+                notFull.notifyOne();
+            }
+            ++done;
+        });
+    }
+    WaitFor(done, producers);
+    uint64_t expect = (uint64_t)producers * items * (items + 1) / 2;
+    FOCUS_LOG_INFO(g_logger) << "condvar sum = " << sum << " expect = " << expect;
+    return sum == expect? 0: 1;
+}
+
+/**
+ * @brief 两个协程通过信号量交替执行
+ */
+int testSemaphore(Scheduler& sc) {
+    FiberSemaphore ping;
+    FiberSemaphore pong;
+    const int rounds = 10000;
+    std::atomic<int> done = {0};
+    int turn = 0;
+    int wrong = 0;
+    sc.schedule([&](){
+        for(int i = 0; i < rounds; ++i) {
+            if(0 != turn) {
+                ++wrong;
+            }
+            turn = 1;
+            ping.notify();
+            pong.wait();
+        }
+        ++done;
+    });
+    sc.schedule([&](){
+        for(int i = 0; i < rounds; ++i) {
+            ping.wait();
+            if(1 != turn) {
+                ++wrong;
+            }
+            turn = 0;
+            pong.notify();
+        }
+        ++done;
+    });
+    WaitFor(done, 2);
+    FOCUS_LOG_INFO(g_logger) << "semaphore rounds = " << rounds << " wrong = " << wrong;
+    return wrong? 1: 0;
+}
+
+/**
+ * @brief 无竞争时加锁解锁的耗时
+ */
+template<class MutexType>
+void benchUncontended(const char* name) {
+    MutexType mutex;
+    const int count = 10000000;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < count; ++i) {
+        typename MutexType::Lock lock(mutex);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    FOCUS_LOG_INFO(g_logger) << name << " uncontended " << (double)ns / count << " ns";
+}
+
+int main(int argc, char* argv[]) {
+    // 关闭系统日志
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    int failed = 0;
+    {
+        Scheduler sc(4, false, "fiber_sync");
+        sc.start();
+        failed += testMutex(sc);
+        failed += testRWMutex(sc);
+        failed += testCondVar(sc);
+        failed += testSemaphore(sc);
+        sc.stop();
+    }
+    benchUncontended<Mutex>("Mutex");
+    benchUncontended<FiberMutex>("FiberMutex");
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
@@ -0,0 +1,304 @@
+#include "iomanager.h"
+#include "config.h"
+#include "hook.h"
+#include "log.h"
+#include "fdmanager.h"
+#include "pagetable.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cstring>
+#include <cerrno>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_iobackend");
+
+/**
+ * @brief TCP回显，覆盖accept/connect/send/recv/readv/writev和接收超时
+ */
+void testEcho(int* failed) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if(bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) || listen(listenFd, 16)
+            || getsockname(listenFd, (struct sockaddr*)&addr, &len)) {
+        FOCUS_LOG_ERROR(g_logger) << "listen error errno = " << errno;
+        ++*failed;
+        return;
+    }
+
+    IOManager::GetThis()->schedule([listenFd, failed](){
+        struct sockaddr_in peer;
+        socklen_t peerLen = sizeof(peer);
+        int fd = accept(listenFd, (struct sockaddr*)&peer, &peerLen);
+        if(fd < 0) {
+            FOCUS_LOG_ERROR(g_logger) << "accept error errno = " << errno;
+            ++*failed;
+            return;
+        }
+        char buf[64];
+        while(true) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if(n <= 0) {
+                break;
+            }
+            struct iovec iov;
+            iov.iov_base = buf;
+            iov.iov_len = n;
+            writev(fd, &iov, 1);
+        }
+        close(fd);
+        close(listenFd);
+    });
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+        FOCUS_LOG_ERROR(g_logger) << "connect error errno = " << errno;
+        ++*failed;
+        return;
+    }
+    struct timeval tv = {0, 100 * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    for(int i = 0; i < 100; ++i) {
+        std::string msg = "hello " + std::to_string(i);
+        if(send(fd, msg.c_str(), msg.size(), 0) != (ssize_t)msg.size()) {
+            ++*failed;
+            break;
+        }
+        char buf[64] = {0};
+        struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = sizeof(buf);
+        ssize_t n = readv(fd, &iov, 1);
+        if(n != (ssize_t)msg.size() || msg != std::string(buf, n)) {
+            FOCUS_LOG_ERROR(g_logger) << "echo mismatch n = " << n;
+            ++*failed;
+            break;
+        }
+    }
+
+    // 没有数据时按SO_RCVTIMEO超时
+    char buf[8];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if(-1 != n || ETIMEDOUT != errno) {
+        FOCUS_LOG_ERROR(g_logger) << "expect timeout n = " << n << " errno = " << errno;
+        ++*failed;
+    }
+    close(fd);
+}
+
+/**
+ * @brief recvmsg在数据未就绪时直接提交给支持的后端
+ */
+void testRecvmsg(int* failed) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        FOCUS_LOG_ERROR(g_logger) << "socketpair error errno = " << errno;
+        ++*failed;
+        return;
+    }
+    FdMgr::GetInstance()->get(fds[0], true);
+    FdMgr::GetInstance()->get(fds[1], true);
+    IOManager* iom = IOManager::GetThis();
+    uint64_t submitted = iom->getSubmitIoCount();
+    // 稍后写入，保证recvmsg先遇到EAGAIN
+    iom->addTimer([fds](){
+        write_f(fds[1], "recvmsg", 7);
+    }, 20);
+
+    char buf[16] = {0};
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    ssize_t n = recvmsg(fds[0], &msg, 0);
+    submitted = iom->getSubmitIoCount() - submitted;
+    if(7 != n || "recvmsg" != std::string(buf, n)) {
+        FOCUS_LOG_ERROR(g_logger) << "recvmsg n = " << n << " errno = " << errno;
+        ++*failed;
+    }
+    if(iom->canSubmitIo() != (submitted > 0)) {
+        FOCUS_LOG_ERROR(g_logger) << "recvmsg submitted = " << submitted
+            << " backend = " << iom->getBackendName();
+        ++*failed;
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * @brief 关闭fd时取消等待中的读，读的协程被唤醒
+ */
+void testCloseCancel(int* failed) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        FOCUS_LOG_ERROR(g_logger) << "socketpair error errno = " << errno;
+        ++*failed;
+        return;
+    }
+    FdMgr::GetInstance()->get(fds[0], true);
+    FdMgr::GetInstance()->get(fds[1], true);
+    // 取消失败时由超时兜底，避免测试挂住
+    struct timeval tv = {3, 0};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    IOManager* iom = IOManager::GetThis();
+    uint64_t submitted = iom->getSubmitIoCount();
+    iom->addTimer([fds](){
+        close(fds[0]);
+    }, 20);
+
+    char buf[16];
+    uint64_t start = GetCurrentMS();
+    ssize_t n = recv(fds[0], buf, sizeof(buf), 0);
+    uint64_t used = GetCurrentMS() - start;
+    submitted = iom->getSubmitIoCount() - submitted;
+    if(n > 0 || used >= 1000 || iom->canSubmitIo() != (submitted > 0)) {
+        FOCUS_LOG_ERROR(g_logger) << "close cancel n = " << n << " errno = " << errno
+            << " used = " << used << " submitted = " << submitted
+            << " backend = " << iom->getBackendName();
+        ++*failed;
+    }
+    close(fds[1]);
+}
+
+/**
+ * @brief connect直接提交给支持的后端，连接被拒绝时返回对应的错误
+ */
+void testConnect(int* failed) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if(bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) || listen(listenFd, 16)
+            || getsockname(listenFd, (struct sockaddr*)&addr, &len)) {
+        FOCUS_LOG_ERROR(g_logger) << "listen error errno = " << errno;
+        ++*failed;
+        return;
+    }
+    IOManager* iom = IOManager::GetThis();
+    uint64_t submitted = iom->getSubmitIoCount();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rt = connect_with_timeout(fd, (struct sockaddr*)&addr, sizeof(addr), 1000);
+    submitted = iom->getSubmitIoCount() - submitted;
+    if(0 != rt || iom->canSubmitIo() != (1 == submitted)) {
+        FOCUS_LOG_ERROR(g_logger) << "connect rt = " << rt << " errno = " << errno
+            << " submitted = " << submitted << " backend = " << iom->getBackendName();
+        ++*failed;
+    }
+    close(fd);
+    close(listenFd);
+
+    // 监听关闭后连接被拒绝
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    rt = connect_with_timeout(fd, (struct sockaddr*)&addr, sizeof(addr), 1000);
+    if(-1 != rt || ECONNREFUSED != errno) {
+        FOCUS_LOG_ERROR(g_logger) << "expect refused rt = " << rt << " errno = " << errno;
+        ++*failed;
+    }
+    close(fd);
+}
+
+/**
+ * @brief 页表超过初始容量时扩大目录，已有的元素地址不变
+ */
+int testPageTable() {
+    int failed = 0;
+    PageTable<int> table(1024);
+    int* first = table.getOrCreate(5);
+    *first = 5;
+    failed += table.get(1 << 20)? 1: 0;
+    // 超过原来的固定上限
+    size_t big = (1 << 20) + 7;
+    int* last = table.getOrCreate(big);
+    *last = 7;
+    failed += (table.get(big) == last && table.get(5) == first && 5 == *first)? 0: 1;
+    failed += table.capacity() > big? 0: 1;
+    FOCUS_LOG_INFO(g_logger) << "page table capacity = " << table.capacity() << " failed = " << failed;
+    return failed;
+}
+
+/**
+ * @brief 不在第一页的fd也能注册事件
+ * @param[in] highFd 注册事件使用的fd
+ */
+void testHighFd(int* failed, int highFd) {
+    int fds[2];
+    if(pipe(fds) || dup2(fds[0], highFd) < 0) {
+        FOCUS_LOG_ERROR(g_logger) << "pipe error errno = " << errno;
+        ++*failed;
+        return;
+    }
+    int* triggered = new int(0);
+    IOManager::GetThis()->addEvent(highFd, IOManager::READ, [triggered](){
+        ++*triggered;
+    });
+    write(fds[1], "x", 1);
+    usleep(10 * 1000);
+    if(1 != *triggered) {
+        FOCUS_LOG_ERROR(g_logger) << "high fd " << highFd << " not triggered";
+        ++*failed;
+    }
+    delete triggered;
+    close(highFd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(int argc, char* argv[]) {
+    // 关闭系统日志
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    int failed = testPageTable();
+    for(const char* perThread : {"false", "true"}) {
+        Config::LookUpBase("iomanager.per_thread")->fromString(perThread);
+        for(const char* backend : {"epoll", "io_uring"}) {
+            Config::LookUpBase("iomanager.backend")->fromString(backend);
+            {
+                IOManager iom(2, false, backend);
+                FOCUS_LOG_INFO(g_logger) << "request = " << backend
+                    << " backend = " << iom.getBackendName()
+                    << " per_thread = " << iom.isPerThread();
+                iom.schedule(std::bind(&testEcho, &failed));
+                iom.schedule(std::bind(&testHighFd, &failed, 1000));
+            }
+            {
+                // 单独运行，提交计数不受其他测试影响
+                IOManager iom(1, false, backend);
+                iom.schedule([&failed](){
+                    testRecvmsg(&failed);
+                    testConnect(&failed);
+                    testCloseCancel(&failed);
+                });
+            }
+        }
+    }
+
+    // 创建后调高文件数上限，超过初始容量的fd也能注册
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_max > 4096) {
+        struct rlimit low = rl;
+        low.rlim_cur = 1024;
+        setrlimit(RLIMIT_NOFILE, &low);
+        IOManager iom(1, false, "grow");
+        setrlimit(RLIMIT_NOFILE, &rl);
+        int highFd = (RLIM_INFINITY == rl.rlim_max? 1 << 20: std::min<rlim_t>(rl.rlim_max, 1 << 20)) - 1;
+        iom.schedule(std::bind(&testHighFd, &failed, highFd));
+    }
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
@@ -1,6 +1,131 @@
 #include "log.h"
+#include "config.h"
+#include <fstream>
+#include <cstring>
+#include <sys/stat.h>
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
 using namespace focus;
 
+// 测试文件所在的临时目录
+static std::string s_dir;
+
+// 多线程写异步文件日志，对比同步输出的耗时
+void testAsync(){
+    const int threads=4;
+    const int count=20000;
+    auto bench=[&](const std::string& name,LogAppender::ptr appender){
+        Logger::ptr logger(new Logger(name));
+        logger->addAppender(appender);
+        auto start=std::chrono::steady_clock::now();
+        std::vector<Thread::ptr> vec;
+        for(int i=0;i<threads;++i){
+            vec.emplace_back(new Thread([logger](){
+                for(int j=0;j<count;++j){
+                    FOCUS_LOG_INFO(logger)<<"async log test "<<j;
+                }
+            },name+"_"+std::to_string(i)));
+        }
+        for(auto& it: vec){
+            it->join();
+        }
+        AsyncLogAppender::ptr async=std::dynamic_pointer_cast<AsyncLogAppender>(appender);
+        if(async){
+            async->flush();
+        }
+        auto us=std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now()-start).count();
+        std::cout<<name<<" "<<threads*count<<" lines in "<<us<<"us"<<std::endl;
+    };
+
+    bench("sync",LogAppender::ptr(new FileLogAppender(s_dir+"/test_log_sync.txt")));
+
+    AsyncLogAppender::ptr async(new AsyncLogAppender(
+        LogAppender::ptr(new FileLogAppender(s_dir+"/test_log_async.txt"))));
+    bench("async",async);
+    async.reset();
+    unlink((s_dir+"/test_log_sync.txt").c_str());
+    unlink((s_dir+"/test_log_async.txt").c_str());
+
+    // 小队列，满了直接丢弃
+    AsyncLogAppender::ptr drop(new AsyncLogAppender(
+        LogAppender::ptr(new FileLogAppender("/dev/null")),64,AsyncLogAppender::DROP));
+    bench("drop",drop);
+    std::cout<<"drop dropped="<<drop->getDropped()
+        <<" info dropped="<<drop->getDropped(LogLevel::INFO)<<std::endl;
+}
+
+static int64_t FileSize(const std::string& file){
+    struct stat st;
+    if(stat(file.c_str(),&st)){
+        return -1;
+    }
+    return st.st_size;
+}
+
+// 按大小滚动，文件大小应该等于实际写入的字节数
+int testRotate(){
+    int failed=0;
+    const std::string file=s_dir+"/test_log_rotate.txt";
+    {
+        RotatingFileLogAppender::ptr appender(new RotatingFileLogAppender(file,4096,false,2,1024));
+        appender->setLogFormatter(LogFormatter::ptr(new LogFormatter("%m%n")));
+        Logger::ptr logger(new Logger("rotate"));
+        logger->addAppender(appender);
+        for(int i=0;i<1000;++i){
+            FOCUS_LOG_INFO(logger)<<"rotate log test "<<i;
+        }
+        if(appender->getSize()>4096){
+            ++failed;
+        }
+    }
+    for(int i=0;i<=2;++i){
+        std::string name=i?file+"."+std::to_string(i):file;
+        int64_t size=FileSize(name);
+        std::ifstream ifs(name);
+        std::string content((std::istreambuf_iterator<char>(ifs)),std::istreambuf_iterator<char>());
+        if(size<=0||size>4096||content.find('\0')!=std::string::npos){
+            std::cout<<name<<" size="<<size<<" invalid"<<std::endl;
+            ++failed;
+        }
+    }
+    if(FileSize(file+".3")>=0){
+        std::cout<<file<<".3 should be removed"<<std::endl;
+        ++failed;
+    }
+
+    for(int i=0;i<=3;++i){
+        unlink((i?file+"."+std::to_string(i):file).c_str());
+    }
+
+    // 通过配置创建
+    const std::string conf_file=s_dir+"/test_log_conf.txt";
+    YAML::Node root=YAML::Load(
+        "logs:\n"
+        "  - name: conf\n"
+        "    level: info\n"
+        "    formatter: '%m%n'\n"
+        "    appenders:\n"
+        "      - type: RotatingFileLogAppender\n"
+        "        file: "+conf_file+"\n"
+        "        max_size: 1048576\n"
+        "        max_files: 3\n");
+    Config::LoadFromYaml(root);
+    Logger::ptr conf=FOCUS_LOG_NAME("conf");
+    FOCUS_LOG_DEBUG(conf)<<"filtered";
+    FOCUS_LOG_INFO(conf)<<"from config";
+    conf->clearAppenders();
+    if(FileSize(conf_file)!=(int64_t)strlen("from config\n")){
+        std::cout<<"config appender size="<<FileSize(conf_file)<<std::endl;
+        ++failed;
+    }
+    unlink(conf_file.c_str());
+    std::cout<<"rotate "<<(failed?"FAILED":"OK")<<std::endl;
+    return failed;
+}
+
 int main(){
     Logger::ptr logger=LoggerMgr::GetInstance()->getRoot();
     FOCUS_LOG_LEVEL(logger,LogLevel::DEBUG)<<"Test log";
@@ -9,5 +134,20 @@ int main(){
     Logger::ptr testLogger = FOCUS_LOG_NAME("test");
     testLogger->setLogFormatter("[%c]%T[%p]%T[%t]%T[%N]%T[%m]%T%n");
     FOCUS_LOG_DEBUG(testLogger) << "Test Modfiy Formatter";
-    return 0;
-}
\ No newline at end of file
+    testLogger->setLogFormatter("%d{%Y-%m-%d %H:%M:%S.%L}%T%d{%H:%M:%S.%f}%T%m%n");
+    for(int i=0;i<3;++i){
+        FOCUS_LOG_DEBUG(testLogger) << "Test sub-second time " << i;
+        usleep(1500);
+    }
+    // 日志文件写到临时目录，结束后删除
+    char tmpl[]="/tmp/focus_log_XXXXXX";
+    if(!mkdtemp(tmpl)){
+        std::cout<<"mkdtemp failed"<<std::endl;
+        return 1;
+    }
+    s_dir=tmpl;
+    testAsync();
+    int failed=testRotate();
+    rmdir(s_dir.c_str());
+    return failed?1:0;
+}
@@ -0,0 +1,93 @@
+#include "log.h"
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace focus;
+
+// 统计堆内存申请次数
+static std::atomic<uint64_t> s_allocs={0};
+
+void* operator new(size_t size){
+    s_allocs.fetch_add(1,std::memory_order_relaxed);
+    void* p=malloc(size?size:1);
+    if(!p){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept{
+    free(p);
+}
+
+void operator delete(void* p,size_t) noexcept{
+    free(p);
+}
+
+// 不输出的输出器，只测量日志事件的构造
+class NullLogAppender: public LogAppender{
+public:
+    void log(Logger::ptr logger,LogLevel::Level level,LogEvent::ptr event) override{
+    }
+};
+
+// 丢弃所有输出的流缓冲区
+class NullStreamBuf: public std::streambuf{
+protected:
+    int_type overflow(int_type c) override{
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char* s,std::streamsize n) override{
+        return n;
+    }
+};
+
+template<class Fun>
+void bench(const char* name,int count,Fun fun){
+    // 预热，填充日志事件池
+    for(int i=0;i<1000;++i){
+        fun(i);
+    }
+    uint64_t allocs=s_allocs.load();
+    auto start=std::chrono::steady_clock::now();
+    for(int i=0;i<count;++i){
+        fun(i);
+    }
+    auto ns=std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now()-start).count();
+    std::cout<<name<<": "<<(double)ns/count<<" ns/log, "
+        <<(double)(s_allocs.load()-allocs)/count<<" allocs/log"<<std::endl;
+}
+
+int main(int argc,char* argv[]){
+    int count=argc>1?atoi(argv[1]):1000000;
+    Logger::ptr logger(new Logger("bench"));
+    logger->addAppender(LogAppender::ptr(new NullLogAppender()));
+
+    logger->setLevel(LogLevel::ERROR);
+    bench("filtered",count,[&logger](int i){
+        FOCUS_LOG_DEBUG(logger)<<"filtered log "<<i;
+    });
+
+    logger->setLevel(LogLevel::DEBUG);
+    bench("emitted",count,[&logger](int i){
+        FOCUS_LOG_DEBUG(logger)<<"emitted log "<<i;
+    });
+    bench("emitted fmt",count,[&logger](int i){
+        FOCUS_LOG_FMT_DEBUG(logger,"emitted fmt log %d",i);
+    });
+
+    // 时间格式化，同一秒内只填充毫秒
+    LogFormatter::ptr formatter(new LogFormatter("%d{%Y-%m-%d %H:%M:%S.%L}"));
+    NullStreamBuf nullBuf;
+    std::ostream os(&nullBuf);
+    LogEvent::ptr event=LogEvent::Create(logger,__FILE__,__LINE__,0,GetThreadId(),GetFiberId(),
+        GetCurrentUS(),Thread::GetName(),LogLevel::DEBUG);
+    bench("format date",count,[&](int i){
+        formatter->format(os,logger,LogLevel::DEBUG,event);
+    });
+    return 0;
+}
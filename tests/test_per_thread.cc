@@ -0,0 +1,130 @@
+#include "iomanager.h"
+#include "config.h"
+#include "hook.h"
+#include "log.h"
+#include "util.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cstring>
+#include <cerrno>
+#include <map>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_per_thread");
+
+static const int CONNS = 200;
+static Mutex s_mutex;
+static std::map<int, int> s_accepts; // 线程id -> 接受的连接数
+static std::atomic<int> s_moved = {0}; // 连接处理过程中换了线程的次数
+static std::atomic<int> s_served = {0};
+
+/**
+ * @brief 每个线程一个SO_REUSEPORT监听，连接在接受的线程上回显
+ */
+void acceptLoop(int port) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) || listen(listenFd, 128)) {
+        FOCUS_LOG_ERROR(g_logger) << "listen error errno = " << errno;
+        return;
+    }
+    // 接收超时让循环在测试结束后退出
+    struct timeval tv = {1, 0};
+    setsockopt(listenFd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    while(s_served < CONNS) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if(fd < 0) {
+            continue;
+        }
+        int tid = GetThreadId();
+        {
+            Mutex::Lock lock(s_mutex);
+            ++s_accepts[tid];
+        }
+        IOManager::GetThis()->schedule([fd, tid](){
+            char buf[64];
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if(GetThreadId() != tid) {
+                ++s_moved;
+            }
+            if(n > 0) {
+                send(fd, buf, n, 0);
+            }
+            close(fd);
+            ++s_served;
+        }, tid);
+    }
+    close(listenFd);
+}
+
+/**
+ * @brief 定时器在添加的线程上执行
+ */
+void testTimer(int* failed) {
+    int tid = GetThreadId();
+    for(int i = 0; i < 5; ++i) {
+        usleep(2 * 1000);
+        if(GetThreadId() != tid) {
+            FOCUS_LOG_ERROR(g_logger) << "timer moved thread " << tid << " -> " << GetThreadId();
+            ++*failed;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // 关闭系统日志
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    Config::LookUpBase("iomanager.per_thread")->fromString("true");
+    int failed = 0;
+    int port = 20000 + getpid() % 10000;
+    uint64_t start = GetCurrentMS();
+    {
+        IOManager iom(4, false, "per_thread");
+        if(!iom.isPerThread()) {
+            ++failed;
+        }
+        for(int tid: iom.getThreadIds()) {
+            iom.schedule(std::bind(&acceptLoop, port), tid);
+            iom.schedule(std::bind(&testTimer, &failed), tid);
+        }
+        usleep(100 * 1000);
+
+        // 客户端在普通线程上阻塞连接
+        for(int i = 0; i < CONNS; ++i) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            char buf[16] = {0};
+            if(connect(fd, (struct sockaddr*)&addr, sizeof(addr))
+                    || 5 != send(fd, "hello", 5, 0)
+                    || 5 != recv(fd, buf, sizeof(buf), MSG_WAITALL)) {
+                FOCUS_LOG_ERROR(g_logger) << "client error errno = " << errno;
+                ++failed;
+            }
+            close(fd);
+        }
+    }
+    for(auto& it: s_accepts) {
+        FOCUS_LOG_INFO(g_logger) << "thread " << it.first << " accepted " << it.second;
+    }
+    if(s_served != CONNS || s_moved) {
+        ++failed;
+    }
+    FOCUS_LOG_INFO(g_logger) << "served = " << s_served << " moved = " << s_moved
+        << " used = " << GetCurrentMS() - start << "ms "
+        << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
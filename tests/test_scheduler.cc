@@ -1,7 +1,10 @@
 #include "scheduler.h"
+#include "config.h"
 #include <iostream>
 #include <vector>
 #include <functional>
+#include <chrono>
+#include <algorithm>
 
 using namespace focus;
 
@@ -11,7 +14,189 @@ void fun(int i) {
     FOCUS_LOG_DEBUG(g_logger) << "CurFiberId = " << GetFiberId() << "input param " << i;
 }
 
+/**
+ * @brief 大量回调任务，统计回调协程的复用
+ * @param[in] cacheSize 每个线程缓存的协程上限
+ * @return 失败返回1
+ */
+int testFiberCache(const std::string& cacheSize) {
+    Config::LookUpBase("scheduler.fiber_cache_size")->fromString(cacheSize);
+    Config::LookUpBase("scheduler.fiber_cache_idle_ms")->fromString("50");
+    const int tasks = 200000;
+    std::atomic<int> done = {0};
+    Scheduler sc(2, false, "fiber_cache");
+    sc.start();
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < tasks; ++i) {
+        sc.schedule([&done](){
+            ++done;
+        });
+    }
+    while(done < tasks) {
+        usleep(100);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    uint64_t hits = sc.getFiberCacheHits();
+    uint64_t misses = sc.getFiberCacheMisses();
+    size_t cached = sc.getFiberCacheSize();
+    // 空闲一段时间后释放缓存
+    for(int i = 0; i < 100 && sc.getFiberCacheSize(); ++i) {
+        usleep(10000);
+        sc.schedule([](){});
+        usleep(100000);
+    }
+    size_t trimmed = sc.getFiberCacheSize();
+    sc.stop();
+    FOCUS_LOG_INFO(g_logger) << "fiber cache size=" << cacheSize << " " << (double)ns / tasks << " ns/task"
+        << " hits=" << hits << " misses=" << misses << " cached=" << cached << " trimmed=" << trimmed;
+    if("0" == cacheSize) {
+        return (0 == hits && (uint64_t)tasks <= misses)? 0: 1;
+    }
+    // 协程执行完立即放回缓存，几乎所有任务都能命中
+    return (hits + misses >= (uint64_t)tasks && hits > (uint64_t)tasks * 9 / 10 && 0 == trimmed)? 0: 1;
+}
+
+/**
+ * @brief 内联任务在调度协程上执行，对比普通回调任务的开销
+ * @param[in] useInline 是否使用内联任务
+ * @return 失败返回1
+ */
+int testInline(bool useInline) {
+    const int tasks = 200000;
+    std::atomic<int> done = {0};
+    std::atomic<int> wrong = {0};
+    Scheduler sc(2, false, "inline");
+    sc.start();
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < tasks; ++i) {
+        if(useInline) {
+            sc.scheduleInline([&done, &wrong](){
+                // 没有切换到新的协程
+                if(!Scheduler::IsInInlineTask() || Fiber::GetCurrent() != Scheduler::GetMainFiber()) {
+                    ++wrong;
+                }
+                ++done;
+            });
+        }else {
+            sc.schedule([&done, &wrong](){
+                if(Scheduler::IsInInlineTask()) {
+                    ++wrong;
+                }
+                ++done;
+            });
+        }
+    }
+    while(done < tasks) {
+        usleep(100);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    sc.stop();
+    FOCUS_LOG_INFO(g_logger) << (useInline? "inline": "fiber") << " " << (double)ns / tasks << " ns/task"
+        << " wrong=" << wrong;
+    return 0 == wrong? 0: 1;
+}
+
+/**
+ * @brief 忙等一段时间，模拟计算任务
+ */
+static void BusyWait(uint64_t us) {
+    uint64_t end = GetCurrentUS() + us;
+    while(GetCurrentUS() < end);
+}
+
+/**
+ * @brief 优先级和截止时间的执行顺序
+ * @return 失败的检查数
+ */
+int testPriorityOrder() {
+    int failed = 0;
+    std::vector<int> order;
+    Scheduler sc(1, false, "priority");
+    // 启动前添加，全部进入全局队列
+    for(int i = 0; i < 130; ++i) {
+        sc.schedule([&order](){ order.push_back(Scheduler::BACKGROUND); }, Scheduler::BACKGROUND);
+        sc.schedule([&order](){ order.push_back(Scheduler::NORMAL); }, Scheduler::NORMAL);
+        sc.schedule([&order](){ order.push_back(Scheduler::HIGH); }, Scheduler::HIGH);
+    }
+    // 同一优先级中截止时间早的先执行，已经超时的最先执行
+    sc.schedule([&order](){ order.push_back(12); }, Scheduler::HIGH, 2000);
+    sc.schedule([&order](){ order.push_back(11); }, Scheduler::HIGH, 1000);
+    sc.schedule([&order](){ order.push_back(10); }, Scheduler::BACKGROUND, 1);
+    usleep(5000);
+    sc.start();
+    // stop等待所有任务执行完，之后才能读取order
+    sc.stop();
+    failed += 393 == order.size()? 0: 1;
+
+    // 超时的任务最先执行，有截止时间的高优先级任务排在同优先级其他任务之前
+    auto pos = [&order](int value) {
+        return std::find(order.begin(), order.end(), value) - order.begin();
+    };
+    failed += (10 == order[0] && pos(11) < pos(12) && pos(12) < pos(Scheduler::HIGH))? 0: 1;
+    // 三个优先级都有任务时按8:4:1的比例执行
+    int count[Scheduler::PRIORITY_COUNT] = {0};
+    for(size_t i = 1; i < 1 + 130; ++i) {
+        ++count[order[i] > Scheduler::BACKGROUND? Scheduler::HIGH: order[i]];
+    }
+    failed += (80 == count[Scheduler::HIGH] && 40 == count[Scheduler::NORMAL]
+        && 10 == count[Scheduler::BACKGROUND])? 0: 1;
+    Scheduler::PriorityStats stats = sc.getPriorityStats(Scheduler::BACKGROUND);
+    failed += (131 == stats.m_executed && 1 == stats.m_deadlineMissed && 0 == stats.m_depth)? 0: 1;
+    FOCUS_LOG_INFO(g_logger) << "priority order high=" << count[Scheduler::HIGH]
+        << " normal=" << count[Scheduler::NORMAL] << " background=" << count[Scheduler::BACKGROUND]
+        << " failed=" << failed;
+    return failed;
+}
+
+/**
+ * @brief 后台任务堆积时，延迟敏感任务的排队时间
+ * @param[in] priority 延迟敏感任务使用的优先级
+ * @return 平均排队时间(微秒)
+ */
+uint64_t testPriorityLatency(Scheduler::Priority priority) {
+    const int bulk = 2000;
+    const int requests = 100;
+    std::atomic<int> done = {0};
+    Scheduler sc(2, false, "latency");
+    sc.start();
+    for(int i = 0; i < bulk; ++i) {
+        sc.schedule([&done](){
+            BusyWait(50);
+            ++done;
+        }, Scheduler::BACKGROUND);
+    }
+    for(int i = 0; i < requests; ++i) {
+        sc.schedule([&done](){
+            ++done;
+        }, priority);
+        usleep(500);
+    }
+    while(done < bulk + requests) {
+        usleep(1000);
+    }
+    sc.stop();
+    Scheduler::PriorityStats stats = sc.getPriorityStats(priority);
+    uint64_t avg = stats.m_totalWaitUs / std::max<uint64_t>(stats.m_executed, 1);
+    FOCUS_LOG_INFO(g_logger) << "request priority=" << priority << " avg wait=" << avg
+        << " us max wait=" << stats.m_maxWaitUs << " us";
+    return avg;
+}
+
 int main(int argc, char* argv[]) {
+    // 回调协程缓存，在caller线程开启hook之前执行
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    int failed = 0;
+    failed += testFiberCache("0");
+    failed += testFiberCache("32");
+    failed += testInline(false);
+    failed += testInline(true);
+    failed += testPriorityOrder();
+    // 同样是后台优先级时需要排在所有堆积任务之后
+    failed += testPriorityLatency(Scheduler::HIGH) < testPriorityLatency(Scheduler::BACKGROUND)? 0: 1;
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::DEBUG);
+
     Scheduler::ptr scheduler(new Scheduler(2));
     scheduler->start();
     std::vector<Fiber::ptr> vecWorkFibers;
@@ -19,8 +204,17 @@ int main(int argc, char* argv[]) {
         vecWorkFibers.emplace_back(new Fiber(std::bind(&fun, i)));
     }
     scheduler->schedule(vecWorkFibers.begin(), vecWorkFibers.end());
+    // 在调度线程中添加任务，进入本地队列，也可以绑定到caller线程
+    scheduler->schedule([scheduler](){
+        for(int i = 10; i < 20; ++i) {
+            scheduler->schedule(std::bind(&fun, i));
+        }
+        scheduler->schedule(std::bind(&fun, 20), GetThreadId());
+    });
     sleep(1);
     scheduler->stop();
     FOCUS_LOG_DEBUG(g_logger) << "main end";
-    return 0;
-}
\ No newline at end of file
+
+    FOCUS_LOG_INFO(g_logger) << (failed? "FAILED": "OK");
+    return failed? 1: 0;
+}
@@ -0,0 +1,99 @@
+#include "iomanager.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include <unistd.h>
+#include <atomic>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_tickle");
+
+/**
+ * @brief 分批添加小任务，统计tickle调用次数和实际唤醒的系统调用次数
+ * @details 改动前每次tickle只要有空闲线程就会写一次管道
+ */
+int benchmark(const std::string& backend, int rounds, int tasks) {
+    std::atomic<int> done = {0};
+    uint64_t tickles = 0;
+    uint64_t signals = 0;
+    std::string name;
+    // 通过配置选择后端，结束后恢复
+    ConfigVarBase::ptr var = Config::LookUpBase("iomanager.backend");
+    std::string old = var->toString();
+    var->fromString(backend);
+    uint64_t start = GetCurrentMS();
+    {
+        IOManager iom(4, false, "tickle");
+        name = iom.getBackendName();
+        for(int i = 0; i < rounds; ++i) {
+            for(int j = 0; j < tasks; ++j) {
+                iom.schedule([&done](){
+                    ++done;
+                });
+            }
+            // 让工作线程重新睡眠
+            usleep(1000);
+        }
+        while(done < rounds * tasks) {
+            usleep(1000);
+        }
+        tickles = iom.getTickleCount();
+        signals = iom.getTickleSignalCount();
+    }
+    uint64_t used = GetCurrentMS() - start;
+    var->fromString(old);
+    FOCUS_LOG_INFO(g_logger) << backend << " backend = " << name << " tasks = " << done
+        << " tickle = " << tickles
+        << " signal = " << signals
+        << " saved = " << tickles - signals
+        << " used = " << used << "ms";
+    return done == rounds * tasks? 0: 1;
+}
+
+/**
+ * @brief 同时到期的定时器在idle中批量调度
+ */
+int timerBurst(const std::string& backend, int timers) {
+    std::atomic<int> done = {0};
+    uint64_t tickles = 0;
+    uint64_t signals = 0;
+    std::string name;
+    ConfigVarBase::ptr var = Config::LookUpBase("iomanager.backend");
+    std::string old = var->toString();
+    var->fromString(backend);
+    {
+        IOManager iom(4, false, "timer_burst");
+        name = iom.getBackendName();
+        iom.schedule([&iom, &done, timers](){
+            for(int i = 0; i < timers; ++i) {
+                iom.addTimer([&done](){
+                    ++done;
+                }, 10);
+            }
+        });
+        while(done < timers) {
+            usleep(1000);
+        }
+        tickles = iom.getTickleCount();
+        signals = iom.getTickleSignalCount();
+    }
+    var->fromString(old);
+    FOCUS_LOG_INFO(g_logger) << backend << " backend = " << name << " timers = " << done
+        << " tickle = " << tickles
+        << " signal = " << signals;
+    return done == timers? 0: 1;
+}
+
+int main(int argc, char* argv[]) {
+    // 关闭系统日志
+    FOCUS_LOG_NAME("system")->setLevel(LogLevel::FATAL);
+    int rounds = argc > 1? atoi(argv[1]): 200;
+    int tasks = argc > 2? atoi(argv[2]): 100;
+    int failed = 0;
+    failed += benchmark("epoll", rounds, tasks);
+    failed += benchmark("io_uring", rounds, tasks);
+    failed += timerBurst("epoll", 10000);
+    failed += timerBurst("io_uring", 10000);
+    return failed? 1: 0;
+}
@@ -0,0 +1,144 @@
+#include "timer.h"
+#include "log.h"
+#include "util.h"
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+using namespace focus;
+
+static Logger::ptr g_logger = FOCUS_LOG_NAME("test_timer");
+
+/**
+ * @brief 不需要唤醒的定时器管理器
+ */
+class TestTimerManager: public TimerManager {
+public:
+    TestTimerManager(Type type): TimerManager(type) {}
+
+    /**
+     * @brief 等待并执行到期的定时器，直到没有定时器或者超过maxMs
+     */
+    void runFor(uint64_t maxMs) {
+        uint64_t end = GetCurrentMS() + maxMs;
+        while(hasTimer() && GetCurrentMS() < end) {
+            uint64_t next = getNextTimer();
+            if(next > 0) {
+                usleep(std::min<uint64_t>(next, end - GetCurrentMS()) * 1000);
+            }
+            std::vector<std::function<void()>> cbs;
+            listExpiredCb(cbs);
+            for(auto& cb: cbs) {
+                cb();
+            }
+        }
+    }
+
+protected:
+    void onTimerInsertAtFront() override {}
+};
+
+static const char* TypeName(TimerManager::Type type) {
+    return TimerManager::WHEEL == type? "wheel": "set";
+}
+
+/**
+ * @brief 检查到期时间、取消、刷新和循环定时器
+ */
+int testCorrect(TimerManager::Type type) {
+    TestTimerManager mgr(type);
+    int failed = 0;
+    uint64_t start = GetCurrentMS();
+    std::vector<uint64_t> delays = {0, 1, 7, 255, 256, 300, 700};
+    for(uint64_t delay: delays) {
+        mgr.addTimer([&failed, start, delay](){
+            uint64_t elapsed = GetCurrentMS() - start;
+            if(elapsed < delay || elapsed > delay + 50) {
+                FOCUS_LOG_ERROR(g_logger) << "delay = " << delay << " elapsed = " << elapsed;
+                ++failed;
+            }
+        }, delay);
+    }
+
+    // 取消的定时器不执行
+    Timer::ptr canceled = mgr.addTimer([&failed](){
+        ++failed;
+    }, 100);
+    canceled->cancel();
+
+    // 刷新后从现在重新计时
+    uint64_t refreshAt = 0;
+    Timer::ptr refreshed = mgr.addTimer([&failed, &refreshAt](){
+        if(GetCurrentMS() - refreshAt < 200) {
+            ++failed;
+        }
+    }, 200);
+
+    // 循环定时器执行3次后取消
+    int count = 0;
+    Timer::ptr recurring;
+    recurring = mgr.addTimer([&count, &recurring](){
+        if(3 == ++count) {
+            recurring->cancel();
+        }
+    }, 50, true);
+
+    // 超出时间轮范围的定时器
+    Timer::ptr far = mgr.addTimer([&failed](){
+        ++failed;
+    }, 1ull << 33);
+
+    mgr.runFor(100);
+    refreshAt = GetCurrentMS();
+    refreshed->refresh();
+    mgr.runFor(1000);
+    far->cancel();
+
+    if(3 != count || mgr.hasTimer()) {
+        FOCUS_LOG_ERROR(g_logger) << "count = " << count << " hasTimer = " << mgr.hasTimer();
+        ++failed;
+    }
+    FOCUS_LOG_INFO(g_logger) << TypeName(type) << " correct " << (failed? "FAILED": "OK");
+    return failed;
+}
+
+/**
+ * @brief 模拟每个连接一个接收超时定时器的场景
+ */
+void benchmark(TimerManager::Type type, size_t n) {
+    TestTimerManager mgr(type);
+    std::vector<Timer::ptr> timers;
+    timers.reserve(n);
+    auto t0 = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i) {
+        timers.emplace_back(mgr.addTimer([](){}, 5000 + i % 10000));
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for(auto& timer: timers) {
+        timer->refresh();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for(auto& timer: timers) {
+        timer->cancel();
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    auto us = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(b - a).count();
+    };
+    FOCUS_LOG_INFO(g_logger) << TypeName(type) << " n = " << n
+        << " add = " << us(t0, t1) << "us"
+        << " refresh = " << us(t1, t2) << "us"
+        << " cancel = " << us(t2, t3) << "us";
+}
+
+int main(int argc, char* argv[]) {
+    int failed = 0;
+    failed += testCorrect(TimerManager::SET);
+    failed += testCorrect(TimerManager::WHEEL);
+
+    size_t n = argc > 1? atoi(argv[1]): 100000;
+    benchmark(TimerManager::SET, n);
+    benchmark(TimerManager::WHEEL, n);
+    return failed? 1: 0;
+}